@@ -0,0 +1,107 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+	LZ4 block decompressor, fed through the fifo of
+	target_run_flash_async_algorithm()
+
+	parameters:
+	r0 - fifo start, holds the write and read pointers
+	r1 - fifo end
+	r2 - destination address
+	r3 - destination end address
+
+	The read pointer is set to 0 if the stream is corrupt.
+*/
+
+	.text
+	.arm
+
+_start:
+main:
+	mov		r8, r2			/* destination start */
+	ldr		r4, [r0, #4]		/* rp */
+next_token:
+	cmp		r2, r3
+	bhs		exit
+	bl		get_byte
+	mov		r5, r7			/* token */
+	mov		r6, r5, lsr #4		/* literal length */
+	bl		get_length
+	cmp		r6, #0
+	beq		literals_done
+literal:
+	bl		get_byte
+	cmp		r2, r3
+	bhs		error
+	strb	r7, [r2], #1
+	subs	r6, r6, #1
+	bne		literal
+literals_done:
+	cmp		r2, r3
+	bhs		exit			/* the last sequence has no match */
+	bl		get_byte
+	mov		r6, r7
+	bl		get_byte
+	orrs	r6, r6, r7, lsl #8	/* match offset */
+	beq		error
+	sub		r7, r2, r8		/* bytes decompressed so far */
+	cmp		r6, r7
+	bhi		error
+	sub		r9, r2, r6		/* match source */
+	and		r6, r5, #15
+	bl		get_length
+	add		r6, r6, #4		/* match length */
+match:
+	cmp		r2, r3
+	bhs		error
+	ldrb	r7, [r9], #1
+	strb	r7, [r2], #1
+	subs	r6, r6, #1
+	bne		match
+	b		next_token
+
+/* add the extension bytes of a length field of 15 to r6 */
+get_length:
+	cmp		r6, #15
+	movne	pc, lr
+	mov		r10, lr
+length_byte:
+	bl		get_byte
+	add		r6, r6, r7
+	cmp		r7, #255
+	beq		length_byte
+	mov		pc, r10
+
+/* wait for the next byte in the fifo and return it in r7 */
+get_byte:
+	ldr		r11, [r0]		/* wp */
+	cmp		r11, #0
+	beq		exit			/* aborted */
+	cmp		r11, r4
+	beq		get_byte		/* fifo empty */
+	ldrb	r7, [r4], #1
+	cmp		r4, r1
+	addhs	r4, r0, #8
+	str		r4, [r0, #4]		/* rp */
+	mov		pc, lr
+
+error:
+	mov		r4, #0
+	str		r4, [r0, #4]		/* rp = 0 */
+exit:
+	bkpt	#0
+
+	.end
@@ -1268,21 +1268,16 @@ static int cfi_intel_write_block(struct flash_bank *bank, const uint8_t *buffer,
 
 	target_buffer_set_u32_array(target, target_code, target_code_size / 4, target_code_src);
 
-	/* Get memory for block write handler */
-	retval = target_alloc_working_area(target,
-			target_code_size,
-			&write_algorithm);
-	if (retval != ERROR_OK) {
+	/* Get memory for block write handler, with the algorithm code loaded */
+	retval = target_alloc_working_area_code(target, target_code,
+			target_code_size, &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("No working area available, can't do block memory writes");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		return retval;
 	}
-
-	/* write algorithm code to working area */
-	retval = target_write_buffer(target, write_algorithm->address,
-			target_code_size, target_code);
 	if (retval != ERROR_OK) {
 		LOG_ERROR("Unable to write block write code to target");
-		goto cleanup;
+		return retval;
 	}
 
 	/* Get a workspace buffer for the data to flash starting with 32k size.
@@ -1507,23 +1502,12 @@ static int cfi_spansion_write_block_mips(struct flash_bank *bank, const uint8_t
 
 	target_buffer_set_u32_array(target, target_code, target_code_size / 4, target_code_src);
 
-	/* allocate working area */
-	retval = target_alloc_working_area(target, target_code_size,
-			&write_algorithm);
-	if (retval != ERROR_OK) {
-		free(target_code);
-		return retval;
-	}
-
-	/* write algorithm code to working area */
-	retval = target_write_buffer(target, write_algorithm->address,
-			target_code_size, target_code);
-	if (retval != ERROR_OK) {
-		free(target_code);
-		return retval;
-	}
-
+	/* allocate working area, with the algorithm code loaded */
+	retval = target_alloc_working_area_code(target, target_code,
+			target_code_size, &write_algorithm);
 	free(target_code);
+	if (retval != ERROR_OK)
+		return retval;
 
 	/* the following code still assumes target code is fixed 24*4 bytes */
 
@@ -1587,7 +1571,8 @@ static int cfi_spansion_write_block_mips(struct flash_bank *bank, const uint8_t
 		count -= thisrun_count;
 	}
 
-	target_free_all_working_areas(target);
+	target_free_working_area(target, source);
+	target_free_working_area(target, write_algorithm);
 
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
@@ -1886,23 +1871,12 @@ static int cfi_spansion_write_block(struct flash_bank *bank, const uint8_t *buff
 
 	target_buffer_set_u32_array(target, target_code, target_code_size / 4, target_code_src);
 
-	/* allocate working area */
-	retval = target_alloc_working_area(target, target_code_size,
-			&write_algorithm);
-	if (retval != ERROR_OK) {
-		free(target_code);
-		return retval;
-	}
-
-	/* write algorithm code to working area */
-	retval = target_write_buffer(target, write_algorithm->address,
-			target_code_size, target_code);
-	if (retval != ERROR_OK) {
-		free(target_code);
-		return retval;
-	}
-
+	/* allocate working area, with the algorithm code loaded */
+	retval = target_alloc_working_area_code(target, target_code,
+			target_code_size, &write_algorithm);
 	free(target_code);
+	if (retval != ERROR_OK)
+		return retval;
 
 	/* the following code still assumes target code is fixed 24*4 bytes */
 
@@ -1966,7 +1940,8 @@ static int cfi_spansion_write_block(struct flash_bank *bank, const uint8_t *buff
 		count -= thisrun_count;
 	}
 
-	target_free_all_working_areas(target);
+	target_free_working_area(target, source);
+	target_free_working_area(target, write_algorithm);
 
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
@@ -26,6 +26,8 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <helper/metrics.h>
+#include <helper/timeline.h>
 
 /**
  * @file
@@ -38,9 +40,12 @@ static struct flash_bank *flash_banks;
 
 int flash_driver_erase(struct flash_bank *bank, int first, int last)
 {
+	struct timeline_span span;
 	int retval;
 
+	timeline_begin(&span);
 	retval = bank->driver->erase(bank, first, last);
+	timeline_end(&span, "flash", "erase", bank->driver->name);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %d to %d", first, last);
 
@@ -85,18 +90,26 @@ int flash_driver_protect(struct flash_bank *bank, int set, int first, int last)
 	return retval;
 }
 
+static struct metric_family flash_write_bytes_metric =
+	METRIC_COUNTER("openocd_flash_write_bytes_total",
+		"Bytes programmed into flash, by flash driver.", "driver");
+
 int flash_driver_write(struct flash_bank *bank,
 	uint8_t *buffer, uint32_t offset, uint32_t count)
 {
+	struct timeline_span span;
 	int retval;
 
+	timeline_begin(&span);
 	retval = bank->driver->write(bank, buffer, offset, count);
+	timeline_end(&span, "flash", "write", bank->driver->name);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
 			"error writing to flash at address 0x%08" PRIx32 " at offset 0x%8.8" PRIx32,
 			bank->base,
 			offset);
-	}
+	} else
+		metric_add_label(&flash_write_bytes_metric, bank->driver->name, count);
 
 	return retval;
 }
@@ -784,6 +797,197 @@ int flash_write(struct target *target, struct image *image,
 	return flash_write_unlock(target, image, written, erase, false);
 }
 
+/* pending data of an incremental write, always within a single bank */
+struct flash_write_stream {
+	struct target *target;
+	struct flash_bank *bank;
+	uint32_t addr;		/* address of the first pending byte */
+	uint32_t size;		/* number of pending bytes */
+	uint32_t buffer_size;	/* allocated size of buffer */
+	uint8_t *buffer;
+	uint32_t written;
+};
+
+struct flash_write_stream *flash_write_stream_open(struct target *target)
+{
+	struct flash_write_stream *stream = calloc(1, sizeof(*stream));
+
+	if (stream == NULL) {
+		LOG_ERROR("Out of memory for flash write stream");
+		return NULL;
+	}
+
+	stream->target = target;
+	return stream;
+}
+
+/* end address of the sector holding @a addr, or the bank end if unknown */
+static uint32_t flash_sector_end(struct flash_bank *bank, uint32_t addr)
+{
+	uint32_t offset = addr - bank->base;
+	int i;
+
+	for (i = 0; i < bank->num_sectors; i++) {
+		uint32_t end = bank->sectors[i].offset + bank->sectors[i].size;
+		if (offset < end)
+			return bank->base + end;
+	}
+
+	return bank->base + bank->size;
+}
+
+/* program the first @a count pending bytes and drop them from the buffer */
+static int flash_write_stream_flush(struct flash_write_stream *stream,
+		uint32_t count)
+{
+	int retval;
+
+	if (count == 0)
+		return ERROR_OK;
+
+	retval = flash_driver_write(stream->bank, stream->buffer,
+			stream->addr - stream->bank->base, count);
+	if (retval != ERROR_OK)
+		return retval;
+
+	stream->written += count;
+	stream->addr += count;
+	stream->size -= count;
+	memmove(stream->buffer, stream->buffer + count, stream->size);
+
+	return ERROR_OK;
+}
+
+static int flash_write_stream_append(struct flash_write_stream *stream,
+		const uint8_t *data, uint32_t size, uint8_t fill)
+{
+	if (stream->size + size > stream->buffer_size) {
+		/* grow geometrically, the buffer only ever holds about one
+		 * sector since completed sectors are programmed and dropped */
+		uint32_t new_size = MAX(stream->buffer_size * 2, stream->size + size);
+		uint8_t *buffer = realloc(stream->buffer, new_size);
+
+		if (buffer == NULL) {
+			LOG_ERROR("Out of memory for flash write stream");
+			return ERROR_FAIL;
+		}
+		stream->buffer = buffer;
+		stream->buffer_size = new_size;
+	}
+
+	if (data != NULL)
+		memcpy(stream->buffer + stream->size, data, size);
+	else
+		memset(stream->buffer + stream->size, fill, size);
+	stream->size += size;
+
+	return ERROR_OK;
+}
+
+int flash_write_stream_add(struct flash_write_stream *stream,
+		uint32_t addr, const uint8_t *data, uint32_t size)
+{
+	int retval;
+
+	while (size > 0) {
+		if (stream->size > 0) {
+			uint32_t pending_end = stream->addr + stream->size;
+
+			if (addr > pending_end &&
+					addr < flash_sector_end(stream->bank, pending_end - 1)) {
+				/* small gap inside the last pending sector: pad it, as
+				 * flash_write() does, rather than programming that
+				 * sector twice */
+				retval = flash_write_stream_append(stream, NULL,
+						addr - pending_end, stream->bank->default_padded_value);
+				if (retval != ERROR_OK)
+					return retval;
+			} else if (addr != pending_end) {
+				retval = flash_write_stream_flush(stream, stream->size);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+		}
+
+		if (stream->size == 0) {
+			retval = get_flash_bank_by_addr(stream->target, addr, false,
+					&stream->bank);
+			if (retval != ERROR_OK)
+				return retval;
+			if (stream->bank == NULL) {
+				LOG_WARNING("no flash bank found for address %" PRIx32, addr);
+				return ERROR_OK;
+			}
+			stream->addr = addr;
+		}
+
+		/* never let pending data cross the end of its bank */
+		uint32_t count = size;
+		uint32_t bank_left = stream->bank->base + stream->bank->size - addr;
+		if (count > bank_left)
+			count = bank_left;
+
+		retval = flash_write_stream_append(stream, data, count, 0);
+		if (retval != ERROR_OK)
+			return retval;
+
+		addr += count;
+		data += count;
+		size -= count;
+
+		if (size > 0) {
+			retval = flash_write_stream_flush(stream, stream->size);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+int flash_write_stream_program(struct flash_write_stream *stream)
+{
+	uint32_t end, complete = 0;
+
+	if (stream->size == 0)
+		return ERROR_OK;
+
+	/* find the last sector boundary covered by the pending data */
+	end = flash_sector_end(stream->bank, stream->addr);
+	while (end <= stream->addr + stream->size) {
+		complete = end - stream->addr;
+		if (end == stream->bank->base + stream->bank->size)
+			break;
+		end = flash_sector_end(stream->bank, end);
+	}
+
+	return flash_write_stream_flush(stream, complete);
+}
+
+int flash_write_stream_close(struct flash_write_stream *stream,
+		uint32_t *written)
+{
+	int retval = ERROR_OK;
+
+	if (stream->size > 0)
+		retval = flash_write_stream_flush(stream, stream->size);
+
+	if (written)
+		*written = stream->written;
+
+	flash_write_stream_free(stream);
+	return retval;
+}
+
+void flash_write_stream_free(struct flash_write_stream *stream)
+{
+	if (stream == NULL)
+		return;
+
+	free(stream->buffer);
+	free(stream);
+}
+
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size, int num_blocks)
 {
 	int i;
@@ -148,6 +148,45 @@ int flash_unlock_address_range(struct target *target, uint32_t addr,
 int flash_write(struct target *target,
 		struct image *image, uint32_t *written, int erase);
 
+struct flash_write_stream;
+
+/**
+ * Starts an incremental flash write on @a target.  Data is then handed
+ * over with flash_write_stream_add() in pieces of ascending address, and
+ * every sector that has been completely received is programmed by
+ * flash_write_stream_program(), so programming can proceed while the
+ * rest of the data is still being transferred.  Like flash_write() with
+ * @a erase zero, the flash must already be erased.
+ * @returns A new stream, or NULL if out of memory.
+ */
+struct flash_write_stream *flash_write_stream_open(struct target *target);
+
+/**
+ * Queues @a size bytes at @a addr for programming.  No flash access is
+ * done here unless the data is not contiguous with the pending data, in
+ * which case the pending data is written first.
+ * @returns ERROR_OK if successful; otherwise, an error code.
+ */
+int flash_write_stream_add(struct flash_write_stream *stream,
+		uint32_t addr, const uint8_t *data, uint32_t size);
+
+/**
+ * Programs all pending sectors that have been completely received.
+ * @returns ERROR_OK if successful; otherwise, an error code.
+ */
+int flash_write_stream_program(struct flash_write_stream *stream);
+
+/**
+ * Programs any remaining data, releases the stream and reports the total
+ * number of bytes programmed in @a written.
+ * @returns ERROR_OK if successful; otherwise, an error code.
+ */
+int flash_write_stream_close(struct flash_write_stream *stream,
+		uint32_t *written);
+
+/** Releases @a stream, discarding any data not yet programmed. */
+void flash_write_stream_free(struct flash_write_stream *stream);
+
 /**
  * Forces targets to re-examine their erase/protection state.
  * This routine must be called when the system may modify the status.
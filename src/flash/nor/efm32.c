@@ -662,14 +662,10 @@ static int efm32x_write_block(struct flash_bank *bank, const uint8_t *buf,
 	};
 
 	/* flash write code */
-	if (target_alloc_working_area(target, sizeof(efm32x_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	ret = target_alloc_working_area_code(target, efm32x_flash_write_code,
+			sizeof(efm32x_flash_write_code), &write_algorithm);
+	if (ret == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
 		LOG_WARNING("no working area available, can't do block memory writes");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	ret = target_write_buffer(target, write_algorithm->address,
-			sizeof(efm32x_flash_write_code), efm32x_flash_write_code);
 	if (ret != ERROR_OK)
 		return ret;
 
@@ -767,17 +767,11 @@ int kinetis_disable_wdog(struct target *target, uint32_t sim_sdid)
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
-	retval = target_alloc_working_area(target, sizeof(kinetis_unlock_wdog_code), &wdog_algorithm);
+	retval = target_alloc_working_area_code(target, (uint8_t *)kinetis_unlock_wdog_code,
+			sizeof(kinetis_unlock_wdog_code), &wdog_algorithm);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = target_write_buffer(target, wdog_algorithm->address,
-			sizeof(kinetis_unlock_wdog_code), (uint8_t *)kinetis_unlock_wdog_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, wdog_algorithm);
-		return retval;
-	}
-
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
 	armv7m_info.core_mode = ARM_MODE_THREAD;
 
@@ -892,14 +886,10 @@ static int kinetis_write_block(struct flash_bank *bank, const uint8_t *buffer,
 		buffer_size = (target->working_area_size/2);
 
 	/* allocate working area with flash programming code */
-	if (target_alloc_working_area(target, sizeof(kinetis_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_working_area_code(target, kinetis_flash_write_code,
+			sizeof(kinetis_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
 		LOG_WARNING("no working area available, can't do block memory writes");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-		sizeof(kinetis_flash_write_code), kinetis_flash_write_code);
 	if (retval != ERROR_OK)
 		return retval;
 
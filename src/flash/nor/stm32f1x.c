@@ -614,14 +614,10 @@ static int stm32x_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	};
 
 	/* flash write code */
-	if (target_alloc_working_area(target, sizeof(stm32x_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_working_area_code(target, stm32x_flash_write_code,
+			sizeof(stm32x_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
 		LOG_WARNING("no working area available, can't do block memory writes");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32x_flash_write_code), stm32x_flash_write_code);
 	if (retval != ERROR_OK)
 		return retval;
 
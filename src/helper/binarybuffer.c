@@ -427,14 +427,17 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 {
 	size_t i;
-	uint8_t tmp;
 
 	if (!length)
 		return 0;
 
-	for (i = 0; i < length - 1 && i < 2 * count; i++) {
-		tmp = (bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f;
-		hex[i] = hex_digits[tmp];
+	/* whole bytes first, then a possible trailing high nibble */
+	for (i = 0; i + 2 < length && i < 2 * count; i += 2)
+		hexify_byte(hex + i, bin[i / 2]);
+
+	if (i < length - 1 && i < 2 * count) {
+		hex[i] = hex_digits[bin[i / 2] >> 4];
+		i++;
 	}
 
 	hex[i] = 0;
@@ -442,6 +445,25 @@ size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 	return i;
 }
 
+/**
+ * Convert one byte into a pair of lowercase hexadecimal digits.
+ *
+ * This is the table-driven replacement for sprintf("%02x") on hot paths
+ * such as register list encoding in the GDB server and RTOS support.
+ *
+ * @param[out] hex Buffer receiving exactly two characters; no null-terminator
+ *                 is written.
+ * @param[in] byte Value to convert.
+ *
+ * @returns Pointer to the character following the written pair.
+ */
+char *hexify_byte(char *hex, uint8_t byte)
+{
+	hex[0] = hex_digits[byte >> 4];
+	hex[1] = hex_digits[byte & 0x0f];
+	return hex + 2;
+}
+
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count)
 {
 	unsigned i;
@@ -236,6 +236,7 @@ void bit_copy_discard(struct bit_copy_queue *q);
  * used in ti-icdi driver and gdb server */
 size_t unhexify(uint8_t *bin, const char *hex, size_t count);
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t out_maxlen);
+char *hexify_byte(char *hex, uint8_t byte);
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count);
 
 #endif /* OPENOCD_HELPER_BINARYBUFFER_H */
@@ -30,16 +30,500 @@
 #include "configuration.h"
 #include "fileio.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBLZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#define FILEIO_DECODER_BUFFER_SIZE	(64 * 1024)
+
+struct fileio_decoder;
+
+/*
+ * A stream decompressor for files that start with its magic number.
+ * decode() decompresses into decoder->out, reading decoder->in with
+ * fileio_decoder_fill() when it runs dry, and sets decoder->eof at the
+ * end of the data.
+ */
+struct fileio_codec {
+	const char *name;
+	/* only file names ending in this are decompressed */
+	const char *suffix;
+	const uint8_t *magic;
+	size_t magic_size;
+	int (*init)(struct fileio_decoder *decoder);
+	int (*decode)(struct fileio_decoder *decoder);
+	void (*quit)(struct fileio_decoder *decoder);
+};
+
+struct fileio_decoder {
+	const struct fileio_codec *codec;
+	void *stream;
+	const char *url;
+	FILE *file;
+
+	uint8_t in[FILEIO_DECODER_BUFFER_SIZE];
+	size_t in_size;
+	bool in_eof;
+
+	uint8_t out[FILEIO_DECODER_BUFFER_SIZE];
+	size_t out_pos;
+	size_t out_size;
+
+	size_t position;	/* decompressed offset of out[out_pos] */
+	bool eof;
+};
+
 struct fileio {
 	char *url;
 	size_t size;
+	bool size_valid;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	struct fileio_decoder *decoder;	/* NULL unless compressed */
+	uint8_t *data;			/* see fileio_map() */
+	size_t data_size;
+	bool data_mapped;
 };
 
+static int fileio_decoder_fill(struct fileio_decoder *decoder)
+{
+	decoder->in_size = fread(decoder->in, 1, sizeof(decoder->in), decoder->file);
+	if (decoder->in_size == 0) {
+		if (ferror(decoder->file)) {
+			LOG_ERROR("couldn't read %s: %s", decoder->url, strerror(errno));
+			return ERROR_FILEIO_OPERATION_FAILED;
+		}
+		decoder->in_eof = true;
+	}
+
+	return ERROR_OK;
+}
+
+#ifdef HAVE_ZLIB
+static int fileio_gzip_init(struct fileio_decoder *decoder)
+{
+	z_stream *zs = calloc(1, sizeof(*zs));
+	if (zs == NULL)
+		return ERROR_FAIL;
+
+	/* 16 + MAX_WBITS: expect a gzip header */
+	if (inflateInit2(zs, 16 + MAX_WBITS) != Z_OK) {
+		free(zs);
+		return ERROR_FAIL;
+	}
+
+	decoder->stream = zs;
+	return ERROR_OK;
+}
+
+static int fileio_gzip_decode(struct fileio_decoder *decoder)
+{
+	z_stream *zs = decoder->stream;
+
+	zs->next_out = decoder->out;
+	zs->avail_out = sizeof(decoder->out);
+
+	while (zs->avail_out > 0) {
+		if (zs->avail_in == 0) {
+			int retval = fileio_decoder_fill(decoder);
+			if (retval != ERROR_OK)
+				return retval;
+			zs->next_in = decoder->in;
+			zs->avail_in = decoder->in_size;
+		}
+
+		int ret = inflate(zs, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			/* gzip allows several members in one file */
+			if (zs->avail_in == 0) {
+				int retval = fileio_decoder_fill(decoder);
+				if (retval != ERROR_OK)
+					return retval;
+				zs->next_in = decoder->in;
+				zs->avail_in = decoder->in_size;
+			}
+			if (zs->avail_in == 0) {
+				decoder->eof = true;
+				break;
+			}
+			inflateReset(zs);
+		} else if (ret == Z_BUF_ERROR && decoder->in_eof) {
+			LOG_ERROR("%s: unexpected end of gzip data", decoder->url);
+			return ERROR_FILEIO_OPERATION_FAILED;
+		} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			LOG_ERROR("%s: corrupt gzip data: %s", decoder->url,
+					zs->msg ? zs->msg : "unknown error");
+			return ERROR_FILEIO_OPERATION_FAILED;
+		}
+	}
+
+	decoder->out_size = sizeof(decoder->out) - zs->avail_out;
+	return ERROR_OK;
+}
+
+static void fileio_gzip_quit(struct fileio_decoder *decoder)
+{
+	inflateEnd(decoder->stream);
+	free(decoder->stream);
+}
+
+static const uint8_t fileio_gzip_magic[] = { 0x1f, 0x8b };
+#endif
+
+#ifdef HAVE_LIBLZMA
+static int fileio_xz_init(struct fileio_decoder *decoder)
+{
+	static const lzma_stream init = LZMA_STREAM_INIT;
+	lzma_stream *xz = malloc(sizeof(*xz));
+	if (xz == NULL)
+		return ERROR_FAIL;
+
+	*xz = init;
+	if (lzma_stream_decoder(xz, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+		free(xz);
+		return ERROR_FAIL;
+	}
+
+	decoder->stream = xz;
+	return ERROR_OK;
+}
+
+static int fileio_xz_decode(struct fileio_decoder *decoder)
+{
+	lzma_stream *xz = decoder->stream;
+
+	xz->next_out = decoder->out;
+	xz->avail_out = sizeof(decoder->out);
+
+	while (xz->avail_out > 0) {
+		if (xz->avail_in == 0 && !decoder->in_eof) {
+			int retval = fileio_decoder_fill(decoder);
+			if (retval != ERROR_OK)
+				return retval;
+			xz->next_in = decoder->in;
+			xz->avail_in = decoder->in_size;
+		}
+
+		lzma_ret ret = lzma_code(xz, decoder->in_eof ? LZMA_FINISH : LZMA_RUN);
+		if (ret == LZMA_STREAM_END) {
+			decoder->eof = true;
+			break;
+		} else if (ret == LZMA_BUF_ERROR) {
+			LOG_ERROR("%s: unexpected end of xz data", decoder->url);
+			return ERROR_FILEIO_OPERATION_FAILED;
+		} else if (ret != LZMA_OK) {
+			LOG_ERROR("%s: corrupt xz data (error %d)", decoder->url, ret);
+			return ERROR_FILEIO_OPERATION_FAILED;
+		}
+	}
+
+	decoder->out_size = sizeof(decoder->out) - xz->avail_out;
+	return ERROR_OK;
+}
+
+static void fileio_xz_quit(struct fileio_decoder *decoder)
+{
+	lzma_end(decoder->stream);
+	free(decoder->stream);
+}
+
+static const uint8_t fileio_xz_magic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+#endif
+
+#ifdef HAVE_LIBZSTD
+struct fileio_zstd {
+	ZSTD_DStream *ds;
+	ZSTD_inBuffer in;
+};
+
+static int fileio_zstd_init(struct fileio_decoder *decoder)
+{
+	struct fileio_zstd *zstd = calloc(1, sizeof(*zstd));
+	if (zstd == NULL)
+		return ERROR_FAIL;
+
+	zstd->ds = ZSTD_createDStream();
+	if (zstd->ds == NULL || ZSTD_isError(ZSTD_initDStream(zstd->ds))) {
+		ZSTD_freeDStream(zstd->ds);
+		free(zstd);
+		return ERROR_FAIL;
+	}
+	zstd->in.src = decoder->in;
+
+	decoder->stream = zstd;
+	return ERROR_OK;
+}
+
+static int fileio_zstd_decode(struct fileio_decoder *decoder)
+{
+	struct fileio_zstd *zstd = decoder->stream;
+	ZSTD_outBuffer out = { decoder->out, sizeof(decoder->out), 0 };
+
+	while (out.pos < out.size) {
+		if (zstd->in.pos == zstd->in.size && !decoder->in_eof) {
+			int retval = fileio_decoder_fill(decoder);
+			if (retval != ERROR_OK)
+				return retval;
+			zstd->in.size = decoder->in_size;
+			zstd->in.pos = 0;
+		}
+
+		/* also decodes the frames following the first one */
+		size_t produced = out.pos;
+		size_t ret = ZSTD_decompressStream(zstd->ds, &out, &zstd->in);
+		if (ZSTD_isError(ret)) {
+			LOG_ERROR("%s: corrupt zstd data: %s", decoder->url,
+					ZSTD_getErrorName(ret));
+			return ERROR_FILEIO_OPERATION_FAILED;
+		}
+
+		if (decoder->in_eof && zstd->in.pos == zstd->in.size && out.pos == produced) {
+			/* 0 when the last frame is complete and flushed */
+			if (ret != 0) {
+				LOG_ERROR("%s: unexpected end of zstd data", decoder->url);
+				return ERROR_FILEIO_OPERATION_FAILED;
+			}
+			decoder->eof = true;
+			break;
+		}
+	}
+
+	decoder->out_size = out.pos;
+	return ERROR_OK;
+}
+
+static void fileio_zstd_quit(struct fileio_decoder *decoder)
+{
+	struct fileio_zstd *zstd = decoder->stream;
+
+	ZSTD_freeDStream(zstd->ds);
+	free(zstd);
+}
+
+static const uint8_t fileio_zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+#endif
+
+static const struct fileio_codec fileio_codecs[] = {
+#ifdef HAVE_ZLIB
+	{
+		.name = "gzip",
+		.suffix = ".gz",
+		.magic = fileio_gzip_magic,
+		.magic_size = sizeof(fileio_gzip_magic),
+		.init = fileio_gzip_init,
+		.decode = fileio_gzip_decode,
+		.quit = fileio_gzip_quit,
+	},
+#endif
+#ifdef HAVE_LIBLZMA
+	{
+		.name = "xz",
+		.suffix = ".xz",
+		.magic = fileio_xz_magic,
+		.magic_size = sizeof(fileio_xz_magic),
+		.init = fileio_xz_init,
+		.decode = fileio_xz_decode,
+		.quit = fileio_xz_quit,
+	},
+#endif
+#ifdef HAVE_LIBZSTD
+	{
+		.name = "zstd",
+		.suffix = ".zst",
+		.magic = fileio_zstd_magic,
+		.magic_size = sizeof(fileio_zstd_magic),
+		.init = fileio_zstd_init,
+		.decode = fileio_zstd_decode,
+		.quit = fileio_zstd_quit,
+	},
+#endif
+	{ .name = NULL },
+};
+
+/* (Re)starts decompressing at the beginning of the file. */
+static int fileio_decoder_start(struct fileio_decoder *decoder)
+{
+	if (fseek(decoder->file, 0, SEEK_SET) != 0) {
+		LOG_ERROR("couldn't seek file %s: %s", decoder->url, strerror(errno));
+		return ERROR_FILEIO_OPERATION_FAILED;
+	}
+
+	decoder->in_size = 0;
+	decoder->in_eof = false;
+	decoder->out_pos = 0;
+	decoder->out_size = 0;
+	decoder->position = 0;
+	decoder->eof = false;
+
+	if (decoder->codec->init(decoder) != ERROR_OK) {
+		LOG_ERROR("couldn't set up %s decompression for %s",
+				decoder->codec->name, decoder->url);
+		return ERROR_FILEIO_OPERATION_FAILED;
+	}
+
+	return ERROR_OK;
+}
+
+/* Copies (or with a NULL @a buffer skips) up to @a size decompressed
+ * bytes, stopping early at the end of the data or, with @a line, after
+ * a newline. */
+static int fileio_decoder_read(struct fileio_decoder *decoder, size_t size,
+		uint8_t *buffer, size_t *size_read, bool line)
+{
+	*size_read = 0;
+
+	while (size > 0) {
+		if (decoder->out_pos == decoder->out_size) {
+			if (decoder->eof)
+				break;
+
+			decoder->out_pos = 0;
+			decoder->out_size = 0;
+			int retval = decoder->codec->decode(decoder);
+			if (retval != ERROR_OK)
+				return retval;
+			continue;
+		}
+
+		const uint8_t *start = decoder->out + decoder->out_pos;
+		size_t count = decoder->out_size - decoder->out_pos;
+		if (count > size)
+			count = size;
+		if (line) {
+			const uint8_t *newline = memchr(start, '\n', count);
+			if (newline != NULL)
+				count = newline - start + 1;
+		}
+
+		if (buffer != NULL) {
+			memcpy(buffer, start, count);
+			buffer += count;
+		}
+		decoder->out_pos += count;
+		decoder->position += count;
+		*size_read += count;
+		size -= count;
+
+		if (line && start[count - 1] == '\n')
+			break;
+	}
+
+	return ERROR_OK;
+}
+
+static int fileio_decoder_seek(struct fileio_decoder *decoder, size_t position)
+{
+	size_t size_read;
+	int retval;
+
+	/* compressed streams only go forward, start over to go back */
+	if (position < decoder->position) {
+		decoder->codec->quit(decoder);
+		retval = fileio_decoder_start(decoder);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* like fseek(), seeking past the end is no error */
+	return fileio_decoder_read(decoder, position - decoder->position,
+			NULL, &size_read, false);
+}
+
+static int fileio_decoder_open(struct fileio *fileio)
+{
+	uint8_t magic[8];
+	size_t magic_size;
+	size_t url_len = strlen(fileio->url);
+	const struct fileio_codec *codec;
+
+	/* raw images may well start with a compression magic, so only the
+	 * file name decides whether to decompress; the magic just checks it */
+	for (codec = fileio_codecs; codec->name; codec++) {
+		size_t suffix_len = strlen(codec->suffix);
+		if (url_len > suffix_len
+				&& strcmp(fileio->url + url_len - suffix_len, codec->suffix) == 0)
+			break;
+	}
+	if (codec->name == NULL)
+		return ERROR_OK;
+
+	magic_size = fread(magic, 1, sizeof(magic), fileio->file);
+	if (fseek(fileio->file, 0, SEEK_SET) != 0) {
+		fclose(fileio->file);
+		return ERROR_FILEIO_OPERATION_FAILED;
+	}
+
+	if (magic_size < codec->magic_size
+			|| memcmp(magic, codec->magic, codec->magic_size) != 0) {
+		LOG_ERROR("%s is not %s compressed", fileio->url, codec->name);
+		fclose(fileio->file);
+		return ERROR_FILEIO_OPERATION_FAILED;
+	}
+
+	LOG_DEBUG("%s is %s compressed", fileio->url, codec->name);
+
+	/* the decompressed data is handed out as is */
+	if (fileio->type == FILEIO_TEXT) {
+		fclose(fileio->file);
+		fileio->file = open_file_from_path(fileio->url, "rb");
+		if (!fileio->file) {
+			LOG_ERROR("couldn't open %s", fileio->url);
+			return ERROR_FILEIO_OPERATION_FAILED;
+		}
+	}
+
+	struct fileio_decoder *decoder = malloc(sizeof(*decoder));
+	if (decoder == NULL) {
+		LOG_ERROR("out of memory");
+		fclose(fileio->file);
+		return ERROR_FAIL;
+	}
+	decoder->codec = codec;
+	decoder->url = fileio->url;
+	decoder->file = fileio->file;
+
+	int retval = fileio_decoder_start(decoder);
+	if (retval != ERROR_OK) {
+		free(decoder);
+		fclose(fileio->file);
+		return retval;
+	}
+
+	fileio->decoder = decoder;
+	/* not known until everything has been decompressed */
+	fileio->size_valid = false;
+
+	return ERROR_OK;
+}
+
 static inline int fileio_close_local(struct fileio *fileio)
 {
+	if (fileio->data) {
+#ifdef HAVE_SYS_MMAN_H
+		if (fileio->data_mapped)
+			munmap(fileio->data, fileio->data_size);
+		else
+#endif
+			free(fileio->data);
+		fileio->data = NULL;
+	}
+
+	if (fileio->decoder) {
+		fileio->decoder->codec->quit(fileio->decoder);
+		free(fileio->decoder);
+		fileio->decoder = NULL;
+	}
+
 	int retval = fclose(fileio->file);
 	if (retval != 0) {
 		if (retval == EBADF)
@@ -112,6 +596,11 @@ static inline int fileio_open_local(struct fileio *fileio)
 	}
 
 	fileio->size = file_size;
+	fileio->size_valid = true;
+
+	/* compressed files are only ever read */
+	if (fileio->access == FILEIO_READ)
+		return fileio_decoder_open(fileio);
 
 	return ERROR_OK;
 }
@@ -127,6 +616,8 @@ int fileio_open(struct fileio **fileio, const char *url,
 	tmp->type = type;
 	tmp->access = access_type;
 	tmp->url = strdup(url);
+	tmp->decoder = NULL;
+	tmp->data = NULL;
 
 	retval = fileio_open_local(tmp);
 
@@ -157,6 +648,9 @@ int fileio_seek(struct fileio *fileio, size_t position)
 {
 	int retval;
 
+	if (fileio->decoder)
+		return fileio_decoder_seek(fileio->decoder, position);
+
 	retval = fseek(fileio->file, position, SEEK_SET);
 
 	if (retval != 0) {
@@ -172,6 +666,9 @@ static int fileio_local_read(struct fileio *fileio, size_t size, void *buffer,
 {
 	ssize_t retval;
 
+	if (fileio->decoder)
+		return fileio_decoder_read(fileio->decoder, size, buffer, size_read, false);
+
 	retval = fread(buffer, 1, size, fileio->file);
 	*size_read = (retval >= 0) ? retval : 0;
 
@@ -202,6 +699,21 @@ int fileio_read_u32(struct fileio *fileio, uint32_t *data)
 
 static int fileio_local_fgets(struct fileio *fileio, size_t size, void *buffer)
 {
+	if (fileio->decoder) {
+		size_t size_read;
+
+		if (size == 0)
+			return ERROR_FILEIO_OPERATION_FAILED;
+		int retval = fileio_decoder_read(fileio->decoder, size - 1, buffer,
+				&size_read, true);
+		if (retval != ERROR_OK)
+			return retval;
+		if (size_read == 0)
+			return ERROR_FILEIO_OPERATION_FAILED;
+		((char *)buffer)[size_read] = '\0';
+		return ERROR_OK;
+	}
+
 	if (fgets(buffer, size, fileio->file) == NULL)
 		return ERROR_FILEIO_OPERATION_FAILED;
 
@@ -253,17 +765,88 @@ int fileio_write_u32(struct fileio *fileio, uint32_t data)
 }
 
 /**
- * FIX!!!!
- *
- * For now this can not fail, but that's because a seek was executed
- * on startup.
- *
- * Avoiding the seek on startup opens up for using streams.
- *
+ * Uncompressed files were measured with a seek on startup. Compressed
+ * files have to be decompressed once to the end to learn their size,
+ * which is only done when it is asked for.
  */
 int fileio_size(struct fileio *fileio, size_t *size)
 {
+	if (!fileio->size_valid) {
+		struct fileio_decoder *decoder = fileio->decoder;
+		size_t position = decoder->position;
+		size_t size_read;
+		int retval;
+
+		retval = fileio_decoder_read(decoder, SIZE_MAX, NULL, &size_read, false);
+		if (retval != ERROR_OK)
+			return retval;
+		fileio->size = decoder->position;
+		fileio->size_valid = true;
+
+		retval = fileio_decoder_seek(decoder, position);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
 	*size = fileio->size;
 
 	return ERROR_OK;
 }
+
+int fileio_map(struct fileio *fileio, const uint8_t **data, size_t *size)
+{
+	size_t file_size;
+	int retval;
+
+	if (fileio->data) {
+		*data = fileio->data;
+		*size = fileio->data_size;
+		return ERROR_OK;
+	}
+
+	if (fileio->access != FILEIO_READ)
+		return ERROR_FILEIO_ACCESS_NOT_SUPPORTED;
+
+	retval = fileio_size(fileio, &file_size);
+	if (retval != ERROR_OK)
+		return retval;
+
+#ifdef HAVE_SYS_MMAN_H
+	if (!fileio->decoder && file_size > 0) {
+		void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE,
+				fileno(fileio->file), 0);
+		if (map != MAP_FAILED) {
+			fileio->data = map;
+			fileio->data_size = file_size;
+			fileio->data_mapped = true;
+			*data = fileio->data;
+			*size = fileio->data_size;
+			return ERROR_OK;
+		}
+		LOG_DEBUG("couldn't map %s: %s", fileio->url, strerror(errno));
+	}
+#endif
+
+	/* one spare byte, so that empty files get a buffer too */
+	uint8_t *buffer = malloc(file_size + 1);
+	if (buffer == NULL) {
+		LOG_ERROR("out of memory reading %s (%zu bytes)", fileio->url, file_size);
+		return ERROR_FAIL;
+	}
+
+	/* text mode reads may come out shorter than the file */
+	retval = fileio_seek(fileio, 0);
+	if (retval == ERROR_OK)
+		retval = fileio_read(fileio, file_size, buffer, &fileio->data_size);
+	if (retval != ERROR_OK) {
+		free(buffer);
+		return retval;
+	}
+
+	fileio->data = buffer;
+	fileio->data_mapped = false;
+	*data = fileio->data;
+	*size = fileio->data_size;
+
+	return ERROR_OK;
+}
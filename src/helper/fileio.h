@@ -59,6 +59,14 @@ int fileio_read_u32(struct fileio *fileio, uint32_t *data);
 int fileio_write_u32(struct fileio *fileio, uint32_t data);
 int fileio_size(struct fileio *fileio, size_t *size);
 
+/**
+ * Returns the whole contents of a file opened with FILEIO_READ. The file
+ * is mapped into memory where the host supports that, else (and for
+ * compressed files) it is read into a buffer once. The data stays valid
+ * until fileio_close().
+ */
+int fileio_map(struct fileio *fileio, const uint8_t **data, size_t *size);
+
 #define ERROR_FILEIO_LOCATION_UNKNOWN			(-1200)
 #define ERROR_FILEIO_NOT_FOUND					(-1201)
 #define ERROR_FILEIO_OPERATION_FAILED			(-1202)
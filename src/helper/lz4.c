@@ -0,0 +1,143 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "log.h"
+#include "lz4.h"
+
+/* Greedy single-probe LZ4 block compressor. It trades ratio for speed
+ * and simplicity; its output is what the decompressors in
+ * contrib/loaders/compress expect, and any LZ4 block decoder accepts. */
+
+#define LZ4_MIN_MATCH		4
+#define LZ4_LAST_LITERALS	5	/* a block ends with at least 5 literals */
+#define LZ4_MFLIMIT		12	/* no match starts in the last 12 bytes */
+#define LZ4_MAX_OFFSET		65535
+#define LZ4_HASH_BITS		14
+
+struct lz4_out {
+	uint8_t *p;
+	uint8_t *end;
+};
+
+static uint32_t lz4_read32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static unsigned lz4_hash(uint32_t seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+static bool lz4_put_length(struct lz4_out *out, size_t len)
+{
+	while (len >= 255) {
+		if (out->p == out->end)
+			return false;
+		*out->p++ = 255;
+		len -= 255;
+	}
+	if (out->p == out->end)
+		return false;
+	*out->p++ = len;
+	return true;
+}
+
+/* emit literals @a lit of length @a lit_len and, for @a match_len > 0, a
+ * match of that length at @a offset */
+static bool lz4_put_sequence(struct lz4_out *out, const uint8_t *lit, size_t lit_len,
+		size_t offset, size_t match_len)
+{
+	size_t ml = match_len ? match_len - LZ4_MIN_MATCH : 0;
+
+	if (out->p == out->end)
+		return false;
+	*out->p++ = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+
+	if (lit_len >= 15 && !lz4_put_length(out, lit_len - 15))
+		return false;
+
+	if ((size_t)(out->end - out->p) < lit_len)
+		return false;
+	memcpy(out->p, lit, lit_len);
+	out->p += lit_len;
+
+	if (!match_len)
+		return true;
+
+	if (out->end - out->p < 2)
+		return false;
+	*out->p++ = offset & 0xff;
+	*out->p++ = offset >> 8;
+
+	return ml < 15 || lz4_put_length(out, ml - 15);
+}
+
+int lz4_compress(const uint8_t *src, size_t src_len,
+		uint8_t *dst, size_t dst_size, size_t *dst_len)
+{
+	struct lz4_out out = { .p = dst, .end = dst + dst_size };
+	uint32_t *table;
+	size_t anchor = 0;
+	size_t ip = 0;
+	int retval = ERROR_FAIL;
+
+	/* positions plus one, zero marks an empty slot */
+	table = calloc(1 << LZ4_HASH_BITS, sizeof(*table));
+	if (table == NULL)
+		return ERROR_FAIL;
+
+	while (src_len > LZ4_MFLIMIT && ip < src_len - LZ4_MFLIMIT) {
+		uint32_t seq = lz4_read32(src + ip);
+		unsigned h = lz4_hash(seq);
+		size_t ref = table[h];
+
+		table[h] = ip + 1;
+		if (ref == 0 || ip + 1 - ref > LZ4_MAX_OFFSET || lz4_read32(src + ref - 1) != seq) {
+			ip++;
+			continue;
+		}
+		ref--;
+
+		/* extend the match backwards into pending literals, then forwards */
+		while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+			ip--;
+			ref--;
+		}
+		size_t len = LZ4_MIN_MATCH;
+		while (ip + len < src_len - LZ4_LAST_LITERALS && src[ip + len] == src[ref + len])
+			len++;
+
+		if (!lz4_put_sequence(&out, src + anchor, ip - anchor, ip - ref, len))
+			goto done;
+
+		ip += len;
+		anchor = ip;
+	}
+
+	if (!lz4_put_sequence(&out, src + anchor, src_len - anchor, 0, 0))
+		goto done;
+
+	*dst_len = out.p - dst;
+	retval = ERROR_OK;
+
+done:
+	free(table);
+	return retval;
+}
@@ -0,0 +1,30 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_HELPER_LZ4_H
+#define OPENOCD_HELPER_LZ4_H
+
+/**
+ * Compress @a src into an LZ4 block (the raw block format, without the
+ * frame header) in @a dst.
+ *
+ * @returns ERROR_OK with the compressed size in @a dst_len, or ERROR_FAIL
+ * if the block does not fit into @a dst_size bytes. Passing the largest
+ * size that still pays off makes incompressible data fail early.
+ */
+int lz4_compress(const uint8_t *src, size_t src_len,
+		uint8_t *dst, size_t dst_size, size_t *dst_len);
+
+#endif /* OPENOCD_HELPER_LZ4_H */
@@ -0,0 +1,280 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "metrics.h"
+#include "log.h"
+#include "command.h"
+
+#include <stdarg.h>
+
+const uint64_t metric_time_bounds[METRIC_TIME_BOUNDS] = {
+	10, 100, 1000, 10000, 100000, 1000000, 10000000,
+};
+
+/* registered families, sorted by name */
+static struct metric_family *metric_families;
+
+static void metric_register(struct metric_family *family)
+{
+	struct metric_family **prev = &metric_families;
+
+	while (*prev && strcmp((*prev)->name, family->name) < 0)
+		prev = &(*prev)->next;
+
+	family->next = *prev;
+	*prev = family;
+	family->registered = true;
+}
+
+struct metric *metric_get(struct metric_family *family, const char *label_value)
+{
+	struct metric **prev = &family->metrics;
+	struct metric *metric;
+
+	/* kept sorted by label value */
+	for (; *prev; prev = &(*prev)->next) {
+		int cmp = label_value ? strcmp((*prev)->label_value, label_value) : 0;
+		if (cmp == 0)
+			return *prev;
+		if (cmp > 0)
+			break;
+	}
+
+	metric = calloc(1, sizeof(struct metric));
+	if (metric == NULL)
+		return NULL;
+	if (label_value) {
+		metric->label_value = strdup(label_value);
+		if (metric->label_value == NULL) {
+			free(metric);
+			return NULL;
+		}
+	}
+	if (family->type == METRIC_TYPE_HISTOGRAM) {
+		metric->buckets = calloc(family->num_bounds, sizeof(uint64_t));
+		if (metric->buckets == NULL) {
+			free(metric->label_value);
+			free(metric);
+			return NULL;
+		}
+	}
+
+	metric->next = *prev;
+	*prev = metric;
+
+	if (!family->registered)
+		metric_register(family);
+
+	return metric;
+}
+
+void metric_add_label(struct metric_family *family, const char *label_value, uint64_t n)
+{
+	struct metric *metric = metric_get(family, label_value);
+
+	if (metric != NULL)
+		metric->value += n;
+}
+
+void metric_observe(struct metric_family *family, uint64_t us)
+{
+	struct metric *metric = family->metrics;
+	unsigned i;
+
+	if (metric == NULL)
+		metric = metric_get(family, NULL);
+	if (metric == NULL)
+		return;
+
+	metric->value += us;
+	metric->count++;
+	for (i = 0; i < family->num_bounds; i++) {
+		if (us <= family->bounds[i]) {
+			metric->buckets[i]++;
+			break;
+		}
+	}
+}
+
+struct metrics_buffer {
+	char *data;
+	size_t size;
+	size_t len;
+	bool failed;
+};
+
+static void metrics_printf(struct metrics_buffer *buf, const char *fmt, ...)
+	__attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 2, 3)));
+
+static void metrics_printf(struct metrics_buffer *buf, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	if (buf->failed)
+		return;
+
+	for (;;) {
+		va_start(ap, fmt);
+		len = vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, ap);
+		va_end(ap);
+
+		if (len < 0) {
+			buf->failed = true;
+			return;
+		}
+		if (buf->len + len < buf->size)
+			break;
+
+		size_t size = buf->size * 2 + len;
+		char *data = realloc(buf->data, size);
+		if (data == NULL) {
+			buf->failed = true;
+			return;
+		}
+		buf->data = data;
+		buf->size = size;
+	}
+
+	buf->len += len;
+}
+
+/* the label part of a sample, "" for metrics without a label */
+static void metrics_print_labels(struct metrics_buffer *buf, struct metric_family *family,
+		struct metric *metric, const char *le)
+{
+	const char *sep = "{";
+	const char *p;
+
+	if (metric->label_value) {
+		metrics_printf(buf, "{%s=\"", family->label);
+		for (p = metric->label_value; *p; p++) {
+			/* label values escape backslash, quote and line feed */
+			if (*p == '\\' || *p == '"')
+				metrics_printf(buf, "\\%c", *p);
+			else if (*p == '\n')
+				metrics_printf(buf, "\\n");
+			else
+				metrics_printf(buf, "%c", *p);
+		}
+		metrics_printf(buf, "\"");
+		sep = ",";
+	}
+	if (le)
+		metrics_printf(buf, "%sle=\"%s\"", sep, le);
+	if (metric->label_value || le)
+		metrics_printf(buf, "}");
+}
+
+char *metrics_format(void)
+{
+	struct metrics_buffer buf = { .size = 4096 };
+	struct metric_family *family;
+	struct metric *metric;
+	unsigned i;
+
+	buf.data = malloc(buf.size);
+	if (buf.data == NULL)
+		return NULL;
+	buf.data[0] = '\0';
+
+	for (family = metric_families; family; family = family->next) {
+		bool histogram = family->type == METRIC_TYPE_HISTOGRAM;
+
+		metrics_printf(&buf, "# HELP %s %s\n", family->name, family->help);
+		metrics_printf(&buf, "# TYPE %s %s\n", family->name,
+				histogram ? "histogram" : "counter");
+
+		for (metric = family->metrics; metric; metric = metric->next) {
+			if (!histogram) {
+				metrics_printf(&buf, "%s", family->name);
+				metrics_print_labels(&buf, family, metric, NULL);
+				metrics_printf(&buf, " %" PRIu64 "\n", metric->value);
+				continue;
+			}
+
+			/* buckets are cumulative */
+			uint64_t count = 0;
+			for (i = 0; i < family->num_bounds; i++) {
+				char le[32];
+
+				count += metric->buckets[i];
+				snprintf(le, sizeof(le), "%g", family->bounds[i] / 1e6);
+				metrics_printf(&buf, "%s_bucket", family->name);
+				metrics_print_labels(&buf, family, metric, le);
+				metrics_printf(&buf, " %" PRIu64 "\n", count);
+			}
+			metrics_printf(&buf, "%s_bucket", family->name);
+			metrics_print_labels(&buf, family, metric, "+Inf");
+			metrics_printf(&buf, " %" PRIu64 "\n", metric->count);
+
+			metrics_printf(&buf, "%s_sum", family->name);
+			metrics_print_labels(&buf, family, metric, NULL);
+			metrics_printf(&buf, " %.6f\n", metric->value / 1e6);
+
+			metrics_printf(&buf, "%s_count", family->name);
+			metrics_print_labels(&buf, family, metric, NULL);
+			metrics_printf(&buf, " %" PRIu64 "\n", metric->count);
+		}
+	}
+
+	if (buf.failed) {
+		LOG_ERROR("out of memory formatting metrics");
+		free(buf.data);
+		return NULL;
+	}
+
+	return buf.data;
+}
+
+COMMAND_HANDLER(handle_metrics_command)
+{
+	if (CMD_ARGC > 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	char *text = metrics_format();
+	if (text == NULL)
+		return ERROR_FAIL;
+
+	/* without the trailing line feed, command_print() adds one */
+	size_t len = strlen(text);
+	if (len > 0)
+		text[len - 1] = '\0';
+	command_print(CMD_CTX, "%s", text);
+	free(text);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration metrics_command_handlers[] = {
+	{
+		.name = "metrics",
+		.handler = handle_metrics_command,
+		.mode = COMMAND_ANY,
+		.help = "Display the adapter, target and server counters "
+			"in the Prometheus text format.",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int metrics_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, metrics_command_handlers);
+}
@@ -0,0 +1,106 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_HELPER_METRICS_H
+#define OPENOCD_HELPER_METRICS_H
+
+#include <helper/types.h>
+
+/*
+ * Counters and histograms for the Prometheus text exposition format.
+ *
+ * A metric family is a static variable next to the code it measures,
+ * defined with METRIC_COUNTER() or METRIC_HISTOGRAM_US(). It registers
+ * itself on first use, so families that never count don't show up. A
+ * family may have one label, e.g. the access size, with one metric per
+ * label value.
+ */
+enum metric_type {
+	METRIC_TYPE_COUNTER,
+	METRIC_TYPE_HISTOGRAM,
+};
+
+struct metric {
+	struct metric *next;
+	char *label_value;		/* NULL if the family has no label */
+	uint64_t value;			/* counter value, or sum of observations */
+	uint64_t count;			/* number of observations */
+	uint64_t *buckets;		/* observations per bucket, histograms only */
+};
+
+struct metric_family {
+	const char *name;
+	const char *help;
+	enum metric_type type;
+	const char *label;		/* label name, NULL for none */
+	const uint64_t *bounds;		/* bucket upper bounds in microseconds */
+	unsigned num_bounds;
+	struct metric *metrics;
+	struct metric_family *next;
+	bool registered;
+};
+
+/* 10us, 100us, 1ms, 10ms, 100ms, 1s, 10s */
+#define METRIC_TIME_BOUNDS	7
+extern const uint64_t metric_time_bounds[METRIC_TIME_BOUNDS];
+
+#define METRIC_COUNTER(name_, help_, label_) { \
+		.name = name_, \
+		.help = help_, \
+		.type = METRIC_TYPE_COUNTER, \
+		.label = label_, \
+	}
+
+/** A histogram of durations, observed in microseconds, exposed in seconds. */
+#define METRIC_HISTOGRAM_US(name_, help_) { \
+		.name = name_, \
+		.help = help_, \
+		.type = METRIC_TYPE_HISTOGRAM, \
+		.bounds = metric_time_bounds, \
+		.num_bounds = METRIC_TIME_BOUNDS, \
+	}
+
+/**
+ * Returns the metric of @a family for @a label_value, which must be NULL
+ * for families without a label, creating it if needed. Returns NULL if
+ * out of memory.
+ */
+struct metric *metric_get(struct metric_family *family, const char *label_value);
+
+/** Adds @a n to a counter without a label. */
+static inline void metric_add(struct metric_family *family, uint64_t n)
+{
+	struct metric *metric = family->metrics;
+
+	if (metric == NULL)
+		metric = metric_get(family, NULL);
+	if (metric != NULL)
+		metric->value += n;
+}
+
+/** Adds @a n to the counter for @a label_value. */
+void metric_add_label(struct metric_family *family, const char *label_value, uint64_t n);
+
+/** Records a duration of @a us microseconds in a histogram without a label. */
+void metric_observe(struct metric_family *family, uint64_t us);
+
+/** Returns all metrics in the Prometheus text format, to be freed by the caller. */
+char *metrics_format(void);
+
+struct command_context;
+
+int metrics_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_HELPER_METRICS_H */
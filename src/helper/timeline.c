@@ -0,0 +1,249 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "timeline.h"
+#include "log.h"
+#include "command.h"
+#include "fileio.h"
+#include "time_support.h"
+
+#define TIMELINE_DEFAULT_EVENTS		(256*1024)
+#define TIMELINE_DETAIL_MAX		24
+#define TIMELINE_CHUNK			(64*1024)
+
+struct timeline_event {
+	const char *category;
+	const char *name;
+	int64_t start;
+	int64_t duration;
+	char detail[TIMELINE_DETAIL_MAX];
+};
+
+bool timeline_recording;
+
+/* ring buffer, the oldest events are overwritten once it is full */
+static struct timeline_event *timeline_events;
+static size_t timeline_size;
+static size_t timeline_next;
+static bool timeline_wrapped;
+
+int64_t timeline_now(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return now.tv_sec * 1000000ll + now.tv_usec;
+}
+
+void timeline_record(struct timeline_span *span, const char *category,
+		const char *name, const char *detail)
+{
+	struct timeline_event *event;
+
+	/* stopped meanwhile */
+	if (!timeline_recording)
+		return;
+
+	event = &timeline_events[timeline_next];
+	event->category = category;
+	event->name = name;
+	event->start = span->start;
+	event->duration = timeline_now() - span->start;
+	if (detail)
+		strncpy(event->detail, detail, TIMELINE_DETAIL_MAX - 1);
+	event->detail[detail ? TIMELINE_DETAIL_MAX - 1 : 0] = '\0';
+
+	if (++timeline_next == timeline_size) {
+		timeline_next = 0;
+		timeline_wrapped = true;
+	}
+}
+
+/* JSON string contents, for details like GDB packet types */
+static size_t timeline_escape(char *dst, const char *src)
+{
+	char *p = dst;
+
+	for (; *src; src++) {
+		unsigned char c = *src;
+
+		if (c == '"' || c == '\\') {
+			*p++ = '\\';
+			*p++ = c;
+		} else if (c < 0x20 || c >= 0x7f)
+			p += sprintf(p, "\\u%04x", c);
+		else
+			*p++ = c;
+	}
+	*p = '\0';
+
+	return p - dst;
+}
+
+static int timeline_dump(const char *filename)
+{
+	struct fileio *fileio;
+	size_t count, first, i;
+	size_t len = 0;
+	size_t written;
+	int retval;
+
+	char *buffer = malloc(TIMELINE_CHUNK);
+	if (buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	retval = fileio_open(&fileio, filename, FILEIO_WRITE, FILEIO_BINARY);
+	if (retval != ERROR_OK) {
+		free(buffer);
+		return retval;
+	}
+
+	count = timeline_wrapped ? timeline_size : timeline_next;
+	first = timeline_wrapped ? timeline_next : 0;
+
+	len = sprintf(buffer, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (i = 0; i < count && retval == ERROR_OK; i++) {
+		struct timeline_event *event = &timeline_events[(first + i) % timeline_size];
+		char detail[TIMELINE_DETAIL_MAX * 6];
+
+		/* the longest event takes well below 512 bytes */
+		if (TIMELINE_CHUNK - len < 512) {
+			retval = fileio_write(fileio, len, buffer, &written);
+			len = 0;
+		}
+
+		len += sprintf(buffer + len, "{\"cat\":\"%s\",\"name\":\"%s\",\"ph\":\"X\","
+				"\"pid\":1,\"tid\":1,\"ts\":%" PRId64 ",\"dur\":%" PRId64,
+				event->category, event->name, event->start, event->duration);
+		if (event->detail[0]) {
+			timeline_escape(detail, event->detail);
+			len += sprintf(buffer + len, ",\"args\":{\"detail\":\"%s\"}", detail);
+		}
+		len += sprintf(buffer + len, "}%s\n", i + 1 < count ? "," : "");
+	}
+	len += sprintf(buffer + len, "]}\n");
+
+	if (retval == ERROR_OK)
+		retval = fileio_write(fileio, len, buffer, &written);
+
+	fileio_close(fileio);
+	free(buffer);
+
+	if (retval == ERROR_OK)
+		LOG_INFO("wrote %zu timeline events to %s%s", count, filename,
+				timeline_wrapped ? ", older ones were overwritten" : "");
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_trace_timeline_start_command)
+{
+	unsigned size = TIMELINE_DEFAULT_EVENTS;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+		if (size == 0)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	/* starting again throws away what was recorded */
+	struct timeline_event *events = realloc(timeline_events,
+			size * sizeof(struct timeline_event));
+	if (events == NULL) {
+		LOG_ERROR("Out of memory for %u timeline events", size);
+		return ERROR_FAIL;
+	}
+
+	timeline_events = events;
+	timeline_size = size;
+	timeline_next = 0;
+	timeline_wrapped = false;
+	timeline_recording = true;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_trace_timeline_stop_command)
+{
+	if (CMD_ARGC > 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	timeline_recording = false;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_trace_timeline_dump_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (timeline_events == NULL) {
+		LOG_ERROR("no timeline recorded, use 'trace_timeline start' first");
+		return ERROR_FAIL;
+	}
+
+	return timeline_dump(CMD_ARGV[0]);
+}
+
+static const struct command_registration trace_timeline_subcommand_handlers[] = {
+	{
+		.name = "start",
+		.handler = handle_trace_timeline_start_command,
+		.mode = COMMAND_ANY,
+		.help = "Start recording, keeping the given number of most "
+			"recent events.",
+		.usage = "[max_events]",
+	},
+	{
+		.name = "stop",
+		.handler = handle_trace_timeline_stop_command,
+		.mode = COMMAND_ANY,
+		.help = "Stop recording.",
+		.usage = "",
+	},
+	{
+		.name = "dump",
+		.handler = handle_trace_timeline_dump_command,
+		.mode = COMMAND_ANY,
+		.help = "Write the recorded events in the Chrome trace event format.",
+		.usage = "filename",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration timeline_command_handlers[] = {
+	{
+		.name = "trace_timeline",
+		.mode = COMMAND_ANY,
+		.help = "Record a timeline of adapter, target, flash, GDB and "
+			"event script activity.",
+		.usage = "",
+		.chain = trace_timeline_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int timeline_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, timeline_command_handlers);
+}
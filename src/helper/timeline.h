@@ -0,0 +1,60 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_HELPER_TIMELINE_H
+#define OPENOCD_HELPER_TIMELINE_H
+
+#include <helper/types.h>
+
+/*
+ * Timeline of what OpenOCD spends its time on, for the Chrome trace
+ * viewer and Perfetto. Code of interest is wrapped in spans:
+ *
+ *	struct timeline_span span;
+ *	timeline_begin(&span);
+ *	retval = jtag->execute_queue();
+ *	timeline_end(&span, "adapter", "execute_queue", NULL);
+ *
+ * While 'trace_timeline' isn't recording, that costs a test of a flag.
+ * Category and name must be string constants, only the detail is copied.
+ */
+struct timeline_span {
+	int64_t start;			/* microseconds, 0 when not recording */
+};
+
+extern bool timeline_recording;
+
+int64_t timeline_now(void);
+
+static inline void timeline_begin(struct timeline_span *span)
+{
+	span->start = timeline_recording ? timeline_now() : 0;
+}
+
+void timeline_record(struct timeline_span *span, const char *category,
+		const char *name, const char *detail);
+
+static inline void timeline_end(struct timeline_span *span, const char *category,
+		const char *name, const char *detail)
+{
+	if (span->start)
+		timeline_record(span, category, name, detail);
+}
+
+struct command_context;
+
+int timeline_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_HELPER_TIMELINE_H */
@@ -34,6 +34,7 @@
 #include "minidriver.h"
 #include "interface.h"
 #include "interfaces.h"
+#include "remote_adapter.h"
 #include <transport/transport.h>
 
 #ifdef HAVE_STRINGS_H
@@ -430,11 +431,27 @@ COMMAND_HANDLER(handle_adapter_nsrst_assert_width_command)
 
 COMMAND_HANDLER(handle_adapter_khz_command)
 {
-	if (CMD_ARGC > 1)
+	if (CMD_ARGC > 0 && strcmp(CMD_ARGV[0], "auto") == 0) {
+		unsigned min_khz = 100, max_khz = 100000;
+		if (CMD_ARGC != 1 && CMD_ARGC != 3)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		if (CMD_ARGC == 3) {
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], min_khz);
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], max_khz);
+		}
+		if (CMD_CTX->mode != COMMAND_EXEC) {
+			LOG_ERROR("'adapter_khz auto' needs an initialized adapter");
+			return ERROR_FAIL;
+		}
+
+		int retval = jtag_config_khz_auto(min_khz, max_khz);
+		if (ERROR_OK != retval)
+			return retval;
+	} else if (CMD_ARGC > 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	int retval = ERROR_OK;
-	if (CMD_ARGC == 1) {
+	if (CMD_ARGC == 1 && strcmp(CMD_ARGV[0], "auto") != 0) {
 		unsigned khz = 0;
 		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], khz);
 
@@ -463,9 +480,10 @@ static const struct command_registration interface_command_handlers[] = {
 		.mode = COMMAND_ANY,
 		.help = "With an argument, change to the specified maximum "
 			"jtag speed.  For JTAG, 0 KHz signifies adaptive "
-			" clocking. "
+			" clocking. 'auto' searches for the fastest speed "
+			"the link passes its checks at, then backs off. "
 			"With or without argument, display current setting.",
-		.usage = "[khz]",
+		.usage = "[khz | 'auto' [min_khz max_khz]]",
 	},
 	{
 		.name = "adapter_name",
@@ -531,5 +549,15 @@ static const struct command_registration interface_command_handlers[] = {
  */
 int interface_register_commands(struct command_context *ctx)
 {
-	return register_commands(ctx, NULL, interface_command_handlers);
+	int retval = register_commands(ctx, NULL, interface_command_handlers);
+	if (retval != ERROR_OK)
+		return retval;
+
+#ifndef HAVE_JTAG_MINIDRIVER_H
+	/* minidrivers have no command queue to serve or capture */
+	retval = adapter_serve_register_commands(ctx);
+	if (retval == ERROR_OK)
+		retval = adapter_capture_register_commands(ctx);
+#endif
+	return retval;
 }
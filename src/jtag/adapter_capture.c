@@ -0,0 +1,226 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "jtag.h"
+#include "interface.h"
+#include "commands.h"
+#include "swd.h"
+#include "remote_adapter.h"
+#include <helper/fileio.h>
+
+/* 'adapter_capture' records what the adapter was asked to do and what it
+ * answered, as the remote_adapter requests and replies that would have
+ * carried it. The replay driver plays such a capture back without any
+ * hardware. JTAG queues are recorded once executed, SWD transactions by
+ * sitting between the debug code and the adapter's swd_driver. */
+
+extern struct jtag_interface *jtag_interface;
+
+bool adapter_capture_active;
+
+static struct fileio *capture_fileio;
+static struct ra_msg capture_msg;
+static unsigned capture_count;
+
+/* the adapter's SWD driver, and the copy of it that records */
+static const struct swd_driver *capture_adapter_swd;
+static struct swd_driver capture_swd;
+static struct ra_swd_batch capture_swd_batch;
+
+static int capture_write_msg(void)
+{
+	size_t written;
+
+	ra_msg_end(&capture_msg);
+	if (capture_msg.error)
+		return ERROR_FAIL;
+
+	return fileio_write(capture_fileio, capture_msg.len, capture_msg.data, &written);
+}
+
+static void capture_failed(void)
+{
+	LOG_ERROR("adapter_capture: writing the capture failed, it ends here");
+	adapter_capture_stop();
+}
+
+/* Record a JTAG queue just executed by the adapter, before the callbacks
+ * of the queue get to see the captured bits. */
+void adapter_capture_jtag(struct jtag_command *queue, int retval)
+{
+	if (queue == NULL)
+		return;
+
+	ra_msg_begin(&capture_msg, RA_MSG_JTAG);
+	if (ra_msg_put_jtag_queue(&capture_msg, queue) != ERROR_OK ||
+			capture_write_msg() != ERROR_OK) {
+		capture_failed();
+		return;
+	}
+
+	ra_msg_begin(&capture_msg, RA_MSG_JTAG);
+	ra_msg_put_u32(&capture_msg, retval);
+	ra_msg_put_jtag_results(&capture_msg, queue);
+	if (capture_write_msg() != ERROR_OK) {
+		capture_failed();
+		return;
+	}
+
+	capture_count++;
+}
+
+static int capture_swd_switch_seq(enum swd_special_seq seq)
+{
+	ra_swd_batch_switch_seq(&capture_swd_batch, seq);
+	return capture_adapter_swd->switch_seq(seq);
+}
+
+static void capture_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_hint)
+{
+	ra_swd_batch_read(&capture_swd_batch, cmd, value, ap_delay_hint);
+	capture_adapter_swd->read_reg(cmd, value, ap_delay_hint);
+}
+
+static void capture_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay_hint)
+{
+	ra_swd_batch_write(&capture_swd_batch, cmd, value, ap_delay_hint);
+	capture_adapter_swd->write_reg(cmd, value, ap_delay_hint);
+}
+
+static int capture_swd_run(void)
+{
+	int retval = capture_adapter_swd->run();
+
+	if (capture_swd_batch.msg.len == 0)
+		return retval;
+
+	ra_msg_begin(&capture_msg, RA_MSG_SWD);
+	ra_msg_put(&capture_msg, capture_swd_batch.msg.data, capture_swd_batch.msg.len);
+	if (capture_swd_batch.msg.error || capture_write_msg() != ERROR_OK)
+		goto fail;
+
+	ra_msg_begin(&capture_msg, RA_MSG_SWD);
+	ra_msg_put_u32(&capture_msg, retval);
+	ra_swd_batch_put_results(&capture_msg, &capture_swd_batch);
+	if (capture_write_msg() != ERROR_OK)
+		goto fail;
+
+	capture_count++;
+	ra_swd_batch_reset(&capture_swd_batch);
+	return retval;
+
+fail:
+	capture_failed();
+	return retval;
+}
+
+static int adapter_capture_start(const char *filename)
+{
+	uint8_t version[4];
+	size_t written;
+	int retval;
+
+	retval = fileio_open(&capture_fileio, filename, FILEIO_WRITE, FILEIO_BINARY);
+	if (retval != ERROR_OK)
+		return retval;
+
+	h_u32_to_le(version, RA_PROTOCOL_VERSION);
+	retval = fileio_write(capture_fileio, RA_CAPTURE_MAGIC_SIZE, RA_CAPTURE_MAGIC, &written);
+	if (retval == ERROR_OK)
+		retval = fileio_write(capture_fileio, sizeof(version), version, &written);
+	if (retval != ERROR_OK) {
+		fileio_close(capture_fileio);
+		capture_fileio = NULL;
+		return retval;
+	}
+
+	if (jtag_interface->swd) {
+		capture_adapter_swd = jtag_interface->swd;
+		capture_swd = *capture_adapter_swd;
+		capture_swd.switch_seq = capture_swd_switch_seq;
+		capture_swd.read_reg = capture_swd_read_reg;
+		capture_swd.write_reg = capture_swd_write_reg;
+		capture_swd.run = capture_swd_run;
+		jtag_interface->swd = &capture_swd;
+	}
+
+	capture_count = 0;
+	adapter_capture_active = true;
+
+	return ERROR_OK;
+}
+
+void adapter_capture_stop(void)
+{
+	if (!adapter_capture_active)
+		return;
+
+	adapter_capture_active = false;
+	if (capture_adapter_swd) {
+		jtag_interface->swd = capture_adapter_swd;
+		capture_adapter_swd = NULL;
+	}
+
+	if (fileio_close(capture_fileio) == ERROR_OK)
+		LOG_INFO("adapter_capture: %u transactions recorded", capture_count);
+	capture_fileio = NULL;
+
+	ra_msg_free(&capture_msg);
+	ra_swd_batch_free(&capture_swd_batch);
+}
+
+COMMAND_HANDLER(handle_adapter_capture_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(CMD_ARGV[0], "stop") == 0) {
+		adapter_capture_stop();
+		return ERROR_OK;
+	}
+
+	if (adapter_capture_active) {
+		LOG_ERROR("adapter transactions are already being captured");
+		return ERROR_FAIL;
+	}
+
+	if (jtag_interface == NULL) {
+		LOG_ERROR("adapter_capture needs the debug adapter selected first");
+		return ERROR_FAIL;
+	}
+
+	return adapter_capture_start(CMD_ARGV[0]);
+}
+
+static const struct command_registration adapter_capture_command_handlers[] = {
+	{
+		.name = "adapter_capture",
+		.handler = handle_adapter_capture_command,
+		.mode = COMMAND_ANY,
+		.help = "Record the adapter's transactions to a file for the "
+			"replay driver, or stop doing so.",
+		.usage = "filename | 'stop'",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int adapter_capture_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, adapter_capture_command_handlers);
+}
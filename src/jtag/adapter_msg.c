@@ -0,0 +1,290 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "jtag.h"
+#include "interface.h"
+#include "commands.h"
+#include "remote_adapter.h"
+#include <helper/binarybuffer.h>
+
+/* Encoding of flushed JTAG queues and SWD batches as remote_adapter
+ * messages, shared by the remote_adapter driver, 'adapter_capture' and
+ * the replay driver. */
+
+int ra_msg_reserve(struct ra_msg *msg, uint32_t len)
+{
+	uint32_t size;
+	uint8_t *data;
+
+	if (msg->len + len <= msg->size)
+		return ERROR_OK;
+
+	size = msg->size ? msg->size : 4096;
+	while (size < msg->len + len)
+		size *= 2;
+
+	data = realloc(msg->data, size);
+	if (data == NULL) {
+		LOG_ERROR("Out of memory for an adapter message");
+		return ERROR_FAIL;
+	}
+
+	msg->data = data;
+	msg->size = size;
+	return ERROR_OK;
+}
+
+void ra_msg_put(struct ra_msg *msg, const void *data, uint32_t len)
+{
+	if (ra_msg_reserve(msg, len) != ERROR_OK) {
+		msg->error = true;
+		return;
+	}
+	memcpy(msg->data + msg->len, data, len);
+	msg->len += len;
+}
+
+void ra_msg_put_u8(struct ra_msg *msg, uint8_t val)
+{
+	ra_msg_put(msg, &val, 1);
+}
+
+void ra_msg_put_u32(struct ra_msg *msg, uint32_t val)
+{
+	uint8_t le[4];
+	h_u32_to_le(le, val);
+	ra_msg_put(msg, le, 4);
+}
+
+/* Start a frame of @a type, the payload is appended next. */
+void ra_msg_begin(struct ra_msg *msg, enum ra_msg_type type)
+{
+	msg->len = 0;
+	msg->error = false;
+	ra_msg_put_u32(msg, 0);
+	ra_msg_put_u8(msg, type);
+}
+
+/* Fill in the payload length once the payload is complete. */
+void ra_msg_end(struct ra_msg *msg)
+{
+	if (!msg->error)
+		h_u32_to_le(msg->data, msg->len - RA_HEADER_SIZE);
+}
+
+void ra_msg_free(struct ra_msg *msg)
+{
+	free(msg->data);
+	memset(msg, 0, sizeof(*msg));
+}
+
+static void ra_msg_put_scan(struct ra_msg *msg, struct scan_command *scan)
+{
+	ra_msg_put_u8(msg, scan->ir_scan);
+	ra_msg_put_u8(msg, scan->end_state);
+	ra_msg_put_u32(msg, scan->num_fields);
+
+	for (int i = 0; i < scan->num_fields; i++) {
+		struct scan_field *field = &scan->fields[i];
+		uint8_t flags = 0;
+
+		if (field->out_value)
+			flags |= RA_FIELD_OUT;
+		if (field->in_value)
+			flags |= RA_FIELD_IN;
+
+		ra_msg_put_u32(msg, field->num_bits);
+		ra_msg_put_u8(msg, flags);
+		if (field->out_value)
+			ra_msg_put(msg, field->out_value, DIV_ROUND_UP(field->num_bits, 8));
+	}
+}
+
+/* Append the commands of @a queue as the payload of a RA_MSG_JTAG request. */
+int ra_msg_put_jtag_queue(struct ra_msg *msg, struct jtag_command *queue)
+{
+	for (struct jtag_command *cmd = queue; cmd; cmd = cmd->next) {
+		ra_msg_put_u8(msg, cmd->type);
+
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			ra_msg_put_scan(msg, cmd->cmd.scan);
+			break;
+		case JTAG_TLR_RESET:
+			ra_msg_put_u8(msg, cmd->cmd.statemove->end_state);
+			break;
+		case JTAG_RUNTEST:
+			ra_msg_put_u32(msg, cmd->cmd.runtest->num_cycles);
+			ra_msg_put_u8(msg, cmd->cmd.runtest->end_state);
+			break;
+		case JTAG_RESET:
+			ra_msg_put_u8(msg, cmd->cmd.reset->trst);
+			ra_msg_put_u8(msg, cmd->cmd.reset->srst);
+			break;
+		case JTAG_PATHMOVE:
+			ra_msg_put_u32(msg, cmd->cmd.pathmove->num_states);
+			for (int i = 0; i < cmd->cmd.pathmove->num_states; i++)
+				ra_msg_put_u8(msg, cmd->cmd.pathmove->path[i]);
+			break;
+		case JTAG_SLEEP:
+			ra_msg_put_u32(msg, cmd->cmd.sleep->us);
+			break;
+		case JTAG_STABLECLOCKS:
+			ra_msg_put_u32(msg, cmd->cmd.stableclocks->num_cycles);
+			break;
+		case JTAG_TMS:
+			ra_msg_put_u32(msg, cmd->cmd.tms->num_bits);
+			ra_msg_put(msg, cmd->cmd.tms->bits, DIV_ROUND_UP(cmd->cmd.tms->num_bits, 8));
+			break;
+		default:
+			LOG_ERROR("BUG: unknown JTAG command type encountered");
+			return ERROR_FAIL;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* Append the captured bits of an executed @a queue, as a server replies. */
+void ra_msg_put_jtag_results(struct ra_msg *msg, struct jtag_command *queue)
+{
+	for (struct jtag_command *cmd = queue; cmd; cmd = cmd->next) {
+		if (cmd->type != JTAG_SCAN)
+			continue;
+
+		for (int i = 0; i < cmd->cmd.scan->num_fields; i++) {
+			struct scan_field *field = &cmd->cmd.scan->fields[i];
+
+			if (field->in_value)
+				ra_msg_put(msg, field->in_value, DIV_ROUND_UP(field->num_bits, 8));
+		}
+	}
+}
+
+/* Hand out the captured bits of a reply to @a queue and follow the TAP
+ * state the way a local driver would have. */
+int ra_msg_get_jtag_results(struct jtag_command *queue, const uint8_t *data, uint32_t len)
+{
+	uint32_t offset = 0;
+
+	for (struct jtag_command *cmd = queue; cmd; cmd = cmd->next) {
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			for (int i = 0; i < cmd->cmd.scan->num_fields; i++) {
+				struct scan_field *field = &cmd->cmd.scan->fields[i];
+				uint32_t bytes = DIV_ROUND_UP(field->num_bits, 8);
+
+				if (!field->in_value)
+					continue;
+				if (offset + bytes > len)
+					return ERROR_FAIL;
+				buf_cpy(data + offset, field->in_value, field->num_bits);
+				offset += bytes;
+			}
+			tap_set_state(cmd->cmd.scan->end_state);
+			break;
+		case JTAG_TLR_RESET:
+			tap_set_state(TAP_RESET);
+			break;
+		case JTAG_RUNTEST:
+			tap_set_state(cmd->cmd.runtest->end_state);
+			break;
+		case JTAG_RESET:
+			if (cmd->cmd.reset->trst == 1)
+				tap_set_state(TAP_RESET);
+			break;
+		case JTAG_PATHMOVE:
+			tap_set_state(cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1]);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+void ra_swd_batch_switch_seq(struct ra_swd_batch *batch, enum swd_special_seq seq)
+{
+	ra_msg_put_u8(&batch->msg, RA_SWD_SWITCH_SEQ);
+	ra_msg_put_u8(&batch->msg, seq);
+}
+
+void ra_swd_batch_read(struct ra_swd_batch *batch, uint8_t cmd, uint32_t *value,
+		uint32_t ap_delay_hint)
+{
+	if (batch->read_count == batch->read_size) {
+		unsigned size = batch->read_size ? 2 * batch->read_size : 64;
+		uint32_t **reads = realloc(batch->reads, size * sizeof(*reads));
+		if (reads == NULL) {
+			batch->msg.error = true;
+			return;
+		}
+		batch->reads = reads;
+		batch->read_size = size;
+	}
+	batch->reads[batch->read_count++] = value;
+
+	ra_msg_put_u8(&batch->msg, RA_SWD_READ);
+	ra_msg_put_u8(&batch->msg, cmd);
+	ra_msg_put_u32(&batch->msg, ap_delay_hint);
+}
+
+void ra_swd_batch_write(struct ra_swd_batch *batch, uint8_t cmd, uint32_t value,
+		uint32_t ap_delay_hint)
+{
+	ra_msg_put_u8(&batch->msg, RA_SWD_WRITE);
+	ra_msg_put_u8(&batch->msg, cmd);
+	ra_msg_put_u32(&batch->msg, value);
+	ra_msg_put_u32(&batch->msg, ap_delay_hint);
+}
+
+/* Append the values the reads of an executed @a batch returned. */
+void ra_swd_batch_put_results(struct ra_msg *msg, struct ra_swd_batch *batch)
+{
+	for (unsigned i = 0; i < batch->read_count; i++)
+		ra_msg_put_u32(msg, batch->reads[i] ? *batch->reads[i] : 0);
+}
+
+/* Hand out the read values of a reply to the reads of @a batch. */
+int ra_swd_batch_get_results(struct ra_swd_batch *batch, const uint8_t *data, uint32_t len)
+{
+	if (len < 4 * batch->read_count)
+		return ERROR_FAIL;
+
+	for (unsigned i = 0; i < batch->read_count; i++)
+		if (batch->reads[i])
+			*batch->reads[i] = le_to_h_u32(data + 4 * i);
+
+	return ERROR_OK;
+}
+
+void ra_swd_batch_reset(struct ra_swd_batch *batch)
+{
+	batch->msg.len = 0;
+	batch->msg.error = false;
+	batch->read_count = 0;
+}
+
+void ra_swd_batch_free(struct ra_swd_batch *batch)
+{
+	ra_msg_free(&batch->msg);
+	free(batch->reads);
+	memset(batch, 0, sizeof(*batch));
+}
@@ -0,0 +1,537 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "jtag.h"
+#include "interface.h"
+#include "commands.h"
+#include "swd.h"
+#include "remote_adapter.h"
+#include <helper/binarybuffer.h>
+#include <server/server.h>
+
+/* 'adapter_serve' exports the local adapter to remote_adapter clients.
+ * Requests carry whole flushed JTAG queues or SWD transaction batches,
+ * which are queued on the local driver and executed in one go. */
+
+#define RA_BUF_INITIAL		(64*1024)
+
+extern struct jtag_interface *jtag_interface;
+
+struct ra_buffer {
+	uint8_t *data;
+	uint32_t size;
+	uint32_t len;
+};
+
+struct ra_connection {
+	struct ra_buffer in;
+	struct ra_buffer out;
+};
+
+struct ra_args {
+	const uint8_t *data;
+	uint32_t len;
+};
+
+static char *adapter_serve_port;
+
+static int ra_buffer_reserve(struct ra_buffer *buf, uint32_t len)
+{
+	uint32_t size;
+	uint8_t *data;
+
+	if (buf->len + len <= buf->size)
+		return ERROR_OK;
+
+	size = buf->size ? buf->size : RA_BUF_INITIAL;
+	while (size < buf->len + len)
+		size *= 2;
+
+	data = realloc(buf->data, size);
+	if (data == NULL) {
+		LOG_ERROR("adapter_serve: out of memory");
+		return ERROR_FAIL;
+	}
+
+	buf->data = data;
+	buf->size = size;
+	return ERROR_OK;
+}
+
+static bool ra_get(struct ra_args *args, const uint8_t **p, uint32_t len)
+{
+	if (args->len < len)
+		return false;
+	*p = args->data;
+	args->data += len;
+	args->len -= len;
+	return true;
+}
+
+static bool ra_get_u8(struct ra_args *args, uint8_t *val)
+{
+	const uint8_t *p;
+	if (!ra_get(args, &p, 1))
+		return false;
+	*val = *p;
+	return true;
+}
+
+static bool ra_get_u32(struct ra_args *args, uint32_t *val)
+{
+	const uint8_t *p;
+	if (!ra_get(args, &p, 4))
+		return false;
+	*val = le_to_h_u32(p);
+	return true;
+}
+
+static bool ra_get_state(struct ra_args *args, tap_state_t *state)
+{
+	uint8_t val;
+	if (!ra_get_u8(args, &val) || val > TAP_RESET)
+		return false;
+	*state = val;
+	return true;
+}
+
+static void *ra_queue_alloc(bool queue, size_t size)
+{
+	return queue ? cmd_queue_alloc(size) : NULL;
+}
+
+/* Walk the commands of a RA_MSG_JTAG request. Without @a queue this only
+ * validates them and adds up the size of the captured data, so that a
+ * malformed request never leaves half of its commands queued. With
+ * @a queue the commands go to the JTAG queue, captured bits to @a capture. */
+static int ra_jtag_decode(struct ra_args args, bool queue,
+		uint8_t *capture, uint32_t *capture_len)
+{
+	*capture_len = 0;
+
+	while (args.len) {
+		struct jtag_command *cmd = ra_queue_alloc(queue, sizeof(*cmd));
+		uint32_t num, num_bits;
+		tap_state_t state;
+		const uint8_t *bits;
+		uint8_t type, val, flags;
+
+		if (!ra_get_u8(&args, &type))
+			return ERROR_FAIL;
+
+		/* SWD adapters only see resets and sleeps on this queue */
+		if (!transport_is_jtag() && type != JTAG_RESET && type != JTAG_SLEEP) {
+			LOG_ERROR("adapter_serve: JTAG command, but transport is not JTAG");
+			return ERROR_FAIL;
+		}
+
+		switch (type) {
+		case JTAG_SCAN:
+		{
+			struct scan_field *fields;
+
+			if (!ra_get_u8(&args, &val) || !ra_get_state(&args, &state) ||
+					!ra_get_u32(&args, &num) || num == 0 || num > args.len / 5)
+				return ERROR_FAIL;
+
+			fields = ra_queue_alloc(queue, num * sizeof(*fields));
+			for (uint32_t i = 0; i < num; i++) {
+				if (!ra_get_u32(&args, &num_bits) || !ra_get_u8(&args, &flags) ||
+						num_bits == 0 || num_bits > RA_FRAME_MAX)
+					return ERROR_FAIL;
+
+				bits = NULL;
+				if ((flags & RA_FIELD_OUT) &&
+						!ra_get(&args, &bits, DIV_ROUND_UP(num_bits, 8)))
+					return ERROR_FAIL;
+
+				if (queue) {
+					fields[i].num_bits = num_bits;
+					fields[i].out_value = bits;
+					fields[i].in_value = NULL;
+					if (flags & RA_FIELD_IN)
+						fields[i].in_value = capture + *capture_len;
+				}
+				if (flags & RA_FIELD_IN)
+					*capture_len += DIV_ROUND_UP(num_bits, 8);
+			}
+
+			if (queue) {
+				cmd->cmd.scan = cmd_queue_alloc(sizeof(*cmd->cmd.scan));
+				cmd->cmd.scan->ir_scan = val;
+				cmd->cmd.scan->num_fields = num;
+				cmd->cmd.scan->fields = fields;
+				cmd->cmd.scan->end_state = state;
+			}
+			break;
+		}
+		case JTAG_TLR_RESET:
+			if (!ra_get_state(&args, &state))
+				return ERROR_FAIL;
+			if (queue) {
+				cmd->cmd.statemove = cmd_queue_alloc(sizeof(*cmd->cmd.statemove));
+				cmd->cmd.statemove->end_state = state;
+			}
+			break;
+		case JTAG_RUNTEST:
+			if (!ra_get_u32(&args, &num) || !ra_get_state(&args, &state))
+				return ERROR_FAIL;
+			if (queue) {
+				cmd->cmd.runtest = cmd_queue_alloc(sizeof(*cmd->cmd.runtest));
+				cmd->cmd.runtest->num_cycles = num;
+				cmd->cmd.runtest->end_state = state;
+			}
+			break;
+		case JTAG_RESET:
+			if (!ra_get_u8(&args, &val) || !ra_get_u8(&args, &flags))
+				return ERROR_FAIL;
+			if (queue) {
+				cmd->cmd.reset = cmd_queue_alloc(sizeof(*cmd->cmd.reset));
+				cmd->cmd.reset->trst = val == 0xff ? -1 : val;
+				cmd->cmd.reset->srst = flags == 0xff ? -1 : flags;
+			}
+			break;
+		case JTAG_PATHMOVE:
+			if (!ra_get_u32(&args, &num) || num == 0 || num > args.len)
+				return ERROR_FAIL;
+			if (queue) {
+				cmd->cmd.pathmove = cmd_queue_alloc(sizeof(*cmd->cmd.pathmove));
+				cmd->cmd.pathmove->num_states = num;
+				cmd->cmd.pathmove->path = cmd_queue_alloc(num * sizeof(tap_state_t));
+			}
+			for (uint32_t i = 0; i < num; i++) {
+				if (!ra_get_state(&args, &state))
+					return ERROR_FAIL;
+				if (queue)
+					cmd->cmd.pathmove->path[i] = state;
+			}
+			break;
+		case JTAG_SLEEP:
+			if (!ra_get_u32(&args, &num))
+				return ERROR_FAIL;
+			if (queue) {
+				cmd->cmd.sleep = cmd_queue_alloc(sizeof(*cmd->cmd.sleep));
+				cmd->cmd.sleep->us = num;
+			}
+			break;
+		case JTAG_STABLECLOCKS:
+			if (!ra_get_u32(&args, &num))
+				return ERROR_FAIL;
+			if (queue) {
+				cmd->cmd.stableclocks = cmd_queue_alloc(sizeof(*cmd->cmd.stableclocks));
+				cmd->cmd.stableclocks->num_cycles = num;
+			}
+			break;
+		case JTAG_TMS:
+			if (!ra_get_u32(&args, &num_bits) || num_bits == 0 || num_bits > RA_FRAME_MAX ||
+					!ra_get(&args, &bits, DIV_ROUND_UP(num_bits, 8)))
+				return ERROR_FAIL;
+			if (queue) {
+				cmd->cmd.tms = cmd_queue_alloc(sizeof(*cmd->cmd.tms));
+				cmd->cmd.tms->num_bits = num_bits;
+				cmd->cmd.tms->bits = bits;
+			}
+			break;
+		default:
+			LOG_ERROR("adapter_serve: unknown JTAG command %d", type);
+			return ERROR_FAIL;
+		}
+
+		if (queue) {
+			cmd->type = type;
+			jtag_queue_command(cmd);
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* Queue and run a JTAG request; the captured bits are appended to @a out,
+ * which must have room for them already. */
+static int ra_jtag_execute(const uint8_t *data, uint32_t len, struct ra_buffer *out)
+{
+	struct ra_args args = { .data = data, .len = len };
+	uint32_t capture_len;
+	uint8_t *capture;
+	int retval;
+
+	retval = ra_jtag_decode(args, false, NULL, &capture_len);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("adapter_serve: malformed JTAG request");
+		return retval;
+	}
+
+	if (ra_buffer_reserve(out, capture_len) != ERROR_OK)
+		return ERROR_FAIL;
+	capture = out->data + out->len;
+	memset(capture, 0, capture_len);
+
+	/* out bits point into the request, which stays valid until the
+	 * queue has executed */
+	ra_jtag_decode(args, true, capture, &capture_len);
+	retval = jtag_execute_queue();
+
+	out->len += capture_len;
+	return retval;
+}
+
+static int ra_swd_execute(const uint8_t *data, uint32_t len, struct ra_buffer *out)
+{
+	const struct swd_driver *swd = jtag_interface->swd;
+	struct ra_args args = { .data = data, .len = len };
+	uint32_t reads = 0;
+	uint32_t *values;
+	uint8_t op, cmd;
+	uint32_t value, delay;
+	int retval = ERROR_OK;
+
+	if (!transport_is_swd() || swd == NULL) {
+		LOG_ERROR("adapter_serve: SWD request, but transport is not SWD");
+		return ERROR_FAIL;
+	}
+
+	/* every read takes at least six bytes of the request */
+	if (ra_buffer_reserve(out, len / 6 * 4) != ERROR_OK)
+		return ERROR_FAIL;
+	values = calloc(len / 6 + 1, sizeof(*values));
+	if (values == NULL)
+		return ERROR_FAIL;
+
+	while (args.len && retval == ERROR_OK) {
+		if (!ra_get_u8(&args, &op)) {
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		switch (op) {
+		case RA_SWD_SWITCH_SEQ:
+			if (!ra_get_u8(&args, &cmd))
+				retval = ERROR_FAIL;
+			else
+				retval = swd->switch_seq(cmd);
+			break;
+		case RA_SWD_READ:
+			if (!ra_get_u8(&args, &cmd) || !ra_get_u32(&args, &delay))
+				retval = ERROR_FAIL;
+			else
+				swd->read_reg(cmd, &values[reads++], delay);
+			break;
+		case RA_SWD_WRITE:
+			if (!ra_get_u8(&args, &cmd) || !ra_get_u32(&args, &value) ||
+					!ra_get_u32(&args, &delay))
+				retval = ERROR_FAIL;
+			else
+				swd->write_reg(cmd, value, delay);
+			break;
+		default:
+			LOG_ERROR("adapter_serve: unknown SWD operation %d", op);
+			retval = ERROR_FAIL;
+			break;
+		}
+	}
+
+	/* run what was queued even after a bad request, the driver must not
+	 * keep stale transactions around for the next one */
+	if (retval == ERROR_OK)
+		retval = swd->run();
+	else
+		swd->run();
+
+	for (uint32_t i = 0; i < reads; i++)
+		h_u32_to_le(out->data + out->len + 4 * i, values[i]);
+	out->len += 4 * reads;
+
+	free(values);
+	return retval;
+}
+
+static int ra_process_frame(struct connection *connection, uint8_t type,
+		const uint8_t *data, uint32_t len)
+{
+	struct ra_connection *rac = connection->priv;
+	struct ra_buffer *out = &rac->out;
+	int retval;
+
+	out->len = 0;
+	if (ra_buffer_reserve(out, RA_HEADER_SIZE + 8) != ERROR_OK)
+		return ERROR_SERVER_REMOTE_CLOSED;
+	out->len = RA_HEADER_SIZE + 4;
+
+	switch (type) {
+	case RA_MSG_HELLO:
+		if (len != 4 || le_to_h_u32(data) != RA_PROTOCOL_VERSION) {
+			LOG_ERROR("adapter_serve: client speaks another protocol version");
+			retval = ERROR_FAIL;
+		} else
+			retval = ERROR_OK;
+		h_u32_to_le(out->data + out->len, RA_PROTOCOL_VERSION);
+		out->len += 4;
+		break;
+	case RA_MSG_SPEED:
+		if (len != 4)
+			retval = ERROR_FAIL;
+		else
+			retval = jtag_config_khz(le_to_h_u32(data));
+		break;
+	case RA_MSG_JTAG:
+		retval = ra_jtag_execute(data, len, out);
+		break;
+	case RA_MSG_SWD:
+		retval = ra_swd_execute(data, len, out);
+		break;
+	default:
+		LOG_ERROR("adapter_serve: unknown message type %d", type);
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	h_u32_to_le(out->data, out->len - RA_HEADER_SIZE);
+	out->data[4] = type;
+	h_u32_to_le(out->data + RA_HEADER_SIZE, retval);
+
+	if (connection_write(connection, out->data, out->len) != (int)out->len) {
+		LOG_ERROR("adapter_serve: error during write");
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	return ERROR_OK;
+}
+
+static int ra_new_connection(struct connection *connection)
+{
+	connection->priv = calloc(1, sizeof(struct ra_connection));
+	if (connection->priv == NULL)
+		return ERROR_CONNECTION_REJECTED;
+
+	LOG_INFO("adapter_serve: client connected");
+	return ERROR_OK;
+}
+
+static int ra_input(struct connection *connection)
+{
+	struct ra_connection *rac = connection->priv;
+	struct ra_buffer *in = &rac->in;
+	uint32_t offset = 0;
+	int rlen;
+	int retval;
+
+	if (ra_buffer_reserve(in, RA_BUF_INITIAL / 2) != ERROR_OK)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	rlen = connection_read(connection, in->data + in->len, in->size - in->len);
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("adapter_serve: error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+	in->len += rlen;
+
+	/* process every complete frame received so far */
+	while (in->len - offset >= RA_HEADER_SIZE) {
+		uint32_t len = le_to_h_u32(in->data + offset);
+
+		if (len > RA_FRAME_MAX) {
+			LOG_ERROR("adapter_serve: frame of %" PRIu32 " bytes exceeds limit", len);
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+
+		if (in->len - offset - RA_HEADER_SIZE < len) {
+			/* make sure the rest of the frame fits */
+			if (ra_buffer_reserve(in, RA_HEADER_SIZE + len) != ERROR_OK)
+				return ERROR_SERVER_REMOTE_CLOSED;
+			break;
+		}
+
+		retval = ra_process_frame(connection, in->data[offset + 4],
+				in->data + offset + RA_HEADER_SIZE, len);
+		if (retval != ERROR_OK)
+			return retval;
+
+		offset += RA_HEADER_SIZE + len;
+	}
+
+	in->len -= offset;
+	memmove(in->data, in->data + offset, in->len);
+
+	return ERROR_OK;
+}
+
+static int ra_connection_closed(struct connection *connection)
+{
+	struct ra_connection *rac = connection->priv;
+
+	LOG_INFO("adapter_serve: client disconnected");
+
+	if (rac) {
+		free(rac->in.data);
+		free(rac->out.data);
+		free(rac);
+		connection->priv = NULL;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_adapter_serve_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(CMD_ARGV[0], "stop") == 0) {
+		if (adapter_serve_port == NULL)
+			return ERROR_OK;
+		int retval = remove_service("adapter", adapter_serve_port);
+		free(adapter_serve_port);
+		adapter_serve_port = NULL;
+		return retval;
+	}
+
+	if (adapter_serve_port != NULL) {
+		LOG_ERROR("adapter is already served on port %s", adapter_serve_port);
+		return ERROR_FAIL;
+	}
+
+	if (!transport_is_jtag() && !(transport_is_swd() && jtag_interface->swd)) {
+		LOG_ERROR("adapter_serve needs a JTAG or SWD adapter");
+		return ERROR_FAIL;
+	}
+
+	/* one client at a time owns the adapter */
+	int retval = add_service("adapter", CMD_ARGV[0], 1,
+			ra_new_connection, ra_input, ra_connection_closed, NULL);
+	if (retval == ERROR_OK)
+		adapter_serve_port = strdup(CMD_ARGV[0]);
+	return retval;
+}
+
+static const struct command_registration adapter_serve_command_handlers[] = {
+	{
+		.name = "adapter_serve",
+		.handler = handle_adapter_serve_command,
+		.mode = COMMAND_EXEC,
+		.help = "Export the adapter to remote_adapter clients "
+			"on a TCP port, or stop doing so.",
+		.usage = "port | 'stop'",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int adapter_serve_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, adapter_serve_command_handlers);
+}
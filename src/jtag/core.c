@@ -33,8 +33,11 @@
 #include "jtag.h"
 #include "swd.h"
 #include "interface.h"
+#include "remote_adapter.h"
 #include <transport/transport.h>
 #include <helper/jep106.h>
+#include <helper/metrics.h>
+#include <helper/timeline.h>
 
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
@@ -827,6 +830,16 @@ void jtag_check_value_mask(struct scan_field *field, uint8_t *value, uint8_t *ma
 	jtag_set_error(retval);
 }
 
+static struct metric_family jtag_scan_bits_metric =
+	METRIC_COUNTER("openocd_jtag_scan_bits_total",
+		"Bits shifted through IR and DR scans.", NULL);
+static struct metric_family jtag_flushes_metric =
+	METRIC_COUNTER("openocd_jtag_queue_flushes_total",
+		"Times the JTAG queue was executed.", NULL);
+static struct metric_family jtag_flush_duration_metric =
+	METRIC_HISTOGRAM_US("openocd_jtag_queue_flush_duration_seconds",
+		"Time spent executing the JTAG queue.");
+
 int default_interface_jtag_execute_queue(void)
 {
 	if (NULL == jtag) {
@@ -836,13 +849,33 @@ int default_interface_jtag_execute_queue(void)
 		return ERROR_FAIL;
 	}
 
-	return jtag->execute_queue();
+	uint64_t bits = 0;
+	for (struct jtag_command *cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		if (cmd->type == JTAG_SCAN)
+			bits += jtag_scan_size(cmd->cmd.scan);
+	}
+	metric_add(&jtag_scan_bits_metric, bits);
+
+	struct timeline_span span;
+	timeline_begin(&span);
+	int retval = jtag->execute_queue();
+	timeline_end(&span, "adapter", "execute_queue", jtag->name);
+
+	return retval;
 }
 
 void jtag_execute_queue_noclear(void)
 {
+	struct timeval start, end;
+
 	jtag_flush_queue_count++;
+	metric_add(&jtag_flushes_metric, 1);
+
+	gettimeofday(&start, NULL);
 	jtag_set_error(interface_jtag_execute_queue());
+	gettimeofday(&end, NULL);
+	metric_observe(&jtag_flush_duration_metric,
+			(end.tv_sec - start.tv_sec) * 1000000ll + end.tv_usec - start.tv_usec);
 
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
@@ -1472,6 +1505,10 @@ int jtag_init_inner(struct command_context *cmd_ctx)
 
 int adapter_quit(void)
 {
+#ifndef HAVE_JTAG_MINIDRIVER_H
+	adapter_capture_stop();
+#endif
+
 	if (!jtag || !jtag->quit)
 		return ERROR_OK;
 
@@ -1645,6 +1682,212 @@ int jtag_config_rclk(unsigned fallback_speed_khz)
 	return (ERROR_OK != retval) ? retval : jtag_set_speed(speed);
 }
 
+/* Pattern bits shifted per BYPASS check and rounds run per candidate speed */
+#define JTAG_AUTO_KHZ_PATTERN_BITS	512
+#define JTAG_AUTO_KHZ_ROUNDS		8
+/* Stop the search once the bracket is narrower than 1/32 of the speed */
+#define JTAG_AUTO_KHZ_RESOLUTION	32
+/* Settle this many percent below the fastest speed that passed */
+#define JTAG_AUTO_KHZ_MARGIN		25
+
+static uint32_t jtag_auto_khz_random(uint32_t *state)
+{
+	/* xorshift32, good enough to toggle every data line pattern */
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/**
+ * Put every enabled TAP in BYPASS and shift a random pattern through
+ * the chain; it must come back delayed by one bit per TAP, after the
+ * zeros captured by the BYPASS registers.
+ */
+static int jtag_auto_khz_check_bypass(uint32_t seed)
+{
+	unsigned num_taps = 0;
+	unsigned ir_bits = 0;
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap;
+			tap = jtag_tap_next_enabled(tap)) {
+		num_taps++;
+		ir_bits += tap->ir_length;
+	}
+	if (num_taps == 0) {
+		LOG_ERROR("no enabled TAP to check the adapter speed with");
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	unsigned dr_bits = num_taps + JTAG_AUTO_KHZ_PATTERN_BITS;
+	uint8_t *ir_out = malloc(DIV_ROUND_UP(ir_bits, 8));
+	uint8_t *dr_out = calloc(DIV_ROUND_UP(dr_bits, 8), 1);
+	uint8_t *dr_in = calloc(DIV_ROUND_UP(dr_bits, 8), 1);
+	if (ir_out == NULL || dr_out == NULL || dr_in == NULL) {
+		free(ir_out);
+		free(dr_out);
+		free(dr_in);
+		return ERROR_FAIL;
+	}
+
+	buf_set_ones(ir_out, ir_bits);
+	for (unsigned i = 0; i < JTAG_AUTO_KHZ_PATTERN_BITS; i += 32)
+		buf_set_u32(dr_out, i, 32, jtag_auto_khz_random(&seed));
+
+	jtag_add_plain_ir_scan(ir_bits, ir_out, NULL, TAP_IDLE);
+	jtag_add_plain_dr_scan(dr_bits, dr_out, dr_in, TAP_IDLE);
+	int retval = jtag_execute_queue();
+
+	/* whatever happened, the scan left every TAP in BYPASS */
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap;
+			tap = jtag_tap_next_enabled(tap)) {
+		buf_set_ones(tap->cur_instr, tap->ir_length);
+		tap->bypass = 1;
+	}
+
+	if (retval == ERROR_OK) {
+		for (unsigned i = 0; i < dr_bits; i++) {
+			int expected = i < num_taps ? 0
+				: buf_get_u32(dr_out, i - num_taps, 1);
+			if ((int)buf_get_u32(dr_in, i, 1) != expected) {
+				LOG_DEBUG("BYPASS loopback mismatch at bit %u", i);
+				retval = ERROR_JTAG_QUEUE_FAILED;
+				break;
+			}
+		}
+	}
+
+	free(ir_out);
+	free(dr_out);
+	free(dr_in);
+	return retval;
+}
+
+/**
+ * Re-synchronize the SWD link and read DP IDCODE, which must match
+ * the value read at the starting speed. The driver checks the ACK and
+ * data parity of every transfer.
+ */
+static int jtag_auto_khz_check_swd(uint32_t expected_idcode, uint32_t *idcode)
+{
+	const struct swd_driver *swd = jtag->swd;
+	uint32_t value[JTAG_AUTO_KHZ_ROUNDS];
+
+	int retval = swd->switch_seq(LINE_RESET);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* DP IDCODE lives at address 0x0 of the DP */
+	for (unsigned i = 0; i < JTAG_AUTO_KHZ_ROUNDS; i++)
+		swd->read_reg(swd_cmd(true, false, 0x0), &value[i], 0);
+	retval = swd->run();
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned i = 0; i < JTAG_AUTO_KHZ_ROUNDS; i++) {
+		if (idcode == NULL && value[i] != expected_idcode) {
+			LOG_DEBUG("DP IDCODE read back as 0x%08" PRIx32
+				", expected 0x%08" PRIx32, value[i], expected_idcode);
+			return ERROR_FAIL;
+		}
+		if (idcode != NULL && value[i] != value[0])
+			return ERROR_FAIL;
+	}
+	if (idcode != NULL)
+		*idcode = value[0];
+	return ERROR_OK;
+}
+
+/* Run every check at the given speed; ERROR_OK if the link is reliable */
+static int jtag_auto_khz_check(unsigned khz, uint32_t *swd_idcode, bool first)
+{
+	int retval = jtag_config_khz(khz);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (transport_is_swd())
+		return jtag_auto_khz_check_swd(*swd_idcode, first ? swd_idcode : NULL);
+
+	for (unsigned i = 0; i < JTAG_AUTO_KHZ_ROUNDS; i++) {
+		retval = jtag_auto_khz_check_bypass(0x9e3779b9 + (khz << 8) + i);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	return ERROR_OK;
+}
+
+int jtag_config_khz_auto(unsigned min_khz, unsigned max_khz)
+{
+	if (jtag == NULL) {
+		LOG_ERROR("the adapter must be initialized to discover its speed");
+		return ERROR_JTAG_INIT_FAILED;
+	}
+	if (!transport_is_jtag() && !(transport_is_swd() && jtag->swd)) {
+		LOG_ERROR("automatic adapter speed is not supported on %s",
+			get_current_transport()->name);
+		return ERROR_JTAG_NOT_IMPLEMENTED;
+	}
+	if (min_khz == 0 || max_khz < min_khz)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	unsigned old_khz = jtag_get_speed_khz();
+	uint32_t swd_idcode = 0;
+
+	int retval = jtag_auto_khz_check(min_khz, &swd_idcode, true);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("adapter link is not reliable even at %u kHz", min_khz);
+		jtag_config_khz(old_khz);
+		return retval;
+	}
+
+	/* lo always passed, hi either failed or is past the search range */
+	unsigned lo = min_khz;
+	unsigned hi = max_khz + 1;
+	if (jtag_auto_khz_check(max_khz, &swd_idcode, false) == ERROR_OK)
+		lo = max_khz;
+	else
+		hi = max_khz;
+
+	while (hi - lo > 1 && hi - lo > lo / JTAG_AUTO_KHZ_RESOLUTION) {
+		unsigned mid = lo + (hi - lo) / 2;
+		int lo_actual, mid_actual;
+
+		/* adapters with coarse dividers map many requests to one clock */
+		jtag_config_khz(lo);
+		jtag_get_speed_readable(&lo_actual);
+		jtag_config_khz(mid);
+		jtag_get_speed_readable(&mid_actual);
+		if (lo_actual == mid_actual) {
+			lo = mid;
+			continue;
+		}
+
+		retval = jtag_auto_khz_check(mid, &swd_idcode, false);
+		LOG_DEBUG("adapter speed %u kHz: %s", mid,
+			retval == ERROR_OK ? "pass" : "fail");
+		if (retval == ERROR_OK)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	unsigned khz = lo - lo * JTAG_AUTO_KHZ_MARGIN / 100;
+	if (khz < min_khz)
+		khz = min_khz;
+
+	retval = jtag_auto_khz_check(khz, &swd_idcode, false);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("adapter link failed its check at the settled %u kHz", khz);
+		jtag_config_khz(old_khz);
+		return retval;
+	}
+
+	LOG_INFO("fastest reliable adapter speed %u kHz, settled at %u kHz",
+		lo, khz);
+	return ERROR_OK;
+}
+
 int jtag_get_speed(int *speed)
 {
 	switch (clock_mode) {
@@ -34,6 +34,7 @@
 #include <jtag/interface.h>
 #include <jtag/commands.h>
 #include <jtag/minidriver.h>
+#include <jtag/remote_adapter.h>
 #include <helper/command.h>
 
 struct jtag_callback_entry {
@@ -379,6 +380,8 @@ int interface_jtag_execute_queue(void)
 	reentry++;
 
 	int retval = default_interface_jtag_execute_queue();
+	if (adapter_capture_active)
+		adapter_capture_jtag(jtag_command_queue, retval);
 	if (retval == ERROR_OK) {
 		struct jtag_callback_entry *entry;
 		for (entry = jtag_callback_queue_head; entry != NULL; entry = entry->next) {
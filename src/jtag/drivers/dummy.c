@@ -33,19 +33,69 @@ static int clock_count;		/* count clocks in any stable state, only stable states
 
 static uint32_t dummy_data;
 
+/* 'dummy bypass': a single TAP that only has its BYPASS register, as a
+ * stand-in target for code that checks the link, like adapter_khz auto */
+static bool dummy_bypass;
+static uint32_t dummy_shift;		/* IR or BYPASS shift register */
+static unsigned dummy_shift_len;
+
+/* 'dummy error_khz': above this speed, TDO bits are flipped at random */
+static unsigned dummy_error_khz;
+static unsigned dummy_khz_now;
+static uint32_t dummy_error_seed = 1;
+
 static int dummy_read(void)
 {
-	int data = 1 & dummy_data;
-	dummy_data = (dummy_data >> 1) | (1 << 31);
+	int data;
+
+	if (dummy_bypass) {
+		data = 1 & dummy_shift;
+	} else {
+		data = 1 & dummy_data;
+		dummy_data = (dummy_data >> 1) | (1 << 31);
+	}
+
+	if (dummy_error_khz && dummy_khz_now > dummy_error_khz) {
+		/* one bit in eight goes wrong */
+		dummy_error_seed = dummy_error_seed * 1103515245 + 12345;
+		if ((dummy_error_seed >> 16) % 8 == 0)
+			data ^= 1;
+	}
+
 	return data;
 }
 
+static void dummy_bypass_capture(tap_state_t state)
+{
+	if (state == TAP_IRCAPTURE) {
+		struct jtag_tap *tap = jtag_tap_next_enabled(NULL);
+		dummy_shift_len = (tap && tap->ir_length) ? tap->ir_length : 4;
+		/* IEEE 1149.1 wants the two LSBs captured as 01 */
+		dummy_shift = 0x1;
+	} else if (state == TAP_DRCAPTURE) {
+		dummy_shift_len = 1;
+		dummy_shift = 0;
+	}
+}
+
+static void dummy_bypass_shift(tap_state_t state, int tdi)
+{
+	if (state != TAP_IRSHIFT && state != TAP_DRSHIFT)
+		return;
+
+	dummy_shift >>= 1;
+	if (tdi)
+		dummy_shift |= 1 << (dummy_shift_len - 1);
+}
+
 static void dummy_write(int tck, int tms, int tdi)
 {
 	/* TAP standard: "state transitions occur on rising edge of clock" */
 	if (tck != dummy_clock) {
 		if (tck) {
 			tap_state_t old_state = dummy_state;
+			if (dummy_bypass)
+				dummy_bypass_shift(old_state, tdi);
 			dummy_state = tap_state_transition(old_state, tms);
 
 			if (old_state != dummy_state) {
@@ -56,6 +106,9 @@ static void dummy_write(int tck, int tms, int tdi)
 
 				LOG_DEBUG("dummy_tap: %s", tap_state_name(dummy_state));
 
+				if (dummy_bypass)
+					dummy_bypass_capture(dummy_state);
+
 #if defined(DEBUG)
 				if (dummy_state == TAP_DRCAPTURE)
 					dummy_data = 0x01255043;
@@ -113,6 +166,7 @@ static int dummy_speed_div(int speed, int *khz)
 
 static int dummy_speed(int speed)
 {
+	dummy_khz_now = speed ? 64000 / speed : 0;
 	return ERROR_OK;
 }
 
@@ -128,6 +182,51 @@ static int dummy_quit(void)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(dummy_handle_bypass_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], dummy_bypass);
+
+	command_print(CMD_CTX, "dummy bypass TAP is %s", dummy_bypass ? "on" : "off");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dummy_handle_error_khz_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], dummy_error_khz);
+
+	if (dummy_error_khz)
+		command_print(CMD_CTX, "dummy TDO bit errors above %u kHz", dummy_error_khz);
+	else
+		command_print(CMD_CTX, "dummy TDO bit errors disabled");
+	return ERROR_OK;
+}
+
+static const struct command_registration dummy_subcommand_handlers[] = {
+	{
+		.name = "bypass",
+		.handler = dummy_handle_bypass_command,
+		.mode = COMMAND_ANY,
+		.help = "emulate a single TAP with only a BYPASS register",
+		.usage = "['on'|'off']",
+	},
+	{
+		.name = "error_khz",
+		.handler = dummy_handle_error_khz_command,
+		.mode = COMMAND_ANY,
+		.help = "flip TDO bits at random above this speed, 0 to disable",
+		.usage = "[khz]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration dummy_command_handlers[] = {
 	{
 		.name = "dummy",
@@ -136,6 +235,13 @@ static const struct command_registration dummy_command_handlers[] = {
 
 		.chain = hello_command_handlers,
 	},
+	{
+		.name = "dummy",
+		.mode = COMMAND_ANY,
+		.help = "dummy interface driver commands",
+		.usage = "",
+		.chain = dummy_subcommand_handlers,
+	},
 	COMMAND_REGISTRATION_DONE,
 };
 
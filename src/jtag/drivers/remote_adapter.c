@@ -0,0 +1,366 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+#include <jtag/interface.h>
+#include <jtag/commands.h>
+#include <jtag/swd.h>
+#include <jtag/remote_adapter.h>
+#include <helper/binarybuffer.h>
+
+/* The remote_adapter driver forwards the adapter queues to an OpenOCD
+ * running 'adapter_serve' next to the probe. A flushed JTAG queue or a
+ * batch of SWD transactions travels as one message, so a round trip is
+ * paid per flush instead of per bit or per transaction. */
+
+static char *remote_adapter_host;
+static char *remote_adapter_port;
+static int remote_adapter_fd = -1;
+
+static struct ra_msg ra_out;
+static struct ra_msg ra_in;
+
+/* SWD transactions queued since the last run() */
+static struct ra_swd_batch ra_swd_batch;
+
+static int ra_write_all(const uint8_t *data, uint32_t len)
+{
+	while (len) {
+		int n = write_socket(remote_adapter_fd, data, len);
+		if (n <= 0) {
+			LOG_ERROR("remote_adapter: error during write: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		data += n;
+		len -= n;
+	}
+	return ERROR_OK;
+}
+
+static int ra_read_all(uint8_t *data, uint32_t len)
+{
+	while (len) {
+		int n = read_socket(remote_adapter_fd, data, len);
+		if (n <= 0) {
+			if (n == 0)
+				LOG_ERROR("remote_adapter: server closed the connection");
+			else
+				LOG_ERROR("remote_adapter: error during read: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		data += n;
+		len -= n;
+	}
+	return ERROR_OK;
+}
+
+/* Send the request in ra_out and receive the reply. The reply's status
+ * is returned in @a status, its results are left in ra_in. */
+static int ra_transact(int *status)
+{
+	uint8_t header[RA_HEADER_SIZE + 4];
+	uint32_t len;
+
+	ra_msg_end(&ra_out);
+	if (ra_out.error)
+		return ERROR_FAIL;
+	if (remote_adapter_fd < 0) {
+		LOG_ERROR("remote_adapter: not connected");
+		return ERROR_FAIL;
+	}
+
+	if (ra_write_all(ra_out.data, ra_out.len) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (ra_read_all(header, sizeof(header)) != ERROR_OK)
+		return ERROR_FAIL;
+
+	len = le_to_h_u32(header);
+	if (len < 4 || len > RA_FRAME_MAX || header[4] != ra_out.data[4]) {
+		LOG_ERROR("remote_adapter: malformed reply");
+		return ERROR_FAIL;
+	}
+	*status = (int32_t)le_to_h_u32(header + RA_HEADER_SIZE);
+
+	len -= 4;
+	ra_in.len = 0;
+	if (ra_msg_reserve(&ra_in, len) != ERROR_OK)
+		return ERROR_FAIL;
+	if (ra_read_all(ra_in.data, len) != ERROR_OK)
+		return ERROR_FAIL;
+	ra_in.len = len;
+
+	return ERROR_OK;
+}
+
+static int remote_adapter_execute_queue(void)
+{
+	int status;
+
+	if (jtag_command_queue == NULL)
+		return ERROR_OK;
+
+	ra_msg_begin(&ra_out, RA_MSG_JTAG);
+	if (ra_msg_put_jtag_queue(&ra_out, jtag_command_queue) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (ra_transact(&status) != ERROR_OK)
+		return ERROR_JTAG_QUEUE_FAILED;
+
+	if (ra_msg_get_jtag_results(jtag_command_queue, ra_in.data, ra_in.len) != ERROR_OK) {
+		LOG_ERROR("remote_adapter: short reply");
+		return ERROR_JTAG_QUEUE_FAILED;
+	}
+
+	return status;
+}
+
+static int remote_adapter_send_speed(unsigned khz)
+{
+	int status;
+
+	ra_msg_begin(&ra_out, RA_MSG_SPEED);
+	ra_msg_put_u32(&ra_out, khz);
+	if (ra_transact(&status) != ERROR_OK)
+		return ERROR_FAIL;
+	return status;
+}
+
+static int remote_adapter_speed(int speed)
+{
+	return remote_adapter_send_speed(speed);
+}
+
+/* speed values are plain kHz, the server does the adapter's rounding */
+static int remote_adapter_khz(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int remote_adapter_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+static int remote_adapter_swd_init(void)
+{
+	return ERROR_OK;
+}
+
+static int_least32_t remote_adapter_swd_frequency(int_least32_t hz)
+{
+	if (hz > 0)
+		remote_adapter_send_speed(DIV_ROUND_UP(hz, 1000));
+	return hz;
+}
+
+static int remote_adapter_swd_switch_seq(enum swd_special_seq seq)
+{
+	ra_swd_batch_switch_seq(&ra_swd_batch, seq);
+	return ERROR_OK;
+}
+
+static void remote_adapter_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_hint)
+{
+	ra_swd_batch_read(&ra_swd_batch, cmd, value, ap_delay_hint);
+}
+
+static void remote_adapter_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay_hint)
+{
+	ra_swd_batch_write(&ra_swd_batch, cmd, value, ap_delay_hint);
+}
+
+static int remote_adapter_swd_run(void)
+{
+	int status;
+	int retval;
+
+	if (ra_swd_batch.msg.len == 0)
+		return ERROR_OK;
+
+	ra_msg_begin(&ra_out, RA_MSG_SWD);
+	ra_msg_put(&ra_out, ra_swd_batch.msg.data, ra_swd_batch.msg.len);
+	if (ra_swd_batch.msg.error)
+		ra_out.error = true;
+
+	retval = ra_transact(&status);
+	if (retval == ERROR_OK) {
+		if (ra_swd_batch_get_results(&ra_swd_batch, ra_in.data, ra_in.len) != ERROR_OK) {
+			LOG_ERROR("remote_adapter: short reply");
+			retval = ERROR_FAIL;
+		} else
+			retval = status;
+	}
+
+	ra_swd_batch_reset(&ra_swd_batch);
+	return retval;
+}
+
+static const struct swd_driver remote_adapter_swd = {
+	.init = remote_adapter_swd_init,
+	.frequency = remote_adapter_swd_frequency,
+	.switch_seq = remote_adapter_swd_switch_seq,
+	.read_reg = remote_adapter_swd_read_reg,
+	.write_reg = remote_adapter_swd_write_reg,
+	.run = remote_adapter_swd_run,
+};
+
+static int remote_adapter_connect(void)
+{
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+	struct addrinfo *result, *rp;
+	int fd = -1;
+	int flag = 1;
+
+	LOG_INFO("Connecting to %s:%s",
+			remote_adapter_host ? remote_adapter_host : "localhost",
+			remote_adapter_port);
+
+	int s = getaddrinfo(remote_adapter_host, remote_adapter_port, &hints, &result);
+	if (s != 0) {
+		LOG_ERROR("getaddrinfo: %s", gai_strerror(s));
+		return ERROR_FAIL;
+	}
+
+	for (rp = result; rp != NULL; rp = rp->ai_next) {
+		fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		if (fd == -1)
+			continue;
+
+		if (connect(fd, rp->ai_addr, rp->ai_addrlen) != -1)
+			break;
+
+		close_socket(fd);
+	}
+
+	freeaddrinfo(result);
+
+	if (rp == NULL) {
+		LOG_ERROR("Failed to connect: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	/* every flush waits for its reply, don't let Nagle delay it */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag));
+
+	remote_adapter_fd = fd;
+	return ERROR_OK;
+}
+
+static int remote_adapter_init(void)
+{
+	int status;
+
+	if (remote_adapter_port == NULL) {
+		LOG_ERROR("remote_adapter: no port configured, use 'remote_adapter_port'");
+		return ERROR_FAIL;
+	}
+
+	if (remote_adapter_connect() != ERROR_OK)
+		return ERROR_FAIL;
+
+	ra_msg_begin(&ra_out, RA_MSG_HELLO);
+	ra_msg_put_u32(&ra_out, RA_PROTOCOL_VERSION);
+	if (ra_transact(&status) != ERROR_OK || status != ERROR_OK) {
+		LOG_ERROR("remote_adapter: server rejected protocol version %d",
+				RA_PROTOCOL_VERSION);
+		close_socket(remote_adapter_fd);
+		remote_adapter_fd = -1;
+		return ERROR_FAIL;
+	}
+
+	LOG_INFO("remote_adapter driver initialized");
+	return ERROR_OK;
+}
+
+static int remote_adapter_quit(void)
+{
+	if (remote_adapter_fd >= 0)
+		close_socket(remote_adapter_fd);
+	remote_adapter_fd = -1;
+
+	ra_msg_free(&ra_out);
+	ra_msg_free(&ra_in);
+	ra_swd_batch_free(&ra_swd_batch);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(remote_adapter_handle_port_command)
+{
+	uint16_t port;
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u16, CMD_ARGV[0], port);
+	free(remote_adapter_port);
+	remote_adapter_port = strdup(CMD_ARGV[0]);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(remote_adapter_handle_host_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(remote_adapter_host);
+	remote_adapter_host = strdup(CMD_ARGV[0]);
+	return ERROR_OK;
+}
+
+static const struct command_registration remote_adapter_command_handlers[] = {
+	{
+		.name = "remote_adapter_port",
+		.handler = remote_adapter_handle_port_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the TCP port of the remote 'adapter_serve'.",
+		.usage = "port_number",
+	},
+	{
+		.name = "remote_adapter_host",
+		.handler = remote_adapter_handle_host_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the host running 'adapter_serve', "
+			"localhost by default.",
+		.usage = "host_name",
+	},
+	COMMAND_REGISTRATION_DONE,
+};
+
+static const char * const remote_adapter_transports[] = { "jtag", "swd", NULL };
+
+struct jtag_interface remote_adapter_interface = {
+	.name = "remote_adapter",
+	.transports = remote_adapter_transports,
+	.swd = &remote_adapter_swd,
+	.execute_queue = &remote_adapter_execute_queue,
+	.speed = &remote_adapter_speed,
+	.khz = &remote_adapter_khz,
+	.speed_div = &remote_adapter_speed_div,
+	.commands = remote_adapter_command_handlers,
+	.init = &remote_adapter_init,
+	.quit = &remote_adapter_quit,
+};
@@ -0,0 +1,305 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <jtag/interface.h>
+#include <jtag/commands.h>
+#include <jtag/swd.h>
+#include <jtag/remote_adapter.h>
+#include <helper/binarybuffer.h>
+#include <helper/fileio.h>
+
+/* The replay driver answers from an 'adapter_capture' file instead of
+ * hardware. Every flushed JTAG queue and SWD batch is encoded the way
+ * remote_adapter would send it and must match the next recorded request
+ * byte for byte; the recorded reply is then handed out as if the adapter
+ * had produced it. Sleeps are skipped, so a replayed session measures
+ * the host side alone. Once a request differs, the session has diverged
+ * from the capture and every further transaction fails. There is no
+ * resynchronization, so sessions driven by timer polling or by GDB and
+ * telnet clients, whose requests depend on timing, can't be replayed. */
+
+static char *replay_file_name;
+static struct fileio *replay_fileio;
+static const uint8_t *replay_data;
+static size_t replay_size;
+static size_t replay_pos;
+static unsigned replay_count;
+static bool replay_diverged;
+
+static struct ra_msg replay_request;
+static struct ra_swd_batch replay_swd_batch;
+
+/* Match replay_request against the next request of the capture and
+ * return the reply recorded for it. */
+static int replay_next(int *status, const uint8_t **results, uint32_t *results_len)
+{
+	const uint8_t *reply;
+	uint32_t reply_len;
+	size_t left = replay_size - replay_pos;
+
+	ra_msg_end(&replay_request);
+	if (replay_request.error)
+		return ERROR_FAIL;
+	if (replay_diverged)
+		return ERROR_FAIL;
+
+	if (left == 0) {
+		LOG_ERROR("replay: the capture ends after %u transactions", replay_count);
+		replay_diverged = true;
+		return ERROR_FAIL;
+	}
+
+	if (left < replay_request.len ||
+			memcmp(replay_data + replay_pos, replay_request.data, replay_request.len) != 0) {
+		uint32_t offset = 0;
+		while (offset < replay_request.len && offset < left &&
+				replay_data[replay_pos + offset] == replay_request.data[offset])
+			offset++;
+		LOG_ERROR("replay: transaction %u differs from the capture at byte %" PRIu32
+				" of the request", replay_count, offset);
+		LOG_INFO("replay: only scripted sessions replay, not ones with "
+				"background polling or GDB and telnet clients");
+		replay_diverged = true;
+		return ERROR_FAIL;
+	}
+
+	/* the reply frame follows the request, with the same type and an
+	 * i32 status ahead of the results */
+	left -= replay_request.len;
+	reply = replay_data + replay_pos + replay_request.len;
+	if (left < RA_HEADER_SIZE + 4 || reply[4] != replay_request.data[4] ||
+			(reply_len = le_to_h_u32(reply)) < 4 || reply_len > left - RA_HEADER_SIZE) {
+		LOG_ERROR("replay: the capture is truncated or corrupt after %u transactions",
+				replay_count);
+		replay_diverged = true;
+		return ERROR_FAIL;
+	}
+
+	*status = (int32_t)le_to_h_u32(reply + RA_HEADER_SIZE);
+	*results = reply + RA_HEADER_SIZE + 4;
+	*results_len = reply_len - 4;
+
+	replay_pos += replay_request.len + RA_HEADER_SIZE + reply_len;
+	replay_count++;
+
+	return ERROR_OK;
+}
+
+static int replay_execute_queue(void)
+{
+	const uint8_t *results;
+	uint32_t len;
+	int status;
+
+	if (jtag_command_queue == NULL)
+		return ERROR_OK;
+
+	ra_msg_begin(&replay_request, RA_MSG_JTAG);
+	if (ra_msg_put_jtag_queue(&replay_request, jtag_command_queue) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (replay_next(&status, &results, &len) != ERROR_OK)
+		return ERROR_JTAG_QUEUE_FAILED;
+
+	if (ra_msg_get_jtag_results(jtag_command_queue, results, len) != ERROR_OK) {
+		LOG_ERROR("replay: recorded reply is too short");
+		return ERROR_JTAG_QUEUE_FAILED;
+	}
+
+	return status;
+}
+
+/* whatever speed is asked for, the capture is played back as fast as
+ * possible */
+static int replay_speed(int speed)
+{
+	return ERROR_OK;
+}
+
+static int replay_khz(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int replay_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+static int replay_swd_init(void)
+{
+	return ERROR_OK;
+}
+
+static int_least32_t replay_swd_frequency(int_least32_t hz)
+{
+	return hz;
+}
+
+static int replay_swd_switch_seq(enum swd_special_seq seq)
+{
+	ra_swd_batch_switch_seq(&replay_swd_batch, seq);
+	return ERROR_OK;
+}
+
+static void replay_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_hint)
+{
+	ra_swd_batch_read(&replay_swd_batch, cmd, value, ap_delay_hint);
+}
+
+static void replay_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay_hint)
+{
+	ra_swd_batch_write(&replay_swd_batch, cmd, value, ap_delay_hint);
+}
+
+static int replay_swd_run(void)
+{
+	const uint8_t *results;
+	uint32_t len;
+	int status;
+	int retval;
+
+	if (replay_swd_batch.msg.len == 0)
+		return ERROR_OK;
+
+	ra_msg_begin(&replay_request, RA_MSG_SWD);
+	ra_msg_put(&replay_request, replay_swd_batch.msg.data, replay_swd_batch.msg.len);
+	if (replay_swd_batch.msg.error)
+		replay_request.error = true;
+
+	retval = replay_next(&status, &results, &len);
+	if (retval == ERROR_OK) {
+		if (ra_swd_batch_get_results(&replay_swd_batch, results, len) != ERROR_OK) {
+			LOG_ERROR("replay: recorded reply is too short");
+			retval = ERROR_FAIL;
+		} else
+			retval = status;
+	}
+
+	ra_swd_batch_reset(&replay_swd_batch);
+	return retval;
+}
+
+static const struct swd_driver replay_swd = {
+	.init = replay_swd_init,
+	.frequency = replay_swd_frequency,
+	.switch_seq = replay_swd_switch_seq,
+	.read_reg = replay_swd_read_reg,
+	.write_reg = replay_swd_write_reg,
+	.run = replay_swd_run,
+};
+
+static int replay_init(void)
+{
+	int retval;
+
+	if (replay_file_name == NULL) {
+		LOG_ERROR("replay: no capture configured, use 'replay_file'");
+		return ERROR_FAIL;
+	}
+
+	/* compressed captures are unpacked by fileio */
+	retval = fileio_open(&replay_fileio, replay_file_name, FILEIO_READ, FILEIO_BINARY);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = fileio_map(replay_fileio, &replay_data, &replay_size);
+	if (retval != ERROR_OK)
+		goto fail;
+
+	if (replay_size < RA_CAPTURE_MAGIC_SIZE + 4 ||
+			memcmp(replay_data, RA_CAPTURE_MAGIC, RA_CAPTURE_MAGIC_SIZE) != 0) {
+		LOG_ERROR("replay: %s is not an adapter capture", replay_file_name);
+		retval = ERROR_FAIL;
+		goto fail;
+	}
+	if (le_to_h_u32(replay_data + RA_CAPTURE_MAGIC_SIZE) != RA_PROTOCOL_VERSION) {
+		LOG_ERROR("replay: %s was captured with protocol version %" PRIu32 ", not %d",
+				replay_file_name, le_to_h_u32(replay_data + RA_CAPTURE_MAGIC_SIZE),
+				RA_PROTOCOL_VERSION);
+		retval = ERROR_FAIL;
+		goto fail;
+	}
+
+	replay_pos = RA_CAPTURE_MAGIC_SIZE + 4;
+	replay_count = 0;
+	replay_diverged = false;
+
+	LOG_INFO("replay driver initialized, playing back %s", replay_file_name);
+	return ERROR_OK;
+
+fail:
+	fileio_close(replay_fileio);
+	replay_fileio = NULL;
+	return retval;
+}
+
+static int replay_quit(void)
+{
+	if (replay_fileio) {
+		if (!replay_diverged)
+			LOG_INFO("replay: %u transactions replayed, %zu bytes of the capture left",
+					replay_count, replay_size - replay_pos);
+		fileio_close(replay_fileio);
+		replay_fileio = NULL;
+	}
+
+	ra_msg_free(&replay_request);
+	ra_swd_batch_free(&replay_swd_batch);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(replay_handle_file_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(replay_file_name);
+	replay_file_name = strdup(CMD_ARGV[0]);
+	return ERROR_OK;
+}
+
+static const struct command_registration replay_command_handlers[] = {
+	{
+		.name = "replay_file",
+		.handler = replay_handle_file_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the capture written by 'adapter_capture' to play back.",
+		.usage = "filename",
+	},
+	COMMAND_REGISTRATION_DONE,
+};
+
+static const char * const replay_transports[] = { "jtag", "swd", NULL };
+
+struct jtag_interface replay_interface = {
+	.name = "replay",
+	.transports = replay_transports,
+	.swd = &replay_swd,
+	.execute_queue = &replay_execute_queue,
+	.speed = &replay_speed,
+	.khz = &replay_khz,
+	.speed_div = &replay_speed_div,
+	.commands = replay_command_handlers,
+	.init = &replay_init,
+	.quit = &replay_quit,
+};
@@ -102,6 +102,12 @@ extern struct jtag_interface buspirate_interface;
 #if BUILD_REMOTE_BITBANG == 1
 extern struct jtag_interface remote_bitbang_interface;
 #endif
+#if BUILD_REMOTE_ADAPTER == 1
+extern struct jtag_interface remote_adapter_interface;
+#endif
+#if BUILD_REPLAY == 1
+extern struct jtag_interface replay_interface;
+#endif
 #if BUILD_HLADAPTER == 1
 extern struct jtag_interface hl_interface;
 #endif
@@ -195,6 +201,12 @@ struct jtag_interface *jtag_interfaces[] = {
 #if BUILD_REMOTE_BITBANG == 1
 		&remote_bitbang_interface,
 #endif
+#if BUILD_REMOTE_ADAPTER == 1
+		&remote_adapter_interface,
+#endif
+#if BUILD_REPLAY == 1
+		&replay_interface,
+#endif
 #if BUILD_HLADAPTER == 1
 		&hl_interface,
 #endif
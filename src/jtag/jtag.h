@@ -251,6 +251,14 @@ int jtag_config_khz(unsigned khz);
  */
 int jtag_config_rclk(unsigned fallback_speed_khz);
 
+/**
+ * Search for the fastest speed between @a min_khz and @a max_khz at which
+ * the link passes its checks (BYPASS loopback on JTAG, DP IDCODE readback
+ * on SWD), then configure the interface a safety margin below it.
+ * The initial speed is restored if even @a min_khz fails.
+ */
+int jtag_config_khz_auto(unsigned min_khz, unsigned max_khz);
+
 /** Retreives the clock speed of the JTAG interface in KHz. */
 unsigned jtag_get_speed_khz(void);
 
@@ -0,0 +1,132 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_JTAG_REMOTE_ADAPTER_H
+#define OPENOCD_JTAG_REMOTE_ADAPTER_H
+
+#include <jtag/swd.h>
+
+/*
+ * Protocol between the remote_adapter driver and 'adapter_serve', all
+ * integers little endian.
+ *
+ * Every message is a frame: u32 payload length, u8 message type, then
+ * the payload. The server answers every request with a frame of the same
+ * type whose payload starts with an i32 OpenOCD error code, followed by
+ * the results.
+ *
+ * RA_MSG_JTAG carries a whole flushed jtag_command_queue, one command
+ * after the other, each a u8 enum jtag_command_type followed by:
+ *
+ *	JTAG_SCAN		u8 ir_scan, u8 end_state, u32 num_fields, then per
+ *				field u32 num_bits, u8 RA_FIELD_* flags and, with
+ *				RA_FIELD_OUT, the out bits
+ *	JTAG_TLR_RESET		u8 end_state
+ *	JTAG_RUNTEST		u32 num_cycles, u8 end_state
+ *	JTAG_RESET		u8 trst, u8 srst (0xff: no change)
+ *	JTAG_PATHMOVE		u32 num_states, u8 state each
+ *	JTAG_SLEEP		u32 us
+ *	JTAG_STABLECLOCKS	u32 num_cycles
+ *	JTAG_TMS		u32 num_bits, bits
+ *
+ * The reply holds the captured bits of every RA_FIELD_IN field in queue
+ * order, each padded to whole bytes.
+ *
+ * RA_MSG_SWD carries the SWD transactions queued up to swd_driver.run(),
+ * each a u8 RA_SWD_* opcode followed by its arguments. The status of the
+ * reply is what run() returned on the server, followed by a u32 for every
+ * read in queue order.
+ */
+#define RA_PROTOCOL_VERSION	1
+#define RA_HEADER_SIZE		5
+#define RA_FRAME_MAX		(64*1024*1024)
+
+enum ra_msg_type {
+	RA_MSG_HELLO = 0x01,	/* u32 version -> status, u32 version */
+	RA_MSG_SPEED = 0x02,	/* u32 khz -> status */
+	RA_MSG_JTAG = 0x03,	/* commands -> status, captured bits */
+	RA_MSG_SWD = 0x04,	/* transactions -> status, read values */
+};
+
+#define RA_FIELD_OUT		0x01
+#define RA_FIELD_IN		0x02
+
+enum ra_swd_op {
+	RA_SWD_SWITCH_SEQ = 0x01,	/* u8 enum swd_special_seq */
+	RA_SWD_READ = 0x02,		/* u8 cmd, u32 ap_delay_hint */
+	RA_SWD_WRITE = 0x03,		/* u8 cmd, u32 value, u32 ap_delay_hint */
+};
+
+/*
+ * 'adapter_capture' files start with RA_CAPTURE_MAGIC and a u32
+ * RA_PROTOCOL_VERSION, followed by every RA_MSG_JTAG and RA_MSG_SWD
+ * request frame the adapter executed, each directly followed by the
+ * reply frame the server would have sent for it.
+ */
+#define RA_CAPTURE_MAGIC	"OCDRACAP"
+#define RA_CAPTURE_MAGIC_SIZE	8
+
+/* A message being built, the append helpers only note a failure */
+struct ra_msg {
+	uint8_t *data;
+	uint32_t size;
+	uint32_t len;
+	bool error;
+};
+
+/* SWD transactions queued since the last swd_driver.run() */
+struct ra_swd_batch {
+	struct ra_msg msg;		/* the transactions, without a header */
+	uint32_t **reads;		/* destination of every read */
+	unsigned read_count;
+	unsigned read_size;
+};
+
+struct jtag_command;
+
+int ra_msg_reserve(struct ra_msg *msg, uint32_t len);
+void ra_msg_put(struct ra_msg *msg, const void *data, uint32_t len);
+void ra_msg_put_u8(struct ra_msg *msg, uint8_t val);
+void ra_msg_put_u32(struct ra_msg *msg, uint32_t val);
+void ra_msg_begin(struct ra_msg *msg, enum ra_msg_type type);
+void ra_msg_end(struct ra_msg *msg);
+void ra_msg_free(struct ra_msg *msg);
+
+int ra_msg_put_jtag_queue(struct ra_msg *msg, struct jtag_command *queue);
+void ra_msg_put_jtag_results(struct ra_msg *msg, struct jtag_command *queue);
+int ra_msg_get_jtag_results(struct jtag_command *queue, const uint8_t *data, uint32_t len);
+
+void ra_swd_batch_switch_seq(struct ra_swd_batch *batch, enum swd_special_seq seq);
+void ra_swd_batch_read(struct ra_swd_batch *batch, uint8_t cmd, uint32_t *value,
+		uint32_t ap_delay_hint);
+void ra_swd_batch_write(struct ra_swd_batch *batch, uint8_t cmd, uint32_t value,
+		uint32_t ap_delay_hint);
+void ra_swd_batch_put_results(struct ra_msg *msg, struct ra_swd_batch *batch);
+int ra_swd_batch_get_results(struct ra_swd_batch *batch, const uint8_t *data, uint32_t len);
+void ra_swd_batch_reset(struct ra_swd_batch *batch);
+void ra_swd_batch_free(struct ra_swd_batch *batch);
+
+struct command_context;
+
+int adapter_serve_register_commands(struct command_context *cmd_ctx);
+int adapter_capture_register_commands(struct command_context *cmd_ctx);
+
+/* Set while 'adapter_capture' records, see adapter_capture_jtag() */
+extern bool adapter_capture_active;
+
+void adapter_capture_jtag(struct jtag_command *queue, int retval);
+void adapter_capture_stop(void);
+
+#endif /* OPENOCD_JTAG_REMOTE_ADAPTER_H */
@@ -33,6 +33,8 @@
 #include <helper/ioutil.h>
 #include <helper/util.h>
 #include <helper/configuration.h>
+#include <helper/metrics.h>
+#include <helper/timeline.h>
 #include <flash/nor/core.h>
 #include <flash/nand/core.h>
 #include <pld/pld.h>
@@ -245,6 +247,8 @@ struct command_context *setup_command_handler(Jim_Interp *interp)
 		&server_register_commands,
 		&gdb_register_commands,
 		&log_register_commands,
+		&metrics_register_commands,
+		&timeline_register_commands,
 		&transport_register_commands,
 		&interface_register_commands,
 		&target_register_commands,
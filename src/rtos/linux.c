@@ -27,6 +27,7 @@
 #include "target/target_type.h"
 #include "helper/log.h"
 #include "helper/types.h"
+#include "helper/binarybuffer.h"
 #include "rtos.h"
 #include "rtos_standard_stackings.h"
 #include <target/register.h>
@@ -36,6 +37,11 @@
 #include "linux_header.h"
 #define PHYS
 #define MAX_THREADS 200
+/*  task_struct bytes fetched in one access when a task is first seen;
+ *  covers every field used by fill_task(), get_name() and next_task() */
+#define TASK_WINDOW_SIZE (MAX(MAX(MAX(NEXT, MEM), MAX(ONCPU, PID)), COMM) + 16)
+/*  thread_info bytes holding preempt_count and the saved cpu_context */
+#define THREAD_INFO_WINDOW_SIZE (MAX(PREEMPT + 4, CPU_CONT + 10 * 4))
 /*  specific task  */
 struct linux_os {
 	const char *name;
@@ -51,6 +57,12 @@ struct linux_os {
 	/*  virt2phys parameter */
 	uint32_t phys_mask;
 	uint32_t phys_base;
+	/*  end of the kernel linear map, from high_memory; 0 if unknown */
+	uint32_t lowmem_end;
+	/*  last task_struct window read, valid until the target resumes */
+	uint32_t task_window_addr;
+	bool task_window_valid;
+	uint8_t task_window[TASK_WINDOW_SIZE];
 };
 
 struct current_thread {
@@ -105,7 +117,8 @@ static int linux_os_dummy_update(struct rtos *rtos)
 	return 0;
 }
 
-static int linux_compute_virt2phys(struct target *target, uint32_t address)
+static int linux_compute_virt2phys(struct target *target, uint32_t address,
+	uint32_t high_memory_addr)
 {
 	struct linux_os *linux_os = (struct linux_os *)
 		target->rtos->rtos_specific_params;
@@ -115,12 +128,21 @@ static int linux_compute_virt2phys(struct target *target, uint32_t address)
 		LOG_ERROR("Cannot compute linux virt2phys translation");
 		/*  fixes default address  */
 		linux_os->phys_base = 0;
+		linux_os->lowmem_end = 0;
 		return ERROR_FAIL;
 	}
 
 	linux_os->init_task_addr = address;
 	address = address & linux_os->phys_mask;
 	linux_os->phys_base = pa - address;
+
+	/*  vmalloc, modules and per-cpu areas lie outside the linear map,
+	 *  which ends where high_memory points */
+	linux_os->lowmem_end = 0;
+	if (high_memory_addr != 0 &&
+			target_read_u32(target, high_memory_addr, &linux_os->lowmem_end) != ERROR_OK)
+		linux_os->lowmem_end = 0;
+
 	return ERROR_OK;
 }
 
@@ -138,10 +160,42 @@ static int linux_read_memory(struct target *target,
 		return ERROR_FAIL;
 	}
 #ifdef PHYS
-	target_read_phys_memory(target, pa, size, count, buffer);
+	/*  kernel linear map: the translation computed once from init_task
+	 *  holds for every lowmem address, so no page table walk is needed */
+	if (address >= ~linux_os->phys_mask && address < linux_os->lowmem_end &&
+			size * count <= linux_os->lowmem_end - address)
+		return target_read_phys_memory(target, pa, size, count, buffer);
 #endif
-	target_read_memory(target, address, size, count, buffer);
-	return ERROR_OK;
+	return target_read_memory(target, address, size, count, buffer);
+}
+
+static void linux_invalidate_task_window(struct linux_os *linux_os)
+{
+	linux_os->task_window_valid = false;
+}
+
+/*  return the task_struct window starting at base_addr, reading it in
+ *  a single bulk access if it is not the one already cached */
+static const uint8_t *linux_task_window(struct target *target, uint32_t base_addr)
+{
+	struct linux_os *linux_os = (struct linux_os *)
+		target->rtos->rtos_specific_params;
+
+	if (linux_os->task_window_valid && linux_os->task_window_addr == base_addr)
+		return linux_os->task_window;
+
+	linux_os->task_window_valid = false;
+
+	if ((base_addr & 0x3) != 0)
+		LOG_INFO("unaligned address %" PRIx32 "!!", base_addr);
+
+	if (linux_read_memory(target, base_addr, 4, TASK_WINDOW_SIZE / 4,
+			linux_os->task_window) != ERROR_OK)
+		return NULL;
+
+	linux_os->task_window_addr = base_addr;
+	linux_os->task_window_valid = true;
+	return linux_os->task_window;
 }
 
 static char *reg_converter(char *buffer, void *reg, int size)
@@ -149,7 +203,8 @@ static char *reg_converter(char *buffer, void *reg, int size)
 	int i;
 
 	for (i = 0; i < size; i++)
-		buffer += sprintf(buffer, "%02x", ((uint8_t *) reg)[i]);
+		buffer = hexify_byte(buffer, ((uint8_t *) reg)[i]);
+	*buffer = 0;
 
 	return buffer;
 }
@@ -318,8 +373,10 @@ static int linux_os_detect(struct target *target)
 static int linux_os_smp_init(struct target *target);
 static int linux_os_clean(struct target *target);
 #define INIT_TASK 0
+#define HIGH_MEMORY 1
 static const char * const linux_symbol_list[] = {
 	"init_task",
+	"high_memory",
 	NULL
 };
 
@@ -332,6 +389,9 @@ static int linux_get_symbol_list_to_lookup(symbol_table_elem_t *symbol_list[])
 	for (i = 0; i < ARRAY_SIZE(linux_symbol_list); i++)
 		(*symbol_list)[i].symbol_name = linux_symbol_list[i];
 
+	/*  without it every access goes through the MMU */
+	(*symbol_list)[HIGH_MEMORY].optional = true;
+
 	return 0;
 }
 
@@ -373,53 +433,34 @@ int fill_task_pid(struct target *target, struct threads *t)
 int fill_task(struct target *target, struct threads *t)
 {
 	int retval;
-	uint32_t pid_addr = t->base_addr + PID;
-	uint32_t mem_addr = t->base_addr + MEM;
-	uint32_t on_cpu = t->base_addr + ONCPU;
+	const uint8_t *window = linux_task_window(target, t->base_addr);
 	uint8_t *buffer = calloc(1, 4);
-	retval = fill_buffer(target, t->base_addr, buffer);
 
-	if (retval == ERROR_OK) {
-		uint32_t val = get_buffer(target, buffer);
-		t->state = val;
-	} else
+	if (window == NULL) {
 		LOG_ERROR("fill_task: unable to read memory");
+		free(buffer);
+		return ERROR_FAIL;
+	}
 
-	retval = fill_buffer(target, pid_addr, buffer);
-
-	if (retval == ERROR_OK) {
-		uint32_t val = get_buffer(target, buffer);
-		t->pid = val;
-	} else
-		LOG_ERROR("fill task: unable to read memory");
-
-	retval = fill_buffer(target, on_cpu, buffer);
-
-	if (retval == ERROR_OK) {
-		uint32_t val = get_buffer(target, buffer);
-		t->oncpu = val;
-	} else
-		LOG_ERROR("fill task: unable to read memory");
-
-	retval = fill_buffer(target, mem_addr, buffer);
+	t->state = get_buffer(target, window);
+	t->pid = get_buffer(target, window + PID);
+	t->oncpu = get_buffer(target, window + ONCPU);
 
-	if (retval == ERROR_OK) {
-		uint32_t val = get_buffer(target, buffer);
+	uint32_t val = get_buffer(target, window + MEM);
+	retval = ERROR_OK;
 
-		if (val != 0) {
-			uint32_t asid_addr = val + MM_CTX;
-			retval = fill_buffer(target, asid_addr, buffer);
+	if (val != 0) {
+		uint32_t asid_addr = val + MM_CTX;
+		retval = fill_buffer(target, asid_addr, buffer);
 
-			if (retval == ERROR_OK) {
-				val = get_buffer(target, buffer);
-				t->asid = val;
-			} else
-				LOG_ERROR
-					("fill task: unable to read memory -- ASID");
+		if (retval == ERROR_OK) {
+			val = get_buffer(target, buffer);
+			t->asid = val;
 		} else
-			t->asid = 0;
+			LOG_ERROR
+				("fill task: unable to read memory -- ASID");
 	} else
-		LOG_ERROR("fill task: unable to read memory");
+		t->asid = 0;
 
 	free(buffer);
 
@@ -428,21 +469,20 @@ int fill_task(struct target *target, struct threads *t)
 
 int get_name(struct target *target, struct threads *t)
 {
-	int retval;
 	uint32_t full_name[4];
-	uint32_t comm = t->base_addr + COMM;
+	const uint8_t *window = linux_task_window(target, t->base_addr);
 	int i;
 
 	for (i = 0; i < 17; i++)
 		t->name[i] = 0;
 
-	retval = linux_read_memory(target, comm, 4, 4, (uint8_t *) full_name);
-
-	if (retval != ERROR_OK) {
+	if (window == NULL) {
 		LOG_ERROR("get_name: unable to read memory\n");
 		return ERROR_FAIL;
 	}
 
+	memcpy(full_name, window + COMM, sizeof(full_name));
+
 	uint32_t raw_name = target_buffer_get_u32(target,
 			(const uint8_t *)
 			&full_name[0]);
@@ -563,8 +603,10 @@ int get_current(struct target *target, int create)
 struct cpu_context *cpu_context_read(struct target *target, uint32_t base_addr,
 	uint32_t *thread_info_addr_old)
 {
+	struct linux_os *linux_os = (struct linux_os *)
+		target->rtos->rtos_specific_params;
 	struct cpu_context *context = calloc(1, sizeof(struct cpu_context));
-	uint32_t preempt_count_addr = 0;
+	uint8_t thread_info[THREAD_INFO_WINDOW_SIZE];
 	uint32_t registers[10];
 	uint8_t *buffer = calloc(1, 4);
 	uint32_t stack = base_addr + QAT;
@@ -584,22 +626,29 @@ struct cpu_context *cpu_context_read(struct target *target, uint32_t base_addr,
 retry:
 
 	if (*thread_info_addr_old == 0xdeadbeef) {
-		retval = fill_buffer(target, stack, buffer);
+		if (linux_os->task_window_valid &&
+				linux_os->task_window_addr == base_addr) {
+			thread_info_addr = get_buffer(target,
+					linux_os->task_window + QAT);
+		} else {
+			retval = fill_buffer(target, stack, buffer);
 
-		if (retval == ERROR_OK)
-			thread_info_addr = get_buffer(target, buffer);
-		else
-			LOG_ERROR("cpu_context: unable to read memory");
+			if (retval == ERROR_OK)
+				thread_info_addr = get_buffer(target, buffer);
+			else
+				LOG_ERROR("cpu_context: unable to read memory");
+		}
 
 		thread_info_addr_update = thread_info_addr;
 	} else
 		thread_info_addr = *thread_info_addr_old;
 
-	preempt_count_addr = thread_info_addr + PREEMPT;
-	retval = fill_buffer(target, preempt_count_addr, buffer);
+	/*  preempt_count and cpu_context are read in a single access */
+	retval = linux_read_memory(target, thread_info_addr, 4,
+			THREAD_INFO_WINDOW_SIZE / 4, thread_info);
 
 	if (retval == ERROR_OK)
-		context->preempt_count = get_buffer(target, buffer);
+		context->preempt_count = get_buffer(target, thread_info + PREEMPT);
 	else {
 		if (*thread_info_addr_old != 0xdeadbeef) {
 			LOG_ERROR
@@ -613,20 +662,13 @@ retry:
 			goto retry;
 		}
 
-		LOG_ERROR("cpu_context: unable to read memory");
-	}
-
-	thread_info_addr += CPU_CONT;
-
-	retval = linux_read_memory(target, thread_info_addr, 4, 10,
-			(uint8_t *) registers);
-
-	if (retval != ERROR_OK) {
 		free(buffer);
 		LOG_ERROR("cpu_context: unable to read memory\n");
 		return context;
 	}
 
+	memcpy(registers, thread_info + CPU_CONT, sizeof(registers));
+
 	context->R4 =
 		target_buffer_get_u32(target, (const uint8_t *)&registers[0]);
 	context->R5 =
@@ -658,6 +700,14 @@ retry:
 
 uint32_t next_task(struct target *target, struct threads *t)
 {
+	struct linux_os *linux_os = (struct linux_os *)
+		target->rtos->rtos_specific_params;
+
+	/*  a freshly filled task still has its window cached */
+	if (linux_os->task_window_valid &&
+			linux_os->task_window_addr == t->base_addr)
+		return get_buffer(target, linux_os->task_window + NEXT) - NEXT;
+
 	uint8_t *buffer = calloc(1, 4);
 	uint32_t next_addr = t->base_addr + NEXT;
 	int retval = fill_buffer(target, next_addr, buffer);
@@ -769,6 +819,7 @@ int linux_get_tasks(struct target *target, int context)
 		target->rtos->rtos_specific_params;
 	linux_os->thread_list = NULL;
 	linux_os->thread_count = 0;
+	linux_invalidate_task_window(linux_os);
 
 	if (linux_os->init_task_addr == 0xdeadbeef) {
 		LOG_INFO("no init symbol\n");
@@ -871,6 +922,7 @@ static int linux_os_clean(struct target *target)
 	struct linux_os *os_linux = (struct linux_os *)
 		target->rtos->rtos_specific_params;
 	clean_threadlist(target);
+	linux_invalidate_task_window(os_linux);
 	os_linux->init_task_addr = 0xdeadbeef;
 	os_linux->name = "linux";
 	os_linux->thread_list = NULL;
@@ -1001,6 +1053,7 @@ static int linux_task_update(struct target *target, int context)
 	int retval;
 	int loop = 0;
 	linux_os->thread_count = 0;
+	linux_invalidate_task_window(linux_os);
 
 	/*thread_list = thread_list->next; skip init_task*/
 	while (thread_list != NULL) {
@@ -1400,6 +1453,9 @@ static int linux_thread_packet(struct connection *connection, char const *packet
 					linux_compute_virt2phys(target,
 							target->rtos->
 							symbols[INIT_TASK].
+							address,
+							target->rtos->
+							symbols[HIGH_MEMORY].
 							address);
 				}
 
@@ -1462,6 +1518,9 @@ static int linux_thread_packet(struct connection *connection, char const *packet
 				LOG_INFO("threads_needs_update = 1");
 				linux_os->threads_needs_update = 1;
 			}
+
+			/*  task_struct contents change while running */
+			linux_invalidate_task_window(linux_os);
 		}
 
 		/* if a packet handler returned an error, exit input loop */
@@ -57,6 +57,23 @@ int rtos_smp_init(struct target *target)
 	return ERROR_TARGET_INIT_FAILED;
 }
 
+static int rtos_target_event_handler(struct target *target,
+		enum target_event event, void *priv)
+{
+	struct rtos *os = priv;
+
+	switch (event) {
+	case TARGET_EVENT_RESUMED:
+	case TARGET_EVENT_RESET_ASSERT:
+		rtos_invalidate_reg_snapshots(os);
+		break;
+	default:
+		break;
+	}
+
+	return ERROR_OK;
+}
+
 static int os_alloc(struct target *target, struct rtos_type *ostype)
 {
 	struct rtos *os = target->rtos = calloc(1, sizeof(struct rtos));
@@ -73,6 +90,8 @@ static int os_alloc(struct target *target, struct rtos_type *ostype)
 	/* RTOS drivers can override the packet handler in _create(). */
 	os->gdb_thread_packet = rtos_thread_packet;
 
+	target_register_event_callback(rtos_target_event_handler, os);
+
 	return JIM_OK;
 }
 
@@ -81,6 +100,9 @@ static void os_free(struct target *target)
 	if (!target->rtos)
 		return;
 
+	target_unregister_event_callback(rtos_target_event_handler, target->rtos);
+	rtos_invalidate_reg_snapshots(target->rtos);
+
 	if (target->rtos->symbols)
 		free(target->rtos->symbols);
 
@@ -421,6 +443,53 @@ int rtos_thread_packet(struct connection *connection, char const *packet, int pa
 	return GDB_THREAD_PACKET_NOT_CONSUMED;
 }
 
+static struct rtos_reg_snapshot *rtos_find_reg_snapshot(struct rtos *rtos,
+		threadid_t threadid)
+{
+	int i;
+
+	for (i = 0; i < rtos->reg_snapshot_count; i++) {
+		if (rtos->reg_snapshots[i].threadid == threadid)
+			return &rtos->reg_snapshots[i];
+	}
+	return NULL;
+}
+
+static void rtos_add_reg_snapshot(struct rtos *rtos, threadid_t threadid,
+		char *hex_reg_list)
+{
+	struct rtos_reg_snapshot *snapshots;
+
+	snapshots = realloc(rtos->reg_snapshots,
+			(rtos->reg_snapshot_count + 1) * sizeof(struct rtos_reg_snapshot));
+	if (snapshots == NULL) {
+		/* not fatal, the list is simply not cached */
+		free(hex_reg_list);
+		return;
+	}
+
+	snapshots[rtos->reg_snapshot_count].threadid = threadid;
+	snapshots[rtos->reg_snapshot_count].hex_reg_list = hex_reg_list;
+	rtos->reg_snapshots = snapshots;
+	rtos->reg_snapshot_count++;
+}
+
+/**
+ * Drop all cached thread register lists. Must be called whenever the
+ * stacked register values may have changed, i.e. when the target resumes
+ * or the thread list is rebuilt.
+ */
+void rtos_invalidate_reg_snapshots(struct rtos *rtos)
+{
+	int i;
+
+	for (i = 0; i < rtos->reg_snapshot_count; i++)
+		free(rtos->reg_snapshots[i].hex_reg_list);
+	free(rtos->reg_snapshots);
+	rtos->reg_snapshots = NULL;
+	rtos->reg_snapshot_count = 0;
+}
+
 int rtos_get_gdb_reg_list(struct connection *connection)
 {
 	struct target *target = get_target_from_connection(connection);
@@ -430,6 +499,14 @@ int rtos_get_gdb_reg_list(struct connection *connection)
 			((current_threadid != target->rtos->current_thread) ||
 			(target->smp))) {	/* in smp several current thread are possible */
 		char *hex_reg_list;
+		struct rtos_reg_snapshot *snapshot;
+
+		snapshot = rtos_find_reg_snapshot(target->rtos, current_threadid);
+		if (snapshot != NULL) {
+			gdb_put_packet(connection, snapshot->hex_reg_list,
+					strlen(snapshot->hex_reg_list));
+			return ERROR_OK;
+		}
 
 		LOG_DEBUG("RTOS: getting register list for thread 0x%" PRIx64
 				  ", target->rtos->current_thread=0x%" PRIx64 "\r\n",
@@ -446,7 +523,8 @@ int rtos_get_gdb_reg_list(struct connection *connection)
 
 		if (hex_reg_list != NULL) {
 			gdb_put_packet(connection, hex_reg_list, strlen(hex_reg_list));
-			free(hex_reg_list);
+			/* the snapshot list takes ownership of the string */
+			rtos_add_reg_snapshot(target->rtos, current_threadid, hex_reg_list);
 			return ERROR_OK;
 		}
 	}
@@ -500,18 +578,23 @@ int rtos_generic_stack_read(struct target *target,
 			stacking->stack_registers_size;
 	}
 	for (i = 0; i < stacking->num_output_registers; i++) {
+		int width = stacking->register_offsets[i].width_bits/8;
+		int offset = stacking->register_offsets[i].offset;
 		int j;
-		for (j = 0; j < stacking->register_offsets[i].width_bits/8; j++) {
-			if (stacking->register_offsets[i].offset == -1)
-				tmp_str_ptr += sprintf(tmp_str_ptr, "%02x", 0);
-			else if (stacking->register_offsets[i].offset == -2)
-				tmp_str_ptr += sprintf(tmp_str_ptr, "%02x",
+
+		if (offset == -1) {
+			memset(tmp_str_ptr, '0', width * 2);
+			tmp_str_ptr += width * 2;
+		} else if (offset == -2) {
+			for (j = 0; j < width; j++)
+				tmp_str_ptr = hexify_byte(tmp_str_ptr,
 						((uint8_t *)&new_stack_ptr)[j]);
-			else
-				tmp_str_ptr += sprintf(tmp_str_ptr, "%02x",
-						stack_data[stacking->register_offsets[i].offset + j]);
+		} else {
+			for (j = 0; j < width; j++)
+				tmp_str_ptr = hexify_byte(tmp_str_ptr, stack_data[offset + j]);
 		}
 	}
+	*tmp_str_ptr = 0;
 	free(stack_data);
 /*	LOG_OUTPUT("Output register string: %s\r\n", *hex_reg_list); */
 	return ERROR_OK;
@@ -532,6 +615,7 @@ int rtos_try_next(struct target *target)
 		return 0;
 
 	os->type = *type;
+	rtos_invalidate_reg_snapshots(os);
 	if (os->symbols) {
 		free(os->symbols);
 		os->symbols = NULL;
@@ -542,8 +626,10 @@ int rtos_try_next(struct target *target)
 
 int rtos_update_threads(struct target *target)
 {
-	if ((target->rtos != NULL) && (target->rtos->type != NULL))
+	if ((target->rtos != NULL) && (target->rtos->type != NULL)) {
+		rtos_invalidate_reg_snapshots(target->rtos);
 		target->rtos->type->update_threads(target->rtos);
+	}
 	return ERROR_OK;
 }
 
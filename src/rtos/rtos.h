@@ -43,6 +43,16 @@ struct thread_detail {
 	char *extra_info_str;
 };
 
+/**
+ * Hex encoded GDB register list of a thread, kept while the target stays
+ * halted so that repeated 'g' packets for the same thread (thread switching,
+ * "info threads", backtraces) do not re-read and re-encode the stack frame.
+ */
+struct rtos_reg_snapshot {
+	threadid_t threadid;
+	char *hex_reg_list;
+};
+
 struct rtos {
 	const struct rtos_type *type;
 
@@ -55,6 +65,9 @@ struct rtos {
 	int thread_count;
 	int (*gdb_thread_packet)(struct connection *connection, char const *packet, int packet_size);
 	void *rtos_specific_params;
+	/* register list snapshots, invalidated on resume and thread list update */
+	struct rtos_reg_snapshot *reg_snapshots;
+	int reg_snapshot_count;
 };
 
 struct rtos_type {
@@ -104,6 +117,7 @@ int gdb_thread_packet(struct connection *connection, char const *packet, int pac
 int rtos_get_gdb_reg_list(struct connection *connection);
 int rtos_update_threads(struct target *target);
 void rtos_free_threadlist(struct rtos *rtos);
+void rtos_invalidate_reg_snapshots(struct rtos *rtos);
 int rtos_smp_init(struct target *target);
 /*  function for handling symbol access */
 int rtos_qsymbol(struct connection *connection, char const *packet, int packet_size);
@@ -39,6 +39,7 @@
 #endif
 
 #include <target/breakpoints.h>
+#include <target/agent_expr.h>
 #include <target/target_request.h>
 #include <target/register.h>
 #include "server.h"
@@ -46,6 +47,8 @@
 #include "gdb_server.h"
 #include <target/image.h>
 #include <jtag/jtag.h>
+#include <helper/metrics.h>
+#include <helper/timeline.h>
 #include "rtos/rtos.h"
 #include "target/smp.h"
 
@@ -70,7 +73,10 @@ struct gdb_connection {
 	int buf_cnt;
 	int ctrl_c;
 	enum target_state frontend_state;
-	struct image *vflash_image;
+	/* flash download in progress, fed by vFlashWrite packets */
+	struct flash_write_stream *vflash_stream;
+	/* programming error to report on the next vFlash packet */
+	int vflash_error;
 	int closed;
 	int busy;
 	int noack_mode;
@@ -88,6 +94,12 @@ struct gdb_connection {
 	 * normally we reply with a S reply via gdb_last_signal_packet.
 	 * as a side note this behaviour only effects gdb > 6.8 */
 	bool attached;
+	/* GDB read our target description and numbers registers by their
+	 * regnum there, not by their position in the 'g' packet */
+	bool target_desc_read;
+	/* halted on a breakpoint whose conditions are false; resumed from a
+	 * timer once the halted event has been dispatched to everybody */
+	bool resume_pending;
 	/* temporarily used for target description support */
 	struct target_desc_format target_desc;
 	/* temporarily used for thread list support */
@@ -712,10 +724,65 @@ static int gdb_output(struct command_context *context, const char *line)
 	return ERROR_OK;
 }
 
+static void gdb_str_to_target(struct target *target,
+		char *tstr, struct reg *reg);
+
+/**
+ * Append "nn:value;" pairs to a stop reply for every general register whose
+ * value is already cached from debug entry, so GDB does not have to follow
+ * the stop reply with a 'g' packet. Registers that are not cached are left
+ * for GDB to fetch on demand, so this never causes target accesses.
+ *
+ * Registers are numbered the way GDB does: by the regnum of the target
+ * description GDB read, otherwise by their position in the 'g' packet,
+ * where e.g. the Cortex-M xPSR follows the legacy FPA registers.
+ *
+ * @returns The number of characters appended, which never exceeds
+ * @a max_len - 1.
+ */
+static int gdb_expedite_registers(struct target *target, bool target_desc_read,
+		char *buf, int max_len)
+{
+	struct reg **reg_list;
+	int reg_list_size;
+	int len = 0;
+	int i;
+
+	/* with SMP the reported thread may live on another core */
+	if (target->smp)
+		return 0;
+
+	if (target_get_gdb_reg_list(target, &reg_list, &reg_list_size,
+			REG_CLASS_GENERAL) != ERROR_OK)
+		return 0;
+
+	for (i = 0; i < reg_list_size; i++) {
+		struct reg *reg = reg_list[i];
+		int value_len = DIV_ROUND_UP(reg->size, 8) * 2;
+		uint32_t regnum = target_desc_read ? reg->number : (uint32_t)i;
+
+		if (!reg->exist || !reg->valid || reg->size == 0 || reg->size > 64)
+			continue;
+
+		/* "nnnnnnnn:" + value + ";" and the terminating null */
+		if (len + 9 + value_len + 1 + 1 > max_len)
+			break;
+
+		len += snprintf(buf + len, max_len - len, "%02" PRIx32 ":", regnum);
+		gdb_str_to_target(target, buf + len, reg);
+		len += value_len;
+		buf[len++] = ';';
+		buf[len] = 0;
+	}
+
+	free(reg_list);
+	return len;
+}
+
 static void gdb_signal_reply(struct target *target, struct connection *connection)
 {
 	struct gdb_connection *gdb_connection = connection->priv;
-	char sig_reply[45];
+	char sig_reply[1024];
 	char stop_reason[20];
 	char current_thread[25];
 	int sig_reply_len;
@@ -766,6 +833,10 @@ static void gdb_signal_reply(struct target *target, struct connection *connectio
 
 		sig_reply_len = snprintf(sig_reply, sizeof(sig_reply), "T%2.2x%s%s",
 				signal_var, stop_reason, current_thread);
+
+		sig_reply_len += gdb_expedite_registers(target,
+				gdb_connection->target_desc_read, sig_reply + sig_reply_len,
+				sizeof(sig_reply) - sig_reply_len);
 	}
 
 	gdb_put_packet(connection, sig_reply, sig_reply_len);
@@ -860,6 +931,88 @@ static void gdb_fileio_reply(struct target *target, struct connection *connectio
 	}
 }
 
+/* Read the PC from the register cache, for range stepping and
+ * breakpoint conditions */
+static int gdb_read_pc(struct target *target, uint32_t *pc)
+{
+	struct reg *reg = register_get_by_name(target->reg_cache, "pc", 1);
+	if (reg == NULL)
+		return ERROR_FAIL;
+
+	if (!reg->valid) {
+		int retval = reg->type->get(reg);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	*pc = buf_get_u32(reg->value, 0, 32);
+	return ERROR_OK;
+}
+
+/**
+ * Returns true if the target halted on a breakpoint whose conditions,
+ * evaluated here rather than by GDB, are all false, so that the stop
+ * should not be reported.
+ */
+static bool gdb_breakpoint_condition_false(struct target *target)
+{
+	struct breakpoint *breakpoint;
+	uint32_t pc;
+
+	if (target->debug_reason != DBG_REASON_BREAKPOINT
+			|| gdb_read_pc(target, &pc) != ERROR_OK)
+		return false;
+
+	breakpoint = breakpoint_find(target, pc);
+	return breakpoint != NULL && breakpoint->cond != NULL
+		&& !agent_expr_list_true(target, breakpoint->cond);
+}
+
+static void gdb_report_halt(struct target *target, struct connection *connection)
+{
+	/* stop forwarding log packets! */
+	log_remove_callback(gdb_log_callback, connection);
+
+	/* check fileio first */
+	if (target_get_gdb_fileio_info(target, target->fileio_info) == ERROR_OK)
+		gdb_fileio_reply(target, connection);
+	else
+		gdb_signal_reply(target, connection);
+}
+
+/* Resuming from within the halted event would leave the remaining event
+ * callbacks and Tcl handlers with a running target, so it waits for the
+ * next round of timer callbacks. */
+static int gdb_resume_skipped_breakpoint(void *priv)
+{
+	struct connection *connection = priv;
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+
+	if (!gdb_connection->resume_pending)
+		return ERROR_OK;
+	gdb_connection->resume_pending = false;
+
+	/* a halted event handler may have taken over the target */
+	if (gdb_connection->frontend_state != TARGET_RUNNING
+			|| target->state != TARGET_HALTED)
+		return ERROR_OK;
+
+	/* step over the breakpoint we are sitting on */
+	if (target_resume(target, 1, 0x0, 1, 0) != ERROR_OK)
+		gdb_report_halt(target, connection);
+	return ERROR_OK;
+}
+
+static void gdb_cancel_resume(struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	if (gdb_connection->resume_pending) {
+		gdb_connection->resume_pending = false;
+		target_unregister_timer_callback(gdb_resume_skipped_breakpoint, connection);
+	}
+}
+
 static void gdb_frontend_halted(struct target *target, struct connection *connection)
 {
 	struct gdb_connection *gdb_connection = connection->priv;
@@ -874,14 +1027,17 @@ static void gdb_frontend_halted(struct target *target, struct connection *connec
 	 * that are to be ignored.
 	 */
 	if (gdb_connection->frontend_state == TARGET_RUNNING) {
-		/* stop forwarding log packets! */
-		log_remove_callback(gdb_log_callback, connection);
+		/* another halt notification while a resume is pending, e.g.
+		 * for a Ctrl-C, reports the stop after all */
+		if (gdb_connection->resume_pending) {
+			gdb_cancel_resume(connection);
+		} else if (gdb_breakpoint_condition_false(target)) {
+			gdb_connection->resume_pending = true;
+			target_register_timer_callback(gdb_resume_skipped_breakpoint, 0, 0, connection);
+			return;
+		}
 
-		/* check fileio first */
-		if (target_get_gdb_fileio_info(target, target->fileio_info) == ERROR_OK)
-			gdb_fileio_reply(target, connection);
-		else
-			gdb_signal_reply(target, connection);
+		gdb_report_halt(target, connection);
 	}
 }
 
@@ -928,13 +1084,16 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->buf_cnt = 0;
 	gdb_connection->ctrl_c = 0;
 	gdb_connection->frontend_state = TARGET_HALTED;
-	gdb_connection->vflash_image = NULL;
+	gdb_connection->vflash_stream = NULL;
+	gdb_connection->vflash_error = ERROR_OK;
 	gdb_connection->closed = 0;
 	gdb_connection->busy = 0;
 	gdb_connection->noack_mode = 0;
 	gdb_connection->sync = false;
 	gdb_connection->mem_write_error = false;
 	gdb_connection->attached = true;
+	gdb_connection->target_desc_read = false;
+	gdb_connection->resume_pending = false;
 	gdb_connection->target_desc.tdesc = NULL;
 	gdb_connection->target_desc.tdesc_length = 0;
 	gdb_connection->thread_list = NULL;
@@ -1021,11 +1180,12 @@ static int gdb_connection_closed(struct connection *connection)
 		target_state_name(gdb_service->target),
 		gdb_actual_connections);
 
-	/* see if an image built with vFlash commands is left */
-	if (gdb_connection->vflash_image) {
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
+	gdb_cancel_resume(connection);
+
+	/* see if an unfinished vFlash download is left */
+	if (gdb_connection->vflash_stream) {
+		flash_write_stream_free(gdb_connection->vflash_stream);
+		gdb_connection->vflash_stream = NULL;
 	}
 
 	/* if this connection registered a debug-message receiver delete it */
@@ -1105,8 +1265,9 @@ static void gdb_str_to_target(struct target *target,
 
 	for (i = 0; i < buf_len; i++) {
 		int j = gdb_reg_pos(target, i, buf_len);
-		tstr += sprintf(tstr, "%02x", buf[j]);
+		tstr = hexify_byte(tstr, buf[j]);
 	}
+	*tstr = 0;
 }
 
 /* copy over in register buffer */
@@ -1542,34 +1703,182 @@ static int gdb_write_memory_binary_packet(struct connection *connection,
 	return ERROR_OK;
 }
 
+/* poll GDB for a Ctrl-C every this many range steps */
+#define GDB_RANGE_STEP_POLL 16
+
+/* Returns 'c', 's' or 'r' for a c/s packet or a supported vCont action */
+static char gdb_resume_action(char const *packet)
+{
+	if (packet[0] == 'c' || packet[0] == 's')
+		return packet[0];
+	if (strncmp(packet, "vCont;", 6) != 0)
+		return 0;
+	switch (packet[6]) {
+		case 'c':
+		case 's':
+		case 'r':
+			return packet[6];
+		default:
+			return 0;
+	}
+}
+
+/* While range stepping, stop on any input from GDB; a Ctrl-C is
+ * consumed so that the stop reply reports it */
+static bool gdb_range_step_interrupted(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	int got_data;
+	int character;
+
+	if (check_pending(connection, 0, &got_data) != ERROR_OK || !got_data)
+		return false;
+	if (gdb_get_char(connection, &character) != ERROR_OK)
+		return true;
+	if (character == 0x3)
+		gdb_con->ctrl_c = 1;
+	else
+		gdb_putback_char(connection, character);
+	return true;
+}
+
+/**
+ * vCont;r: single-step locally while the PC stays within [start, end),
+ * and only report the final stop to GDB. Stepping also ends on any
+ * other halt reason, on reaching a breakpoint, or when GDB interrupts.
+ */
+static int gdb_range_step(struct connection *connection,
+		uint32_t start, uint32_t end)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+	unsigned steps = 0;
+	uint32_t address = 0;
+	int retval;
+
+	/* hold back the stop replies of the intermediate steps */
+	gdb_con->frontend_state = TARGET_HALTED;
+
+	for (;;) {
+		retval = target_step(target, 1, 0, 0);
+		steps++;
+		if (retval != ERROR_OK || target->state != TARGET_HALTED
+				|| target->debug_reason != DBG_REASON_SINGLESTEP)
+			break;
+
+		/* without a PC to look at, this is a plain single step */
+		if (gdb_read_pc(target, &address) != ERROR_OK)
+			break;
+		if (address < start || address >= end
+				|| breakpoint_find(target, address) != NULL)
+			break;
+
+		if (steps % GDB_RANGE_STEP_POLL == 0) {
+			keep_alive();
+			if (gdb_range_step_interrupted(connection))
+				break;
+		}
+	}
+
+	LOG_DEBUG("range step 0x%8.8" PRIx32 "-0x%8.8" PRIx32 ": %u steps, "
+		"stopped at 0x%8.8" PRIx32, start, end, steps, address);
+
+	gdb_con->frontend_state = TARGET_RUNNING;
+	if (retval == ERROR_OK)
+		gdb_frontend_halted(target, connection);
+	return retval;
+}
+
 static int gdb_step_continue_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
 	struct target *target = get_target_from_connection(connection);
+	char action = gdb_resume_action(packet);
 	int current = 0;
 	uint32_t address = 0x0;
 	int retval = ERROR_OK;
 
 	LOG_DEBUG("-");
 
-	if (packet_size > 1)
+	/* vCont actions always resume at the current address */
+	if (packet[0] != 'v' && packet_size > 1)
 		address = strtoul(packet + 1, NULL, 16);
 	else
 		current = 1;
 
-	gdb_running_type = packet[0];
-	if (packet[0] == 'c') {
+	gdb_running_type = (action == 'c') ? 'c' : 's';
+	if (action == 'c') {
 		LOG_DEBUG("continue");
 		/* resume at current address, don't handle breakpoints, not debugging */
 		retval = target_resume(target, current, address, 0, 0);
-	} else if (packet[0] == 's') {
+	} else if (action == 's') {
 		LOG_DEBUG("step");
 		/* step at current or address, don't handle breakpoints */
 		retval = target_step(target, current, address, 0);
+	} else if (action == 'r') {
+		char *separator;
+		uint32_t start = strtoul(packet + 7, &separator, 16);
+		if (*separator != ',') {
+			LOG_ERROR("incomplete vCont;r packet received");
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		uint32_t end = strtoul(separator + 1, NULL, 16);
+
+		LOG_DEBUG("range step");
+		retval = gdb_range_step(connection, start, end);
 	}
 	return retval;
 }
 
+/**
+ * Attach the ';X len,bytecode' condition list that may follow the kind
+ * field of a Z0/Z1 packet to the breakpoint at @a address, replacing any
+ * earlier one. A condition OpenOCD cannot compile drops the whole list,
+ * so the breakpoint stops on every hit as it would without conditions.
+ */
+static void gdb_breakpoint_conditions(struct target *target,
+		uint32_t address, char const *options)
+{
+	struct breakpoint *breakpoint = breakpoint_find(target, address);
+	struct agent_expr *list = NULL;
+	struct agent_expr **tail = &list;
+
+	if (breakpoint == NULL)
+		return;
+
+	while (strncmp(options, ";X", 2) == 0) {
+		char *separator;
+		unsigned long length = strtoul(options + 2, &separator, 16);
+		uint8_t *bytecode;
+
+		if (*separator != ',' || strlen(separator + 1) < 2 * length)
+			goto fail;
+
+		bytecode = malloc(length ? length : 1);
+		if (bytecode == NULL)
+			goto fail;
+		unhexify(bytecode, separator + 1, length);
+		int retval = agent_expr_compile(target, bytecode, length, tail);
+		free(bytecode);
+		if (retval != ERROR_OK)
+			goto fail;
+
+		tail = &(*tail)->next;
+		options = separator + 1 + 2 * length;
+	}
+
+	agent_expr_free_list(breakpoint->cond);
+	breakpoint->cond = list;
+	return;
+
+fail:
+	LOG_WARNING("condition of the breakpoint at 0x%8.8" PRIx32 " can't be "
+			"evaluated by OpenOCD, stopping on every hit", address);
+	agent_expr_free_list(list);
+	agent_expr_free_list(breakpoint->cond);
+	breakpoint->cond = NULL;
+}
+
 static int gdb_breakpoint_watchpoint_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -1627,8 +1936,10 @@ static int gdb_breakpoint_watchpoint_packet(struct connection *connection,
 					retval = gdb_error(connection, retval);
 					if (retval != ERROR_OK)
 						return retval;
-				} else
+				} else {
+					gdb_breakpoint_conditions(target, address, separator);
 					gdb_put_packet(connection, "OK", 2);
+				}
 			} else {
 				breakpoint_remove(target, address);
 				gdb_put_packet(connection, "OK", 2);
@@ -2465,7 +2776,8 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+",
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;"
+			"ConditionalBreakpoints+",
 			(GDB_BUFFER_SIZE - 1),
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
 			(gdb_target_desc_supported == 1) ? '+' : '-');
@@ -2510,6 +2822,7 @@ static int gdb_query_packet(struct connection *connection,
 		}
 
 		gdb_put_packet(connection, xml, strlen(xml));
+		gdb_connection->target_desc_read = true;
 
 		free(xml);
 		return ERROR_OK;
@@ -2641,32 +2954,58 @@ static int gdb_v_packet(struct connection *connection,
 		}
 		length = packet_size - (parse - packet);
 
-		/* create a new image if there isn't already one */
-		if (gdb_connection->vflash_image == NULL) {
-			gdb_connection->vflash_image = malloc(sizeof(struct image));
-			image_open(gdb_connection->vflash_image, "", "build");
+		/* start a new download if there isn't already one. No need to
+		 * erase as GDB always issues a vFlashErase first. */
+		if (gdb_connection->vflash_stream == NULL) {
+			gdb_connection->vflash_stream = flash_write_stream_open(gdb_service->target);
+			if (gdb_connection->vflash_stream == NULL)
+				return ERROR_FAIL;
+			gdb_connection->vflash_error = ERROR_OK;
+			target_call_event_callbacks(gdb_service->target,
+					TARGET_EVENT_GDB_FLASH_WRITE_START);
 		}
 
-		/* create new section with content from packet buffer */
-		retval = image_add_section(gdb_connection->vflash_image,
-				addr, length, 0x0, (uint8_t const *)parse);
-		if (retval != ERROR_OK)
-			return retval;
+		/* once programming failed, report it and drop the rest */
+		if (gdb_connection->vflash_error != ERROR_OK) {
+			gdb_send_error(connection, EIO);
+			return ERROR_OK;
+		}
 
+		retval = flash_write_stream_add(gdb_connection->vflash_stream,
+				addr, (uint8_t const *)parse, length);
+		if (retval != ERROR_OK) {
+			gdb_connection->vflash_error = retval;
+			gdb_send_error(connection, EIO);
+			return ERROR_OK;
+		}
+
+		/* acknowledge first so GDB sends the next packet while the
+		 * completed sectors are being programmed; a failure is then
+		 * reported on the following vFlash packet */
 		gdb_put_packet(connection, "OK", 2);
 
+		gdb_connection->vflash_error =
+			flash_write_stream_program(gdb_connection->vflash_stream);
+
 		return ERROR_OK;
 	}
 
 	if (strncmp(packet, "vFlashDone", 10) == 0) {
-		uint32_t written;
+		uint32_t written = 0;
+
+		result = gdb_connection->vflash_error;
+		if (gdb_connection->vflash_stream != NULL) {
+			/* program what is left of the download */
+			int retval = flash_write_stream_close(gdb_connection->vflash_stream,
+					&written);
+			if (result == ERROR_OK)
+				result = retval;
+			gdb_connection->vflash_stream = NULL;
+			target_call_event_callbacks(gdb_service->target,
+					TARGET_EVENT_GDB_FLASH_WRITE_END);
+		}
+		gdb_connection->vflash_error = ERROR_OK;
 
-		/* process the flashing buffer. No need to erase as GDB
-		 * always issues a vFlashErase first. */
-		target_call_event_callbacks(gdb_service->target,
-				TARGET_EVENT_GDB_FLASH_WRITE_START);
-		result = flash_write(gdb_service->target, gdb_connection->vflash_image, &written, 0);
-		target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_FLASH_WRITE_END);
 		if (result != ERROR_OK) {
 			if (result == ERROR_FLASH_DST_OUT_OF_BANK)
 				gdb_put_packet(connection, "E.memtype", 9);
@@ -2677,10 +3016,6 @@ static int gdb_v_packet(struct connection *connection,
 			gdb_put_packet(connection, "OK", 2);
 		}
 
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
-
 		return ERROR_OK;
 	}
 
@@ -2766,6 +3101,106 @@ static void gdb_sig_halted(struct connection *connection)
 	gdb_put_packet(connection, sig_reply, 3);
 }
 
+/* c, s and the vCont actions: resume or step, with the stop reply sent
+ * once the target halts */
+static int gdb_resume_packet(struct connection *connection,
+		char const *packet, int packet_size)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+	int retval = ERROR_OK;
+
+	gdb_thread_packet(connection, packet, packet_size);
+	log_add_callback(gdb_log_callback, connection);
+
+	if (gdb_con->mem_write_error) {
+		LOG_ERROR("Memory write failure!");
+
+		/* now that we have reported the memory write error,
+		 * we can clear the condition */
+		gdb_con->mem_write_error = false;
+	}
+
+	bool nostep = false;
+	bool already_running = false;
+	if (target->state == TARGET_RUNNING) {
+		LOG_WARNING("WARNING! The target is already running. "
+				"All changes GDB did to registers will be discarded! "
+				"Waiting for target to halt.");
+		already_running = true;
+	} else if (target->state != TARGET_HALTED) {
+		LOG_WARNING("The target is not in the halted nor running stated, " \
+				"stepi/continue ignored.");
+		nostep = true;
+	} else if ((gdb_resume_action(packet) != 'c') && gdb_con->sync) {
+		/* Hmm..... when you issue a continue in GDB, then a "stepi" is
+		 * sent by GDB first to OpenOCD, thus defeating the check to
+		 * make only the single stepping have the sync feature...
+		 */
+		nostep = true;
+		LOG_WARNING("stepi ignored. GDB will now fetch the register state " \
+				"from the target.");
+	}
+	gdb_con->sync = false;
+
+	if (!already_running && nostep) {
+		/* Either the target isn't in the halted state, then we can't
+		 * step/continue. This might be early setup, etc.
+		 *
+		 * Or we want to allow GDB to pick up a fresh set of
+		 * register values without modifying the target state.
+		 *
+		 */
+		gdb_sig_halted(connection);
+
+		/* stop forwarding log packets! */
+		log_remove_callback(gdb_log_callback, connection);
+	} else {
+		/* We're running/stepping, in which case we can
+		 * forward log output until the target is halted
+		 */
+		gdb_con->frontend_state = TARGET_RUNNING;
+		target_call_event_callbacks(target, TARGET_EVENT_GDB_START);
+
+		if (!already_running) {
+			/* Here we don't want packet processing to stop even if this fails,
+			 * so we use a local variable instead of retval. */
+			retval = gdb_step_continue_packet(connection, packet, packet_size);
+			if (retval != ERROR_OK) {
+				/* we'll never receive a halted
+				 * condition... issue a false one..
+				 */
+				gdb_frontend_halted(target, connection);
+			}
+		}
+	}
+
+	return retval;
+}
+
+static int gdb_vcont_packet(struct connection *connection,
+		char const *packet, int packet_size)
+{
+	/* c and s are required for GDB to use vCont at all; r is range
+	 * stepping. Signals are not delivered, so C and S are left out. */
+	if (strcmp(packet, "vCont?") == 0) {
+		gdb_put_packet(connection, "vCont;c;s;r", 11);
+		return ERROR_OK;
+	}
+
+	/* only one thread runs, so the first action applies */
+	if (gdb_resume_action(packet) == 0) {
+		gdb_put_packet(connection, "", 0);
+		return ERROR_OK;
+	}
+
+	return gdb_resume_packet(connection, packet, packet_size);
+}
+
+static struct metric_family gdb_packets_metric =
+	METRIC_COUNTER("openocd_gdb_packets_total",
+		"GDB remote protocol packets received, by packet type.", "type");
+
 static int gdb_input_inner(struct connection *connection)
 {
 	/* Do not allocate this on the stack */
@@ -2813,6 +3248,12 @@ static int gdb_input_inner(struct connection *connection)
 		}
 
 		if (packet_size > 0) {
+			char packet_type[2] = { packet[0], '\0' };
+			metric_add_label(&gdb_packets_metric, packet_type, 1);
+
+			struct timeline_span span;
+			timeline_begin(&span);
+
 			retval = ERROR_OK;
 			switch (packet[0]) {
 				case 'T':	/* Is thread alive? */
@@ -2855,75 +3296,13 @@ static int gdb_input_inner(struct connection *connection)
 					break;
 				case 'c':
 				case 's':
-				{
-					gdb_thread_packet(connection, packet, packet_size);
-					log_add_callback(gdb_log_callback, connection);
-
-					if (gdb_con->mem_write_error) {
-						LOG_ERROR("Memory write failure!");
-
-						/* now that we have reported the memory write error,
-						 * we can clear the condition */
-						gdb_con->mem_write_error = false;
-					}
-
-					bool nostep = false;
-					bool already_running = false;
-					if (target->state == TARGET_RUNNING) {
-						LOG_WARNING("WARNING! The target is already running. "
-								"All changes GDB did to registers will be discarded! "
-								"Waiting for target to halt.");
-						already_running = true;
-					} else if (target->state != TARGET_HALTED) {
-						LOG_WARNING("The target is not in the halted nor running stated, " \
-								"stepi/continue ignored.");
-						nostep = true;
-					} else if ((packet[0] == 's') && gdb_con->sync) {
-						/* Hmm..... when you issue a continue in GDB, then a "stepi" is
-						 * sent by GDB first to OpenOCD, thus defeating the check to
-						 * make only the single stepping have the sync feature...
-						 */
-						nostep = true;
-						LOG_WARNING("stepi ignored. GDB will now fetch the register state " \
-								"from the target.");
-					}
-					gdb_con->sync = false;
-
-					if (!already_running && nostep) {
-						/* Either the target isn't in the halted state, then we can't
-						 * step/continue. This might be early setup, etc.
-						 *
-						 * Or we want to allow GDB to pick up a fresh set of
-						 * register values without modifying the target state.
-						 *
-						 */
-						gdb_sig_halted(connection);
-
-						/* stop forwarding log packets! */
-						log_remove_callback(gdb_log_callback, connection);
-					} else {
-						/* We're running/stepping, in which case we can
-						 * forward log output until the target is halted
-						 */
-						gdb_con->frontend_state = TARGET_RUNNING;
-						target_call_event_callbacks(target, TARGET_EVENT_GDB_START);
-
-						if (!already_running) {
-							/* Here we don't want packet processing to stop even if this fails,
-							 * so we use a local variable instead of retval. */
-							retval = gdb_step_continue_packet(connection, packet, packet_size);
-							if (retval != ERROR_OK) {
-								/* we'll never receive a halted
-								 * condition... issue a false one..
-								 */
-								gdb_frontend_halted(target, connection);
-							}
-						}
-					}
-				}
-				break;
+					retval = gdb_resume_packet(connection, packet, packet_size);
+					break;
 				case 'v':
-					retval = gdb_v_packet(connection, packet, packet_size);
+					if (strncmp(packet, "vCont", 5) == 0)
+						retval = gdb_vcont_packet(connection, packet, packet_size);
+					else
+						retval = gdb_v_packet(connection, packet, packet_size);
 					break;
 				case 'D':
 					retval = gdb_detach(connection);
@@ -2991,6 +3370,18 @@ static int gdb_input_inner(struct connection *connection)
 					break;
 			}
 
+			if (timeline_recording) {
+				/* general queries are named up to their arguments,
+				 * e.g. "qXfer" or "vCont", the others by their letter */
+				char name[16];
+				size_t len = strchr("qQv", packet[0]) ? strcspn(packet, ":,;") : 1;
+				if (len >= sizeof(name))
+					len = sizeof(name) - 1;
+				memcpy(name, packet, len);
+				name[len] = '\0';
+				timeline_end(&span, "gdb", "packet", name);
+			}
+
 			/* if a packet handler returned an error, exit input loop */
 			if (retval != ERROR_OK)
 				return retval;
@@ -0,0 +1,174 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "metrics_server.h"
+#include <helper/metrics.h>
+
+/*
+ * Just enough HTTP for Prometheus and curl: GET requests for / or
+ * /metrics, answered with the metrics in the text format. Connections
+ * are kept open for further requests until the client closes them.
+ */
+#define METRICS_REQUEST_MAX	4096
+
+struct metrics_connection {
+	char request[METRICS_REQUEST_MAX + 1];
+	size_t len;
+};
+
+static char *metrics_port;
+
+static int metrics_respond(struct connection *connection, const char *status,
+		const char *body)
+{
+	char *header = alloc_printf("HTTP/1.1 %s\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %zu\r\n"
+			"\r\n", status, strlen(body));
+	int retval = ERROR_OK;
+
+	if (header == NULL)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	if (connection_write(connection, header, strlen(header)) != (int)strlen(header)
+		|| connection_write(connection, body, strlen(body)) != (int)strlen(body))
+		retval = ERROR_SERVER_REMOTE_CLOSED;
+
+	free(header);
+	return retval;
+}
+
+static int metrics_handle_request(struct connection *connection, char *request)
+{
+	char *line_end = strpbrk(request, "\r\n");
+	char *path;
+	int retval;
+
+	if (line_end)
+		*line_end = '\0';
+
+	/* "GET <path> HTTP/1.x", ignoring any query */
+	if (strncmp(request, "GET ", 4) != 0)
+		return metrics_respond(connection, "405 Method Not Allowed", "only GET is supported\n");
+
+	path = request + 4;
+	path[strcspn(path, " ?")] = '\0';
+	if (strcmp(path, "/") != 0 && strcmp(path, "/metrics") != 0)
+		return metrics_respond(connection, "404 Not Found", "try /metrics\n");
+
+	char *text = metrics_format();
+	if (text == NULL)
+		return metrics_respond(connection, "500 Internal Server Error", "out of memory\n");
+
+	retval = metrics_respond(connection, "200 OK", text);
+	free(text);
+
+	return retval;
+}
+
+static int metrics_new_connection(struct connection *connection)
+{
+	struct metrics_connection *mc = calloc(1, sizeof(struct metrics_connection));
+	if (mc == NULL)
+		return ERROR_CONNECTION_REJECTED;
+
+	connection->priv = mc;
+	return ERROR_OK;
+}
+
+static int metrics_input(struct connection *connection)
+{
+	struct metrics_connection *mc = connection->priv;
+	char *end;
+	int rlen;
+	int retval;
+
+	rlen = connection_read(connection, mc->request + mc->len, METRICS_REQUEST_MAX - mc->len);
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("metrics: error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+	mc->len += rlen;
+	mc->request[mc->len] = '\0';
+
+	/* answer every complete request, they have no body */
+	while ((end = strstr(mc->request, "\r\n\r\n")) != NULL) {
+		size_t request_len = end + 4 - mc->request;
+
+		end[2] = '\0';
+		retval = metrics_handle_request(connection, mc->request);
+		if (retval != ERROR_OK)
+			return retval;
+
+		mc->len -= request_len;
+		memmove(mc->request, mc->request + request_len, mc->len + 1);
+	}
+
+	if (mc->len == METRICS_REQUEST_MAX) {
+		LOG_ERROR("metrics: request too long, dropping connection");
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	return ERROR_OK;
+}
+
+static int metrics_closed(struct connection *connection)
+{
+	free(connection->priv);
+	connection->priv = NULL;
+
+	return ERROR_OK;
+}
+
+int metrics_server_init(void)
+{
+	if (strcmp(metrics_port, "disabled") == 0) {
+		LOG_INFO("metrics server disabled");
+		return ERROR_OK;
+	}
+
+	return add_service("metrics", metrics_port, CONNECTION_LIMIT_UNLIMITED,
+		&metrics_new_connection, &metrics_input,
+		&metrics_closed, NULL);
+}
+
+COMMAND_HANDLER(handle_metrics_port_command)
+{
+	return CALL_COMMAND_HANDLER(server_pipe_command, &metrics_port);
+}
+
+static const struct command_registration metrics_server_command_handlers[] = {
+	{
+		.name = "metrics_port",
+		.handler = handle_metrics_port_command,
+		.mode = COMMAND_ANY,
+		.help = "Specify port on which to serve the metrics over HTTP "
+			"for Prometheus. Disabled by default. "
+			"Read help on 'gdb_port'.",
+		.usage = "[port_num]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int metrics_server_register_commands(struct command_context *cmd_ctx)
+{
+	metrics_port = strdup("disabled");
+	return register_commands(cmd_ctx, NULL, metrics_server_command_handlers);
+}
@@ -0,0 +1,503 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rpc_server.h"
+#include <target/target.h>
+#include <target/register.h>
+
+/* frame header: u32 payload length, u32 sequence number */
+#define RPC_HEADER_SIZE		8
+#define RPC_FRAME_MAX		(16*1024*1024)
+#define RPC_BUF_INITIAL		(64*1024)
+
+struct rpc_buffer {
+	uint8_t *data;
+	uint32_t size;
+	uint32_t len;
+};
+
+struct rpc_connection {
+	struct rpc_buffer in;
+	struct rpc_buffer out;
+	int target_num;
+	bool notify_events;
+	bool notify_trace;
+	bool outerror;
+};
+
+static char *rpc_port;
+
+static int rpc_buffer_reserve(struct rpc_buffer *buf, uint32_t len)
+{
+	uint32_t size;
+	uint8_t *data;
+
+	if (buf->len + len <= buf->size)
+		return ERROR_OK;
+
+	size = buf->size ? buf->size : RPC_BUF_INITIAL;
+	while (size < buf->len + len)
+		size *= 2;
+
+	data = realloc(buf->data, size);
+	if (data == NULL) {
+		LOG_ERROR("rpc: out of memory");
+		return ERROR_FAIL;
+	}
+
+	buf->data = data;
+	buf->size = size;
+	return ERROR_OK;
+}
+
+/* reserve @a len bytes at the end of @a buf, returns NULL if out of memory */
+static uint8_t *rpc_buffer_append(struct rpc_buffer *buf, uint32_t len)
+{
+	uint8_t *p;
+
+	if (rpc_buffer_reserve(buf, len) != ERROR_OK)
+		return NULL;
+
+	p = buf->data + buf->len;
+	buf->len += len;
+	return p;
+}
+
+static int rpc_put_u8(struct rpc_buffer *buf, uint8_t val)
+{
+	uint8_t *p = rpc_buffer_append(buf, 1);
+	if (p == NULL)
+		return ERROR_FAIL;
+	*p = val;
+	return ERROR_OK;
+}
+
+static int rpc_put_u32(struct rpc_buffer *buf, uint32_t val)
+{
+	uint8_t *p = rpc_buffer_append(buf, 4);
+	if (p == NULL)
+		return ERROR_FAIL;
+	h_u32_to_le(p, val);
+	return ERROR_OK;
+}
+
+static int rpc_write(struct connection *connection, const uint8_t *data, uint32_t len)
+{
+	struct rpc_connection *rpcc = connection->priv;
+	int wlen;
+
+	if (rpcc->outerror)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	wlen = connection_write(connection, data, len);
+	if (wlen == (int)len)
+		return ERROR_OK;
+
+	LOG_ERROR("rpc: error during write: %d != %d", wlen, (int)len);
+	rpcc->outerror = true;
+	return ERROR_SERVER_REMOTE_CLOSED;
+}
+
+/* send an asynchronous notification frame, @a data is appended to @a head */
+static int rpc_send_async(struct connection *connection, uint8_t type,
+		const uint8_t *head, uint32_t head_len, const uint8_t *data, uint32_t len)
+{
+	uint8_t header[RPC_HEADER_SIZE + 1];
+	int retval;
+
+	h_u32_to_le(header, 1 + head_len + len);
+	h_u32_to_le(header + 4, RPC_SEQ_ASYNC);
+	header[RPC_HEADER_SIZE] = type;
+
+	retval = rpc_write(connection, header, sizeof(header));
+	if (retval == ERROR_OK)
+		retval = rpc_write(connection, head, head_len);
+	if (retval == ERROR_OK && len)
+		retval = rpc_write(connection, data, len);
+
+	return retval;
+}
+
+static int rpc_target_event_handler(struct target *target,
+		enum target_event event, void *priv)
+{
+	struct connection *connection = priv;
+	struct rpc_connection *rpcc = connection->priv;
+	uint8_t data[5];
+
+	if (!rpcc->notify_events)
+		return ERROR_OK;
+
+	h_u32_to_le(data, event);
+	data[4] = target->state;
+	rpc_send_async(connection, RPC_ASYNC_EVENT, data, sizeof(data), NULL, 0);
+
+	return ERROR_OK;
+}
+
+static int rpc_target_trace_handler(struct target *target,
+		size_t len, uint8_t *data, void *priv)
+{
+	struct connection *connection = priv;
+	struct rpc_connection *rpcc = connection->priv;
+	uint8_t length[4];
+
+	if (!rpcc->notify_trace)
+		return ERROR_OK;
+
+	/* trace data is forwarded raw, not hexified */
+	h_u32_to_le(length, len);
+	rpc_send_async(connection, RPC_ASYNC_TRACE, length, sizeof(length), data, len);
+
+	return ERROR_OK;
+}
+
+/* argument parser over the request payload */
+struct rpc_args {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static bool rpc_get(struct rpc_args *args, void *dst, uint32_t len)
+{
+	if ((uint32_t)(args->end - args->p) < len)
+		return false;
+	memcpy(dst, args->p, len);
+	args->p += len;
+	return true;
+}
+
+static bool rpc_get_u8(struct rpc_args *args, uint8_t *val)
+{
+	return rpc_get(args, val, 1);
+}
+
+static bool rpc_get_u32(struct rpc_args *args, uint32_t *val)
+{
+	uint8_t buf[4];
+
+	if (!rpc_get(args, buf, sizeof(buf)))
+		return false;
+	*val = le_to_h_u32(buf);
+	return true;
+}
+
+static bool rpc_get_name(struct rpc_args *args, char *name, size_t size)
+{
+	uint8_t len;
+
+	if (!rpc_get_u8(args, &len) || len >= size)
+		return false;
+	if (!rpc_get(args, name, len))
+		return false;
+	name[len] = '\0';
+	return true;
+}
+
+static struct reg *rpc_find_reg(struct target *target, const char *name)
+{
+	struct reg *reg = register_get_by_name(target->reg_cache, name, true);
+
+	if (reg == NULL)
+		LOG_ERROR("rpc: register '%s' not found", name);
+	return reg;
+}
+
+/**
+ * Execute one operation of a batch. Results are appended to the reply
+ * after the status word, which is filled in by the caller.
+ *
+ * @returns ERROR_COMMAND_SYNTAX_ERROR on malformed arguments, otherwise
+ * the status of the operation.
+ */
+static int rpc_execute(struct connection *connection, uint8_t opcode,
+		struct rpc_args *args)
+{
+	struct rpc_connection *rpcc = connection->priv;
+	struct rpc_buffer *out = &rpcc->out;
+	struct target *target = get_target_by_num(rpcc->target_num);
+	uint8_t size, current, flag;
+	uint32_t addr, count, val;
+	char name[256];
+	struct reg *reg;
+	uint8_t *p;
+	int retval;
+
+	if (target == NULL && opcode != RPC_OP_NOP && opcode != RPC_OP_SELECT_TARGET &&
+			opcode != RPC_OP_NOTIFY)
+		return ERROR_TARGET_INVALID;
+
+	switch (opcode) {
+		case RPC_OP_NOP:
+			return ERROR_OK;
+
+		case RPC_OP_READ_MEM:
+			if (!rpc_get_u8(args, &size) || !rpc_get_u32(args, &addr) ||
+					!rpc_get_u32(args, &count))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			if ((size != 1 && size != 2 && size != 4) || count > RPC_FRAME_MAX / size)
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			/* data follows the status word, read straight into the reply */
+			p = rpc_buffer_append(out, size * count);
+			if (p == NULL)
+				return ERROR_FAIL;
+			retval = target_read_memory(target, addr, size, count, p);
+			if (retval != ERROR_OK)
+				out->len -= size * count;
+			return retval;
+
+		case RPC_OP_WRITE_MEM:
+			if (!rpc_get_u8(args, &size) || !rpc_get_u32(args, &addr) ||
+					!rpc_get_u32(args, &count))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			if ((size != 1 && size != 2 && size != 4) || count > RPC_FRAME_MAX / size)
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			if ((uint32_t)(args->end - args->p) < size * count)
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			retval = target_write_memory(target, addr, size, count, args->p);
+			args->p += size * count;
+			return retval;
+
+		case RPC_OP_READ_REG:
+			if (!rpc_get_name(args, name, sizeof(name)))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			reg = rpc_find_reg(target, name);
+			if (reg == NULL)
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			if (!reg->valid) {
+				retval = reg->type->get(reg);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			if (rpc_put_u32(out, reg->size) != ERROR_OK)
+				return ERROR_FAIL;
+			p = rpc_buffer_append(out, DIV_ROUND_UP(reg->size, 8));
+			if (p == NULL)
+				return ERROR_FAIL;
+			memcpy(p, reg->value, DIV_ROUND_UP(reg->size, 8));
+			return ERROR_OK;
+
+		case RPC_OP_WRITE_REG:
+			if (!rpc_get_name(args, name, sizeof(name)) || !rpc_get_u32(args, &count))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			if ((uint32_t)(args->end - args->p) < count)
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			reg = rpc_find_reg(target, name);
+			if (reg == NULL || count != DIV_ROUND_UP(reg->size, 8)) {
+				args->p += count;
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+			retval = reg->type->set(reg, (uint8_t *)args->p);
+			args->p += count;
+			return retval;
+
+		case RPC_OP_HALT:
+			if (!rpc_get_u32(args, &val))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			retval = target_halt(target);
+			if (retval == ERROR_OK && val != 0)
+				retval = target_wait_state(target, TARGET_HALTED, val);
+			return retval;
+
+		case RPC_OP_RESUME:
+			if (!rpc_get_u8(args, &current) || !rpc_get_u32(args, &addr))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			return target_resume(target, current, addr, 1, 0);
+
+		case RPC_OP_STEP:
+			if (!rpc_get_u8(args, &current) || !rpc_get_u32(args, &addr))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			return target_step(target, current, addr, 1);
+
+		case RPC_OP_STATE:
+			retval = target_poll(target);
+			if (retval != ERROR_OK)
+				return retval;
+			return rpc_put_u8(out, target->state);
+
+		case RPC_OP_SELECT_TARGET:
+			if (!rpc_get_u32(args, &val))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			if (get_target_by_num(val) == NULL)
+				return ERROR_TARGET_INVALID;
+			rpcc->target_num = val;
+			return ERROR_OK;
+
+		case RPC_OP_NOTIFY:
+			if (!rpc_get_u8(args, &flag) || !rpc_get_u8(args, &current))
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			rpcc->notify_events = flag != 0;
+			rpcc->notify_trace = current != 0;
+			return ERROR_OK;
+
+		default:
+			LOG_ERROR("rpc: unknown opcode 0x%02x", opcode);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+}
+
+/* run all operations of one request frame and send the reply frame */
+static int rpc_process_frame(struct connection *connection, uint32_t seq,
+		const uint8_t *payload, uint32_t len)
+{
+	struct rpc_connection *rpcc = connection->priv;
+	struct rpc_buffer *out = &rpcc->out;
+	struct rpc_args args = { .p = payload, .end = payload + len };
+	uint8_t opcode;
+
+	out->len = 0;
+	if (rpc_put_u32(out, 0) != ERROR_OK || rpc_put_u32(out, seq) != ERROR_OK)
+		return ERROR_FAIL;
+
+	while (rpc_get_u8(&args, &opcode)) {
+		uint32_t status_pos = out->len;
+		int retval;
+
+		if (rpc_put_u32(out, 0) != ERROR_OK)
+			return ERROR_FAIL;
+
+		retval = rpc_execute(connection, opcode, &args);
+		h_u32_to_le(out->data + status_pos, retval);
+		if (retval != ERROR_OK)
+			break;
+	}
+
+	h_u32_to_le(out->data, out->len - RPC_HEADER_SIZE);
+	return rpc_write(connection, out->data, out->len);
+}
+
+static int rpc_new_connection(struct connection *connection)
+{
+	struct rpc_connection *rpcc;
+
+	rpcc = calloc(1, sizeof(struct rpc_connection));
+	if (rpcc == NULL)
+		return ERROR_CONNECTION_REJECTED;
+
+	rpcc->target_num = connection->cmd_ctx->current_target;
+	connection->priv = rpcc;
+
+	target_register_event_callback(rpc_target_event_handler, connection);
+	target_register_trace_callback(rpc_target_trace_handler, connection);
+
+	return ERROR_OK;
+}
+
+static int rpc_input(struct connection *connection)
+{
+	struct rpc_connection *rpcc = connection->priv;
+	struct rpc_buffer *in = &rpcc->in;
+	uint32_t offset = 0;
+	int rlen;
+	int retval;
+
+	if (rpc_buffer_reserve(in, RPC_BUF_INITIAL / 2) != ERROR_OK)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	rlen = connection_read(connection, in->data + in->len, in->size - in->len);
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("rpc: error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+	in->len += rlen;
+
+	/* process every complete frame received so far */
+	while (in->len - offset >= RPC_HEADER_SIZE) {
+		uint32_t len = le_to_h_u32(in->data + offset);
+		uint32_t seq = le_to_h_u32(in->data + offset + 4);
+
+		if (len > RPC_FRAME_MAX) {
+			LOG_ERROR("rpc: frame of %" PRIu32 " bytes exceeds limit, dropping connection", len);
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+
+		if (in->len - offset - RPC_HEADER_SIZE < len) {
+			/* make sure the rest of the frame fits */
+			if (rpc_buffer_reserve(in, RPC_HEADER_SIZE + len) != ERROR_OK)
+				return ERROR_SERVER_REMOTE_CLOSED;
+			break;
+		}
+
+		retval = rpc_process_frame(connection, seq,
+				in->data + offset + RPC_HEADER_SIZE, len);
+		if (retval != ERROR_OK)
+			return retval;
+
+		offset += RPC_HEADER_SIZE + len;
+	}
+
+	in->len -= offset;
+	memmove(in->data, in->data + offset, in->len);
+
+	return ERROR_OK;
+}
+
+static int rpc_closed(struct connection *connection)
+{
+	struct rpc_connection *rpcc = connection->priv;
+
+	target_unregister_event_callback(rpc_target_event_handler, connection);
+	target_unregister_trace_callback(rpc_target_trace_handler, connection);
+
+	if (rpcc) {
+		free(rpcc->in.data);
+		free(rpcc->out.data);
+		free(rpcc);
+		connection->priv = NULL;
+	}
+
+	return ERROR_OK;
+}
+
+int rpc_init(void)
+{
+	if (strcmp(rpc_port, "disabled") == 0) {
+		LOG_INFO("rpc server disabled");
+		return ERROR_OK;
+	}
+
+	return add_service("rpc", rpc_port, CONNECTION_LIMIT_UNLIMITED,
+		&rpc_new_connection, &rpc_input,
+		&rpc_closed, NULL);
+}
+
+COMMAND_HANDLER(handle_rpc_port_command)
+{
+	return CALL_COMMAND_HANDLER(server_pipe_command, &rpc_port);
+}
+
+static const struct command_registration rpc_command_handlers[] = {
+	{
+		.name = "rpc_port",
+		.handler = handle_rpc_port_command,
+		.mode = COMMAND_ANY,
+		.help = "Specify port on which to listen "
+			"for binary RPC requests. Disabled by default. "
+			"Read help on 'gdb_port'.",
+		.usage = "[port_num]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int rpc_register_commands(struct command_context *cmd_ctx)
+{
+	rpc_port = strdup("disabled");
+	return register_commands(cmd_ctx, NULL, rpc_command_handlers);
+}
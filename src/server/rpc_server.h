@@ -0,0 +1,58 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_SERVER_RPC_SERVER_H
+#define OPENOCD_SERVER_RPC_SERVER_H
+
+#include <server/server.h>
+
+/*
+ * Binary RPC protocol, all integers little endian.
+ *
+ * Every message is a frame: u32 payload length, u32 sequence number,
+ * then the payload. A request payload is a batch of operations, each an
+ * opcode byte followed by its arguments. The reply frame carries the same
+ * sequence number and, for every operation in order, an i32 OpenOCD error
+ * code followed by the operation's results. Processing of a batch stops
+ * at the first failing operation.
+ *
+ * Asynchronous notifications use sequence number RPC_SEQ_ASYNC and carry
+ * one RPC_ASYNC_* type byte followed by its data.
+ */
+#define RPC_SEQ_ASYNC		0xffffffff
+
+enum rpc_opcode {
+	RPC_OP_NOP = 0x00,		/* -> status */
+	RPC_OP_READ_MEM = 0x01,		/* u8 size, u32 addr, u32 count -> status, data */
+	RPC_OP_WRITE_MEM = 0x02,	/* u8 size, u32 addr, u32 count, data -> status */
+	RPC_OP_READ_REG = 0x03,		/* u8 len, name -> status, u32 bits, data */
+	RPC_OP_WRITE_REG = 0x04,	/* u8 len, name, u32 bytes, data -> status */
+	RPC_OP_HALT = 0x05,		/* u32 timeout ms -> status */
+	RPC_OP_RESUME = 0x06,		/* u8 current, u32 addr -> status */
+	RPC_OP_STEP = 0x07,		/* u8 current, u32 addr -> status */
+	RPC_OP_STATE = 0x08,		/* -> status, u8 enum target_state */
+	RPC_OP_SELECT_TARGET = 0x09,	/* u32 target number -> status */
+	RPC_OP_NOTIFY = 0x0a,		/* u8 events, u8 trace -> status */
+};
+
+enum rpc_async_type {
+	RPC_ASYNC_EVENT = 0x01,		/* u32 enum target_event, u8 target_state */
+	RPC_ASYNC_TRACE = 0x02,		/* u32 length, data */
+};
+
+int rpc_init(void);
+int rpc_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_SERVER_RPC_SERVER_H */
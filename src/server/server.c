@@ -32,6 +32,9 @@
 #include <target/openrisc/jsp_server.h>
 #include "openocd.h"
 #include "tcl_server.h"
+#include "rpc_server.h"
+#include "rtt_server.h"
+#include "metrics_server.h"
 #include "telnet_server.h"
 
 #include <signal.h>
@@ -191,7 +194,7 @@ static int remove_connection(struct service *service, struct connection *connect
 	return ERROR_OK;
 }
 
-/* FIX! make service return error instead of invoking exit() */
+/* FIX! named pipe failures still invoke exit() instead of returning an error */
 int add_service(char *name,
 	const char *port,
 	int max_connections,
@@ -235,7 +238,7 @@ int add_service(char *name,
 		c->fd = socket(AF_INET, SOCK_STREAM, 0);
 		if (c->fd == -1) {
 			LOG_ERROR("error creating socket: %s", strerror(errno));
-			exit(-1);
+			goto error;
 		}
 
 		setsockopt(c->fd,
@@ -255,7 +258,7 @@ int add_service(char *name,
 			hp = gethostbyname(bindto_name);
 			if (hp == NULL) {
 				LOG_ERROR("couldn't resolve bindto address: %s", bindto_name);
-				exit(-1);
+				goto error;
 			}
 			memcpy(&c->sin.sin_addr, hp->h_addr_list[0], hp->h_length);
 		}
@@ -263,7 +266,7 @@ int add_service(char *name,
 
 		if (bind(c->fd, (struct sockaddr *)&c->sin, sizeof(c->sin)) == -1) {
 			LOG_ERROR("couldn't bind %s to socket: %s", name, strerror(errno));
-			exit(-1);
+			goto error;
 		}
 
 #ifndef _WIN32
@@ -281,7 +284,7 @@ int add_service(char *name,
 
 		if (listen(c->fd, 1) == -1) {
 			LOG_ERROR("couldn't listen on socket: %s", strerror(errno));
-			exit(-1);
+			goto error;
 		}
 	} else if (c->type == CONNECTION_STDINOUT) {
 		c->fd = fileno(stdin);
@@ -318,6 +321,47 @@ int add_service(char *name,
 		;
 	*p = c;
 
+	return ERROR_OK;
+
+error:
+	/* the caller keeps ownership of priv when the service is not added */
+	if (c->fd != -1)
+		close_socket(c->fd);
+	free(c->name);
+	free(c->port);
+	free(c);
+	return ERROR_FAIL;
+}
+
+int remove_service(const char *name, const char *port)
+{
+	struct service **p = &services;
+
+	while (*p && (strcmp((*p)->name, name) || strcmp((*p)->port, port)))
+		p = &(*p)->next;
+
+	struct service *c = *p;
+	if (c == NULL) {
+		LOG_ERROR("no '%s' service on port %s", name, port);
+		return ERROR_FAIL;
+	}
+
+	while (c->connections)
+		remove_connection(c, c->connections);
+
+	if (c->type == CONNECTION_TCP)
+		close_socket(c->fd);
+	else if (c->type == CONNECTION_PIPE && c->fd != -1)
+		close(c->fd);
+
+	/* unlinking keeps server_loop() safe, as long as a service is not
+	 * removed from one of its own connections */
+	*p = c->next;
+	free(c->name);
+	free(c->port);
+	free(c->priv);
+	free(c);
+
 	return ERROR_OK;
 }
 
@@ -573,6 +617,14 @@ int server_init(struct command_context *cmd_ctx)
 	if (ERROR_OK != ret)
 		return ret;
 
+	ret = rpc_init();
+	if (ERROR_OK != ret)
+		return ret;
+
+	ret = metrics_server_init();
+	if (ERROR_OK != ret)
+		return ret;
+
 	return telnet_init("Open On-Chip Debugger");
 }
 
@@ -702,6 +754,18 @@ int server_register_commands(struct command_context *cmd_ctx)
 	if (ERROR_OK != retval)
 		return retval;
 
+	retval = rpc_register_commands(cmd_ctx);
+	if (ERROR_OK != retval)
+		return retval;
+
+	retval = rtt_server_register_commands(cmd_ctx);
+	if (ERROR_OK != retval)
+		return retval;
+
+	retval = metrics_server_register_commands(cmd_ctx);
+	if (ERROR_OK != retval)
+		return retval;
+
 	retval = jsp_register_commands(cmd_ctx);
 	if (ERROR_OK != retval)
 		return retval;
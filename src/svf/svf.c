@@ -32,6 +32,7 @@
 #include <jtag/jtag.h>
 #include "svf.h"
 #include <helper/time_support.h>
+#include <helper/fileio.h>
 
 /* SVF command */
 enum svf_command {
@@ -210,19 +211,19 @@ struct svf_check_tdo_para {
 static struct svf_check_tdo_para *svf_check_tdo_para;
 static int svf_check_tdo_para_index;
 
-static int svf_read_command_from_file(FILE *fd);
+static int svf_read_command_from_file(struct fileio *fd);
 static int svf_check_tdo(void);
 static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len);
 static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str);
 static int svf_execute_tap(void);
 
-static FILE *svf_fd;
+static struct fileio *svf_fd;
 static char *svf_read_line;
 static size_t svf_read_line_size;
 static char *svf_command_buffer;
 static size_t svf_command_buffer_size;
 static int svf_line_number;
-static int svf_getline(char **lineptr, size_t *n, FILE *stream);
+static int svf_getline(char **lineptr, size_t *n, struct fileio *stream);
 
 #define SVF_MAX_BUFFER_SIZE_TO_COMMIT   (1024 * 1024)
 static uint8_t *svf_tdi_buffer, *svf_tdo_buffer, *svf_mask_buffer;
@@ -398,10 +399,10 @@ COMMAND_HANDLER(handle_svf_command)
 				  "ignore_error") == 0) || (strcmp(CMD_ARGV[i], "-ignore_error") == 0))
 			svf_ignore_error = 1;
 		else {
-			svf_fd = fopen(CMD_ARGV[i], "r");
-			if (svf_fd == NULL) {
-				int err = errno;
-				command_print(CMD_CTX, "open(\"%s\"): %s", CMD_ARGV[i], strerror(err));
+			/* compressed files are decompressed on the fly */
+			if (fileio_open(&svf_fd, CMD_ARGV[i], FILEIO_READ, FILEIO_TEXT) != ERROR_OK) {
+				svf_fd = NULL;
+				command_print(CMD_CTX, "couldn't open \"%s\"", CMD_ARGV[i]);
 				/* no need to free anything now */
 				return ERROR_COMMAND_SYNTAX_ERROR;
 			} else
@@ -490,11 +491,13 @@ COMMAND_HANDLER(handle_svf_command)
 
 	if (svf_progress_enabled) {
 		/* Count total lines in file. */
-		while (!feof(svf_fd)) {
-			svf_getline(&svf_command_buffer, &svf_command_buffer_size, svf_fd);
+		do
 			svf_total_lines++;
+		while (svf_getline(&svf_command_buffer, &svf_command_buffer_size, svf_fd) > 0);
+		if (fileio_seek(svf_fd, 0) != ERROR_OK) {
+			ret = ERROR_FAIL;
+			goto free_all;
 		}
-		rewind(svf_fd);
 	}
 	while (ERROR_OK == svf_read_command_from_file(svf_fd)) {
 		/* Log Output */
@@ -542,8 +545,8 @@ COMMAND_HANDLER(handle_svf_command)
 
 free_all:
 
-	fclose(svf_fd);
-	svf_fd = 0;
+	fileio_close(svf_fd);
+	svf_fd = NULL;
 
 	/* free buffers */
 	if (svf_command_buffer) {
@@ -591,9 +594,9 @@ free_all:
 	return ret;
 }
 
-static int svf_getline(char **lineptr, size_t *n, FILE *stream)
+static int svf_getline(char **lineptr, size_t *n, struct fileio *stream)
 {
-#define MIN_CHUNK 16	/* Buffer is increased by this size each time as required */
+#define MIN_CHUNK 16	/* Buffer is doubled from this size as required */
 	size_t i = 0;
 
 	if (*lineptr == NULL) {
@@ -603,26 +606,26 @@ static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 			return -1;
 	}
 
-	(*lineptr)[0] = fgetc(stream);
-	while ((*lineptr)[i] != '\n') {
-		(*lineptr)[++i] = fgetc(stream);
-		if (feof(stream)) {
+	for (;;) {
+		/* a last line without newline is dropped, as it always was */
+		if (fileio_fgets(stream, *n - i, *lineptr + i) != ERROR_OK) {
 			(*lineptr)[0] = 0;
 			return -1;
 		}
+		i += strlen(*lineptr + i);
+		if (i > 0 && (*lineptr)[i - 1] == '\n')
+			break;
 		if ((i + 2) > *n) {
-			*n += MIN_CHUNK;
+			*n *= 2;
 			*lineptr = realloc(*lineptr, *n);
 		}
 	}
 
-	(*lineptr)[++i] = 0;
-
 	return sizeof(*lineptr);
 }
 
 #define SVFP_CMD_INC_CNT 1024
-static int svf_read_command_from_file(FILE *fd)
+static int svf_read_command_from_file(struct fileio *fd)
 {
 	unsigned char ch;
 	int i = 0;
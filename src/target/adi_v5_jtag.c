@@ -153,36 +153,66 @@ static void log_dap_cmd(const char *header, struct dap_cmd *el)
 #endif
 }
 
-static struct dap_cmd *dap_cmd_new(uint8_t instr,
+/* Journal entries are allocated in blocks and never freed; flushing the
+ * journal returns them to the DAP's pool, so the steady state of queueing
+ * transactions performs no allocations at all. */
+#define DAP_CMD_POOL_BLOCK	256
+
+static int dap_cmd_pool_grow(struct adiv5_dap *dap)
+{
+	struct dap_cmd *block;
+
+	block = calloc(DAP_CMD_POOL_BLOCK, sizeof(struct dap_cmd));
+	if (block == NULL) {
+		LOG_ERROR("Failed to allocate DAP journal entries");
+		return ERROR_FAIL;
+	}
+
+	for (int i = 0; i < DAP_CMD_POOL_BLOCK; i++)
+		list_add_tail(&block[i].lh, &dap->cmd_pool);
+
+	dap->journal_allocated += DAP_CMD_POOL_BLOCK;
+	return ERROR_OK;
+}
+
+static struct dap_cmd *dap_cmd_new(struct adiv5_dap *dap, uint8_t instr,
 		uint8_t reg_addr, uint8_t RnW,
 		uint8_t *outvalue, uint8_t *invalue,
 		uint32_t memaccess_tck)
 {
 	struct dap_cmd *cmd;
 
-	cmd = (struct dap_cmd *)calloc(1, sizeof(struct dap_cmd));
-	if (cmd != NULL) {
-		INIT_LIST_HEAD(&cmd->lh);
-		cmd->instr = instr;
-		cmd->reg_addr = reg_addr;
-		cmd->RnW = RnW;
-		if (outvalue != NULL)
-			memcpy(cmd->outvalue_buf, outvalue, 4);
-		cmd->invalue = (invalue != NULL) ? invalue : cmd->invalue_buf;
-		cmd->memaccess_tck = memaccess_tck;
+	if (list_empty(&dap->cmd_pool)) {
+		if (dap_cmd_pool_grow(dap) != ERROR_OK)
+			return NULL;
+	} else {
+		dap->journal_reused++;
 	}
 
+	cmd = list_first_entry(&dap->cmd_pool, struct dap_cmd, lh);
+	list_del(&cmd->lh);
+
+	memset(cmd, 0, sizeof(*cmd));
+	INIT_LIST_HEAD(&cmd->lh);
+	cmd->instr = instr;
+	cmd->reg_addr = reg_addr;
+	cmd->RnW = RnW;
+	if (outvalue != NULL)
+		memcpy(cmd->outvalue_buf, outvalue, 4);
+	cmd->invalue = (invalue != NULL) ? invalue : cmd->invalue_buf;
+	cmd->memaccess_tck = memaccess_tck;
+
 	return cmd;
 }
 
-static void flush_journal(struct list_head *lh)
+static void dap_cmd_release(struct adiv5_dap *dap, struct dap_cmd *cmd)
 {
-	struct dap_cmd *el, *tmp;
+	list_add(&cmd->lh, &dap->cmd_pool);
+}
 
-	list_for_each_entry_safe(el, tmp, lh, lh) {
-		list_del(&el->lh);
-		free(el);
-	}
+static void flush_journal(struct adiv5_dap *dap, struct list_head *lh)
+{
+	list_splice_init(lh, &dap->cmd_pool);
 }
 
 /***************************************************************************
@@ -196,6 +226,12 @@ static int adi_jtag_dp_scan_cmd(struct adiv5_dap *dap, struct dap_cmd *cmd, uint
 	struct jtag_tap *tap = dap->tap;
 	int retval;
 
+	/* arm_jtag_set_instr() skips the IR scan if the instruction is loaded */
+	if (buf_get_u32(tap->cur_instr, 0, tap->ir_length) == cmd->instr)
+		dap->ir_scans_skipped++;
+	else
+		dap->ir_scans++;
+
 	retval = arm_jtag_set_instr(tap, cmd->instr, NULL, TAP_IDLE);
 	if (retval != ERROR_OK)
 		return retval;
@@ -273,7 +309,7 @@ static int adi_jtag_dp_scan(struct adiv5_dap *dap,
 	struct dap_cmd *cmd;
 	int retval;
 
-	cmd = dap_cmd_new(instr, reg_addr, RnW, outvalue, invalue, memaccess_tck);
+	cmd = dap_cmd_new(dap, instr, reg_addr, RnW, outvalue, invalue, memaccess_tck);
 	if (cmd != NULL)
 		cmd->dp_select = dap->select;
 	else
@@ -282,6 +318,8 @@ static int adi_jtag_dp_scan(struct adiv5_dap *dap,
 	retval = adi_jtag_dp_scan_cmd(dap, cmd, ack);
 	if (retval == ERROR_OK)
 		list_add_tail(&cmd->lh,	&dap->cmd_journal);
+	else
+		dap_cmd_release(dap, cmd);
 
 	return retval;
 }
@@ -371,6 +409,7 @@ static int jtagdp_overrun_check(struct adiv5_dap *dap)
 			log_dap_cmd("LOG", el);
 		} else if (el->ack == JTAG_ACK_WAIT) {
 			found_wait = 1;
+			metric_add_label(&dap_acks_metric, "wait", 1);
 			break;
 		} else {
 			LOG_ERROR("Invalid ACK (%1x) in DAP response", el->ack);
@@ -415,7 +454,7 @@ static int jtagdp_overrun_check(struct adiv5_dap *dap)
 				* To complete the READ, we just keep polling RDBUFF
 				* until the WAIT condition clears
 				*/
-				tmp = dap_cmd_new(JTAG_DP_DPACC,
+				tmp = dap_cmd_new(dap, JTAG_DP_DPACC,
 						DP_RDBUFF, DPAP_READ, NULL, NULL, 0);
 				if (tmp == NULL) {
 					retval = ERROR_JTAG_DEVICE_ERROR;
@@ -459,7 +498,7 @@ static int jtagdp_overrun_check(struct adiv5_dap *dap)
 				}
 
 				/* we're done with this command, release it */
-				free(tmp);
+				dap_cmd_release(dap, tmp);
 
 				if (retval != ERROR_OK)
 					goto done;
@@ -479,11 +518,13 @@ static int jtagdp_overrun_check(struct adiv5_dap *dap)
 	}
 
 	/* we're done with the journal, flush it */
-	flush_journal(&dap->cmd_journal);
+	flush_journal(dap, &dap->cmd_journal);
 
 	/* check for overrun condition in the last batch of transactions */
 	if (found_wait) {
 		LOG_INFO("DAP transaction stalled (WAIT) - slowing down");
+		if (dap->last_ap)
+			mem_ap_tune_memaccess(dap->last_ap, 1, true);
 		/* clear the sticky overrun condition */
 		retval = adi_jtag_scan_inout_check_u32(dap, JTAG_DP_DPACC,
 				DP_CTRL_STAT, DPAP_WRITE,
@@ -494,7 +535,7 @@ static int jtagdp_overrun_check(struct adiv5_dap *dap)
 		/* restore SELECT register first */
 		if (!list_empty(&replay_list)) {
 			el = list_first_entry(&replay_list, struct dap_cmd, lh);
-			tmp = dap_cmd_new(JTAG_DP_DPACC,
+			tmp = dap_cmd_new(dap, JTAG_DP_DPACC,
 					  DP_SELECT, DPAP_WRITE, (uint8_t *)&el->dp_select, NULL, 0);
 			if (tmp == NULL) {
 				retval = ERROR_JTAG_DEVICE_ERROR;
@@ -545,8 +586,8 @@ static int jtagdp_overrun_check(struct adiv5_dap *dap)
 	}
 
  done:
-	flush_journal(&replay_list);
-	flush_journal(&dap->cmd_journal);
+	flush_journal(dap, &replay_list);
+	flush_journal(dap, &dap->cmd_journal);
 	return retval;
 }
 
@@ -570,6 +611,7 @@ static int jtagdp_transaction_endcheck(struct adiv5_dap *dap)
 	/* Check for STICKYERR */
 	if (ctrlstat & SSTICKYERR) {
 		LOG_DEBUG("jtag-dp: CTRL/STAT 0x%" PRIx32, ctrlstat);
+		metric_add_label(&dap_acks_metric, "fault", 1);
 		/* Check power to debug regions */
 		if ((ctrlstat & (CDBGPWRUPREQ | CDBGPWRUPACK | CSYSPWRUPREQ | CSYSPWRUPACK)) !=
 						(CDBGPWRUPREQ | CDBGPWRUPACK | CSYSPWRUPREQ | CSYSPWRUPACK)) {
@@ -592,7 +634,7 @@ static int jtagdp_transaction_endcheck(struct adiv5_dap *dap)
 	}
 
  done:
-	flush_journal(&dap->cmd_journal);
+	flush_journal(dap, &dap->cmd_journal);
 	return retval;
 }
 
@@ -637,6 +679,7 @@ static int jtag_ap_q_read(struct adiv5_ap *ap, unsigned reg,
 	if (retval != ERROR_OK)
 		return retval;
 
+	mem_ap_count_access(ap, reg);
 	retval =  adi_jtag_dp_scan_u32(ap->dap, JTAG_DP_APACC, reg,
 			DPAP_READ, 0, ap->dap->last_read, ap->memaccess_tck, NULL);
 	ap->dap->last_read = data;
@@ -651,6 +694,7 @@ static int jtag_ap_q_write(struct adiv5_ap *ap, unsigned reg,
 	if (retval != ERROR_OK)
 		return retval;
 
+	mem_ap_count_access(ap, reg);
 	retval =  adi_jtag_dp_scan_u32(ap->dap, JTAG_DP_APACC, reg,
 			DPAP_WRITE, data, ap->dap->last_read, ap->memaccess_tck, NULL);
 	ap->dap->last_read = NULL;
@@ -679,6 +723,13 @@ static int jtag_dp_run(struct adiv5_dap *dap)
 	retval2 = jtagdp_overrun_check(dap);
 	retval = jtagdp_transaction_endcheck(dap);
 
+	/* WAITs are recovered by replaying the journal, so it is safe to
+	 * probe for a shorter delay after a run of clean transfers */
+	if (dap->last_ap) {
+		mem_ap_tune_memaccess(dap->last_ap, 0, true);
+		dap->last_ap = NULL;
+	}
+
  done:
 	return (retval2 != ERROR_OK) ? retval2 : retval;
 }
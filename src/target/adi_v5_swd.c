@@ -47,6 +47,8 @@
 #include "arm.h"
 #include "arm_adi_v5.h"
 #include <helper/time_support.h>
+#include <helper/metrics.h>
+#include <helper/timeline.h>
 
 #include <transport/transport.h>
 #include <jtag/interface.h>
@@ -57,10 +59,15 @@
 extern struct jtag_interface *jtag_interface;
 static bool do_sync;
 
+static struct metric_family swd_transactions_metric =
+	METRIC_COUNTER("openocd_swd_transactions_total",
+		"SWD register reads and writes queued.", "op");
+
 static void swd_finish_read(struct adiv5_dap *dap)
 {
 	const struct swd_driver *swd = jtag_interface->swd;
 	if (dap->last_read != NULL) {
+		metric_add_label(&swd_transactions_metric, "read", 1);
 		swd->read_reg(swd_cmd(true, false, DP_RDBUFF), dap->last_read, 0);
 		dap->last_read = NULL;
 	}
@@ -76,6 +83,7 @@ static void swd_clear_sticky_errors(struct adiv5_dap *dap)
 	const struct swd_driver *swd = jtag_interface->swd;
 	assert(swd);
 
+	metric_add_label(&swd_transactions_metric, "write", 1);
 	swd->write_reg(swd_cmd(false,  false, DP_ABORT),
 		STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR, 0);
 }
@@ -83,13 +91,17 @@ static void swd_clear_sticky_errors(struct adiv5_dap *dap)
 static int swd_run_inner(struct adiv5_dap *dap)
 {
 	const struct swd_driver *swd = jtag_interface->swd;
+	struct timeline_span span;
 	int retval;
 
+	timeline_begin(&span);
 	retval = swd->run();
+	timeline_end(&span, "adapter", "swd_run", jtag_interface->name);
 
 	if (retval != ERROR_OK) {
 		/* fault response */
 		dap->do_reconnect = true;
+		metric_add_label(&dap_acks_metric, retval == ERROR_WAIT ? "wait" : "fault", 1);
 	}
 
 	return retval;
@@ -160,6 +172,7 @@ static int swd_queue_ap_abort(struct adiv5_dap *dap, uint8_t *ack)
 	const struct swd_driver *swd = jtag_interface->swd;
 	assert(swd);
 
+	metric_add_label(&swd_transactions_metric, "write", 1);
 	swd->write_reg(swd_cmd(false,  false, DP_ABORT),
 		DAPABORT | STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR, 0);
 	return check_sync(dap);
@@ -195,6 +208,7 @@ static int swd_queue_dp_read(struct adiv5_dap *dap, unsigned reg,
 		return retval;
 
 	swd_queue_dp_bankselect(dap, reg);
+	metric_add_label(&swd_transactions_metric, "read", 1);
 	swd->read_reg(swd_cmd(true,  false, reg), data, 0);
 
 	return check_sync(dap);
@@ -212,6 +226,7 @@ static int swd_queue_dp_write(struct adiv5_dap *dap, unsigned reg,
 
 	swd_finish_read(dap);
 	swd_queue_dp_bankselect(dap, reg);
+	metric_add_label(&swd_transactions_metric, "write", 1);
 	swd->write_reg(swd_cmd(false,  false, reg), data, 0);
 
 	return check_sync(dap);
@@ -246,6 +261,8 @@ static int swd_queue_ap_read(struct adiv5_ap *ap, unsigned reg,
 		return retval;
 
 	swd_queue_ap_bankselect(ap, reg);
+	mem_ap_count_access(ap, reg);
+	metric_add_label(&swd_transactions_metric, "read", 1);
 	swd->read_reg(swd_cmd(true,  true, reg), dap->last_read, ap->memaccess_tck);
 	dap->last_read = data;
 
@@ -266,6 +283,8 @@ static int swd_queue_ap_write(struct adiv5_ap *ap, unsigned reg,
 
 	swd_finish_read(dap);
 	swd_queue_ap_bankselect(ap, reg);
+	mem_ap_count_access(ap, reg);
+	metric_add_label(&swd_transactions_metric, "write", 1);
 	swd->write_reg(swd_cmd(false,  true, reg), data, ap->memaccess_tck);
 
 	return check_sync(dap);
@@ -274,8 +293,19 @@ static int swd_queue_ap_write(struct adiv5_ap *ap, unsigned reg,
 /** Executes all queued DAP operations. */
 static int swd_run(struct adiv5_dap *dap)
 {
+	int retval;
+
 	swd_finish_read(dap);
-	return swd_run_inner(dap);
+	retval = swd_run_inner(dap);
+
+	/* A WAIT fails the whole run with SWD, so the delay is only ever
+	 * raised here, never probed downwards */
+	if (dap->last_ap) {
+		mem_ap_tune_memaccess(dap->last_ap, retval == ERROR_WAIT ? 1 : 0, false);
+		dap->last_ap = NULL;
+	}
+
+	return retval;
 }
 
 const struct dap_ops swd_dap_ops = {
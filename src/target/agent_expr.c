@@ -0,0 +1,454 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "target.h"
+#include "register.h"
+#include "agent_expr.h"
+#include <helper/binarybuffer.h>
+#include <helper/log.h>
+
+/* GDB agent bytecode operations, as in gdb/common/ax.def */
+enum agent_op {
+	AX_ADD = 0x02,
+	AX_SUB = 0x03,
+	AX_MUL = 0x04,
+	AX_DIV_SIGNED = 0x05,
+	AX_DIV_UNSIGNED = 0x06,
+	AX_REM_SIGNED = 0x07,
+	AX_REM_UNSIGNED = 0x08,
+	AX_LSH = 0x09,
+	AX_RSH_SIGNED = 0x0a,
+	AX_RSH_UNSIGNED = 0x0b,
+	AX_LOG_NOT = 0x0e,
+	AX_BIT_AND = 0x0f,
+	AX_BIT_OR = 0x10,
+	AX_BIT_XOR = 0x11,
+	AX_BIT_NOT = 0x12,
+	AX_EQUAL = 0x13,
+	AX_LESS_SIGNED = 0x14,
+	AX_LESS_UNSIGNED = 0x15,
+	AX_EXT = 0x16,
+	AX_REF8 = 0x17,
+	AX_REF16 = 0x18,
+	AX_REF32 = 0x19,
+	AX_REF64 = 0x1a,
+	AX_IF_GOTO = 0x20,
+	AX_GOTO = 0x21,
+	AX_CONST8 = 0x22,
+	AX_CONST16 = 0x23,
+	AX_CONST32 = 0x24,
+	AX_CONST64 = 0x25,
+	AX_REG = 0x26,
+	AX_END = 0x27,
+	AX_DUP = 0x28,
+	AX_POP = 0x29,
+	AX_ZERO_EXT = 0x2a,
+	AX_SWAP = 0x2b,
+	AX_PICK = 0x32,
+	AX_ROT = 0x33,
+};
+
+/* evaluation limits: stack depth, and instructions run, so that a
+ * looping expression cannot hang the halt handling */
+#define AGENT_STACK_SIZE	64
+#define AGENT_MAX_STEPS		10000
+
+struct agent_insn {
+	uint8_t op;
+	/* constant, bit count, pick depth or jump target index */
+	uint64_t operand;
+	struct reg *reg;
+};
+
+/* number of operand bytes following each supported opcode, -1 if the
+ * opcode is not supported */
+static int agent_operand_size(uint8_t op)
+{
+	switch (op) {
+		case AX_ADD ... AX_RSH_UNSIGNED:
+		case AX_LOG_NOT ... AX_LESS_UNSIGNED:
+		case AX_REF8 ... AX_REF64:
+		case AX_END:
+		case AX_DUP:
+		case AX_POP:
+		case AX_SWAP:
+		case AX_ROT:
+			return 0;
+		case AX_EXT:
+		case AX_ZERO_EXT:
+		case AX_CONST8:
+		case AX_PICK:
+			return 1;
+		case AX_IF_GOTO:
+		case AX_GOTO:
+		case AX_CONST16:
+		case AX_REG:
+			return 2;
+		case AX_CONST32:
+			return 4;
+		case AX_CONST64:
+			return 8;
+		default:
+			return -1;
+	}
+}
+
+int agent_expr_compile(struct target *target, const uint8_t *bytecode,
+		unsigned length, struct agent_expr **expr)
+{
+	struct reg **reg_list = NULL;
+	int reg_list_size = 0;
+	int retval = ERROR_FAIL;
+
+	/* byte offset -> instruction index, -1 inside operands */
+	int *index = malloc((length + 1) * sizeof(*index));
+	struct agent_expr *e = calloc(1, sizeof(*e));
+	if (e != NULL)
+		e->insns = calloc(length ? length : 1, sizeof(*e->insns));
+	if (index == NULL || e == NULL || e->insns == NULL)
+		goto out;
+
+	for (unsigned i = 0; i <= length; i++)
+		index[i] = -1;
+
+	for (unsigned pos = 0; pos < length; ) {
+		struct agent_insn *insn = &e->insns[e->num_insns];
+		int size = agent_operand_size(bytecode[pos]);
+
+		if (size < 0) {
+			LOG_DEBUG("unsupported agent expression opcode 0x%02x",
+				bytecode[pos]);
+			goto out;
+		}
+		if (pos + 1 + size > length) {
+			LOG_DEBUG("truncated agent expression");
+			goto out;
+		}
+
+		index[pos] = e->num_insns++;
+		insn->op = bytecode[pos++];
+		/* operands are big endian */
+		for (int i = 0; i < size; i++)
+			insn->operand = (insn->operand << 8) | bytecode[pos++];
+
+		if (insn->op == AX_REG) {
+			if (reg_list == NULL) {
+				retval = target_get_gdb_reg_list(target, &reg_list,
+						&reg_list_size, REG_CLASS_ALL);
+				if (retval != ERROR_OK)
+					goto out;
+				retval = ERROR_FAIL;
+			}
+			if (insn->operand >= (uint64_t)reg_list_size) {
+				LOG_DEBUG("agent expression uses unknown register %u",
+					(unsigned)insn->operand);
+				goto out;
+			}
+			insn->reg = reg_list[insn->operand];
+		}
+		if ((insn->op == AX_EXT || insn->op == AX_ZERO_EXT)
+				&& (insn->operand == 0 || insn->operand > 64)) {
+			LOG_DEBUG("bad agent expression extension width");
+			goto out;
+		}
+	}
+	/* falling off the end is an implicit 'end' */
+	index[length] = e->num_insns;
+
+	for (unsigned i = 0; i < e->num_insns; i++) {
+		struct agent_insn *insn = &e->insns[i];
+		if (insn->op != AX_IF_GOTO && insn->op != AX_GOTO)
+			continue;
+		if (insn->operand > length || index[insn->operand] < 0) {
+			LOG_DEBUG("agent expression jumps into the middle of an operation");
+			goto out;
+		}
+		insn->operand = index[insn->operand];
+	}
+
+	*expr = e;
+	e = NULL;
+	retval = ERROR_OK;
+
+out:
+	free(reg_list);
+	free(index);
+	if (e != NULL)
+		agent_expr_free_list(e);
+	return retval;
+}
+
+static int agent_read_reg(struct reg *reg, uint64_t *value)
+{
+	if (!reg->valid) {
+		int retval = reg->type->get(reg);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	*value = buf_get_u64(reg->value, 0, reg->size > 64 ? 64 : reg->size);
+	return ERROR_OK;
+}
+
+static int agent_read_mem(struct target *target, uint8_t op,
+		uint64_t address, uint64_t *value)
+{
+	int retval;
+
+	switch (op) {
+		case AX_REF8: {
+			uint8_t v;
+			retval = target_read_u8(target, address, &v);
+			*value = v;
+			break;
+		}
+		case AX_REF16: {
+			uint16_t v;
+			retval = target_read_u16(target, address, &v);
+			*value = v;
+			break;
+		}
+		case AX_REF32: {
+			uint32_t v;
+			retval = target_read_u32(target, address, &v);
+			*value = v;
+			break;
+		}
+		default:
+			retval = target_read_u64(target, address, value);
+			break;
+	}
+	return retval;
+}
+
+static bool agent_stack_ok(unsigned sp, unsigned popped, unsigned pushed)
+{
+	if (sp < popped) {
+		LOG_DEBUG("agent expression stack underflow");
+		return false;
+	}
+	if (sp - popped + pushed > AGENT_STACK_SIZE) {
+		LOG_DEBUG("agent expression stack overflow");
+		return false;
+	}
+	return true;
+}
+
+int agent_expr_eval(struct target *target, const struct agent_expr *expr,
+		int64_t *result)
+{
+	uint64_t stack[AGENT_STACK_SIZE];
+	unsigned sp = 0;
+	unsigned pc = 0;
+	int retval;
+
+	/* operand counts popped and pushed, checked before each operation */
+#define AGENT_NEED(n, pushed) \
+	do { \
+		if (!agent_stack_ok(sp, (n), (pushed))) \
+			return ERROR_FAIL; \
+	} while (0)
+
+	for (unsigned steps = 0; pc < expr->num_insns; steps++) {
+		const struct agent_insn *insn = &expr->insns[pc++];
+		uint64_t a, b;
+
+		if (steps == AGENT_MAX_STEPS) {
+			LOG_DEBUG("agent expression ran for too long");
+			return ERROR_FAIL;
+		}
+
+		switch (insn->op) {
+			case AX_ADD ... AX_RSH_UNSIGNED:
+			case AX_BIT_AND ... AX_BIT_XOR:
+			case AX_EQUAL ... AX_LESS_UNSIGNED:
+				AGENT_NEED(2, 1);
+				b = stack[--sp];
+				a = stack[--sp];
+				switch (insn->op) {
+					case AX_ADD:
+						a += b;
+						break;
+					case AX_SUB:
+						a -= b;
+						break;
+					case AX_MUL:
+						a *= b;
+						break;
+					case AX_DIV_SIGNED:
+					case AX_REM_SIGNED:
+						if (b == 0)
+							return ERROR_FAIL;
+						/* INT64_MIN / -1 overflows; the result wraps */
+						if ((int64_t)b == -1)
+							a = insn->op == AX_DIV_SIGNED ? -a : 0;
+						else if (insn->op == AX_DIV_SIGNED)
+							a = (int64_t)a / (int64_t)b;
+						else
+							a = (int64_t)a % (int64_t)b;
+						break;
+					case AX_DIV_UNSIGNED:
+						if (b == 0)
+							return ERROR_FAIL;
+						a /= b;
+						break;
+					case AX_REM_UNSIGNED:
+						if (b == 0)
+							return ERROR_FAIL;
+						a %= b;
+						break;
+					case AX_LSH:
+						a = b < 64 ? a << b : 0;
+						break;
+					case AX_RSH_SIGNED:
+						a = (int64_t)a >> (b < 64 ? b : 63);
+						break;
+					case AX_RSH_UNSIGNED:
+						a = b < 64 ? a >> b : 0;
+						break;
+					case AX_BIT_AND:
+						a &= b;
+						break;
+					case AX_BIT_OR:
+						a |= b;
+						break;
+					case AX_BIT_XOR:
+						a ^= b;
+						break;
+					case AX_EQUAL:
+						a = a == b;
+						break;
+					case AX_LESS_SIGNED:
+						a = (int64_t)a < (int64_t)b;
+						break;
+					default:
+						a = a < b;
+						break;
+				}
+				stack[sp++] = a;
+				break;
+			case AX_LOG_NOT:
+				AGENT_NEED(1, 1);
+				stack[sp - 1] = !stack[sp - 1];
+				break;
+			case AX_BIT_NOT:
+				AGENT_NEED(1, 1);
+				stack[sp - 1] = ~stack[sp - 1];
+				break;
+			case AX_EXT:
+				AGENT_NEED(1, 1);
+				if (insn->operand < 64) {
+					uint64_t sign = 1ULL << (insn->operand - 1);
+					a = stack[sp - 1] & ((sign << 1) - 1);
+					stack[sp - 1] = (a ^ sign) - sign;
+				}
+				break;
+			case AX_ZERO_EXT:
+				AGENT_NEED(1, 1);
+				if (insn->operand < 64)
+					stack[sp - 1] &= (1ULL << insn->operand) - 1;
+				break;
+			case AX_REF8 ... AX_REF64:
+				AGENT_NEED(1, 1);
+				retval = agent_read_mem(target, insn->op, stack[sp - 1], &a);
+				if (retval != ERROR_OK)
+					return retval;
+				stack[sp - 1] = a;
+				break;
+			case AX_IF_GOTO:
+				AGENT_NEED(1, 0);
+				if (stack[--sp])
+					pc = insn->operand;
+				break;
+			case AX_GOTO:
+				pc = insn->operand;
+				break;
+			case AX_CONST8 ... AX_CONST64:
+				AGENT_NEED(0, 1);
+				stack[sp++] = insn->operand;
+				break;
+			case AX_REG:
+				AGENT_NEED(0, 1);
+				retval = agent_read_reg(insn->reg, &a);
+				if (retval != ERROR_OK)
+					return retval;
+				stack[sp++] = a;
+				break;
+			case AX_END:
+				pc = expr->num_insns;
+				break;
+			case AX_DUP:
+				AGENT_NEED(1, 2);
+				stack[sp] = stack[sp - 1];
+				sp++;
+				break;
+			case AX_POP:
+				AGENT_NEED(1, 0);
+				sp--;
+				break;
+			case AX_SWAP:
+				AGENT_NEED(2, 2);
+				a = stack[sp - 1];
+				stack[sp - 1] = stack[sp - 2];
+				stack[sp - 2] = a;
+				break;
+			case AX_PICK:
+				AGENT_NEED(insn->operand + 1, insn->operand + 2);
+				stack[sp] = stack[sp - 1 - insn->operand];
+				sp++;
+				break;
+			case AX_ROT:
+				/* a b c => c a b */
+				AGENT_NEED(3, 3);
+				a = stack[sp - 1];
+				stack[sp - 1] = stack[sp - 2];
+				stack[sp - 2] = stack[sp - 3];
+				stack[sp - 3] = a;
+				break;
+		}
+	}
+
+#undef AGENT_NEED
+
+	if (sp == 0) {
+		LOG_DEBUG("agent expression left no result");
+		return ERROR_FAIL;
+	}
+	*result = stack[sp - 1];
+	return ERROR_OK;
+}
+
+bool agent_expr_list_true(struct target *target, const struct agent_expr *list)
+{
+	for (const struct agent_expr *e = list; e != NULL; e = e->next) {
+		int64_t result;
+		if (agent_expr_eval(target, e, &result) != ERROR_OK || result != 0)
+			return true;
+	}
+	return false;
+}
+
+void agent_expr_free_list(struct agent_expr *expr)
+{
+	while (expr != NULL) {
+		struct agent_expr *next = expr->next;
+		free(expr->insns);
+		free(expr);
+		expr = next;
+	}
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_TARGET_AGENT_EXPR_H
+#define OPENOCD_TARGET_AGENT_EXPR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct target;
+struct agent_insn;
+
+/**
+ * A GDB agent expression (see "Agent Expressions" in the GDB manual),
+ * compiled for one target: jump offsets are turned into instruction
+ * indices and register numbers into register cache entries.
+ */
+struct agent_expr {
+	struct agent_insn *insns;
+	unsigned num_insns;
+	/* next condition of the same breakpoint */
+	struct agent_expr *next;
+};
+
+/**
+ * Compile @a length bytes of agent bytecode for @a target.
+ * Fails for malformed code and for operations that only make sense
+ * in tracepoints (trace, tracev, printf, state variables, floats).
+ */
+int agent_expr_compile(struct target *target, const uint8_t *bytecode,
+		unsigned length, struct agent_expr **expr);
+
+/** Run @a expr against the halted target's registers and memory. */
+int agent_expr_eval(struct target *target, const struct agent_expr *expr,
+		int64_t *result);
+
+/**
+ * Evaluate a list of breakpoint conditions. Returns true if any of them
+ * holds, or if one could not be evaluated, so that errors err on the
+ * side of stopping.
+ */
+bool agent_expr_list_true(struct target *target, const struct agent_expr *list);
+
+/** Free @a expr and every expression chained after it. */
+void agent_expr_free_list(struct agent_expr *expr);
+
+#endif /* OPENOCD_TARGET_AGENT_EXPR_H */
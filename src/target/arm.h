@@ -245,6 +245,8 @@ int arm_checksum_memory(struct target *target,
 		uint32_t address, uint32_t count, uint32_t *checksum);
 int arm_blank_check_memory(struct target *target,
 		uint32_t address, uint32_t count, uint32_t *blank, uint8_t erased_value);
+int arm_write_compressed(struct target *target,
+		uint32_t address, uint32_t size, const uint8_t *buffer);
 
 void arm_set_cpsr(struct arm *arm, uint32_t cpsr);
 struct reg *arm_reg_current(struct arm *arm, unsigned regnum);
@@ -909,6 +909,7 @@ struct target_type arm9tdmi_target = {
 
 	.checksum_memory = arm_checksum_memory,
 	.blank_check_memory = arm_blank_check_memory,
+	.write_compressed = arm_write_compressed,
 
 	.run_algorithm = armv4_5_run_algorithm,
 
@@ -77,6 +77,10 @@
 #include <helper/time_support.h>
 #include <helper/list.h>
 
+struct metric_family dap_acks_metric =
+	METRIC_COUNTER("openocd_dap_acks_total",
+		"DAP transactions answered with WAIT, or with FAULT or another error.", "ack");
+
 /* ARM ADI Specification requires at least 10 bits used for TAR autoincrement  */
 
 /*
@@ -88,6 +92,52 @@ static uint32_t max_tar_block_size(uint32_t tar_autoincr_block, uint32_t address
 	return tar_autoincr_block - ((tar_autoincr_block - 1) & address);
 }
 
+/* Number of transfers without WAIT before memaccess_tck is lowered again */
+#define MEMACCESS_TUNE_WINDOW	4096
+
+/**
+ * Adapt an AP's memaccess_tck after a run of queued transactions.
+ * A run stalled by WAIT raises the delay by half; a full window of
+ * transfers without WAIT lowers it by an eighth, but only when
+ * @a can_lower says the transport recovers from WAIT responses without
+ * failing the transfer.
+ */
+void mem_ap_tune_memaccess(struct adiv5_ap *ap, unsigned waits, bool can_lower)
+{
+	uint32_t tck = ap->memaccess_tck;
+
+	ap->wait_count += waits;
+
+	if (!ap->memaccess_auto)
+		return;
+
+	if (waits) {
+		tck = MIN(tck + MAX(tck / 2, 1u), ap->memaccess_max);
+	} else if (can_lower && ap->memaccess_transfers >= MEMACCESS_TUNE_WINDOW) {
+		tck = MAX(tck - MIN(MAX(tck / 8, 1u), tck), ap->memaccess_min);
+	} else {
+		return;
+	}
+
+	ap->memaccess_transfers = 0;
+	if (tck != ap->memaccess_tck) {
+		LOG_DEBUG("AP #%" PRIu8 ": memory access delay %" PRIu32 " -> %" PRIu32 " tck",
+				ap->ap_num, ap->memaccess_tck, tck);
+		ap->memaccess_tck = tck;
+	}
+}
+
+/* Bytes moved by the next DRW access: a whole word when a packed transfer
+ * fits before the end of the buffer and of the TAR auto-increment block. */
+static uint32_t mem_ap_drw_size(struct adiv5_ap *ap, uint32_t size, size_t nbytes,
+		uint32_t address, bool addrinc)
+{
+	if (addrinc && ap->packed_transfers && nbytes >= 4
+			&& max_tar_block_size(ap->tar_autoincr_block, address) >= 4)
+		return 4;
+	return size;
+}
+
 /***************************************************************************
  *                                                                         *
  * DP and MEM-AP  register access  through APACC and DPACC                 *
@@ -308,16 +358,13 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 		return retval;
 
 	while (nbytes > 0) {
-		uint32_t this_size = size;
+		uint32_t this_size = mem_ap_drw_size(ap, size, nbytes, address, addrinc);
 
 		/* Select packed transfer if possible */
-		if (addrinc && ap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(ap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
+		if (this_size != size)
 			retval = mem_ap_setup_csw(ap, csw_size | CSW_ADDRINC_PACKED);
-		} else {
+		else
 			retval = mem_ap_setup_csw(ap, csw_size | csw_addrincr);
-		}
 
 		if (retval != ERROR_OK)
 			break;
@@ -424,10 +471,16 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	if (ap->unaligned_access_bad && (adr % size != 0))
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
-	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
-	 * over-allocation if packed transfers are going to be used, but determining the real need at
-	 * this point would be messy. */
-	uint32_t *read_buf = malloc(count * sizeof(uint32_t));
+	/* Allocate buffer to hold the sequence of DRW reads that will be made. With packed
+	 * transfers that is about a quarter (8-bit) or half (16-bit) of count. */
+	uint32_t drw_count = 0;
+	for (size_t n = nbytes, a = address; n > 0; drw_count++) {
+		uint32_t this_size = mem_ap_drw_size(ap, size, n, a, addrinc);
+		n -= this_size;
+		a += this_size;
+	}
+
+	uint32_t *read_buf = malloc(drw_count * sizeof(uint32_t));
 	uint32_t *read_ptr = read_buf;
 	if (read_buf == NULL) {
 		LOG_ERROR("Failed to allocate read buffer");
@@ -444,16 +497,13 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	 * useful bytes it contains, and their location in the word, depends on the type of transfer
 	 * and alignment. */
 	while (nbytes > 0) {
-		uint32_t this_size = size;
+		uint32_t this_size = mem_ap_drw_size(ap, size, nbytes, address, addrinc);
 
 		/* Select packed transfer if possible */
-		if (addrinc && ap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(ap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
+		if (this_size != size)
 			retval = mem_ap_setup_csw(ap, csw_size | CSW_ADDRINC_PACKED);
-		} else {
+		else
 			retval = mem_ap_setup_csw(ap, csw_size | csw_addrincr);
-		}
 		if (retval != ERROR_OK)
 			break;
 
@@ -497,12 +547,7 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 
 	/* Replay loop to populate caller's buffer from the correct word and byte lane */
 	while (nbytes > 0) {
-		uint32_t this_size = size;
-
-		if (addrinc && ap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(ap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
-		}
+		uint32_t this_size = mem_ap_drw_size(ap, size, nbytes, address, addrinc);
 
 		if (dap->ti_be_32_quirks) {
 			switch (this_size) {
@@ -534,16 +579,57 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	return retval;
 }
 
+/* Some MEM-APs report packed AddrInc support at init but drop it later,
+ * e.g. after a power domain change. When a transfer that may have used
+ * packed mode fails, repeat the CSW readback probe from mem_ap_init().
+ * Only if CSW no longer holds the packed setting are packed transfers
+ * disabled; any other failure (WAIT timeout, bus fault, link error) is
+ * returned unchanged. Returns true if the AP stopped packing. */
+static bool mem_ap_packed_unsupported(struct adiv5_ap *ap, uint32_t size, uint32_t count)
+{
+	uint32_t csw;
+
+	if (!ap->packed_transfers || size == 4 || size * count < 4)
+		return false;
+
+	/* force the CSW write, the cached value may not match after a fault */
+	ap->csw_value = 0;
+	if (mem_ap_setup_csw(ap, CSW_8BIT | CSW_ADDRINC_PACKED) != ERROR_OK
+			|| dap_queue_ap_read(ap, MEM_AP_REG_CSW, &csw) != ERROR_OK
+			|| dap_run(ap->dap) != ERROR_OK)
+		return false;
+
+	if (csw & CSW_ADDRINC_PACKED)
+		return false;
+
+	LOG_WARNING("MEM-AP #%" PRIu8 " no longer accepts packed transfers, disabling them",
+			ap->ap_num);
+	ap->packed_transfers = false;
+	return true;
+}
+
 int mem_ap_read_buf(struct adiv5_ap *ap,
 		uint8_t *buffer, uint32_t size, uint32_t count, uint32_t address)
 {
-	return mem_ap_read(ap, buffer, size, count, address, true);
+	int retval = mem_ap_read(ap, buffer, size, count, address, true);
+
+	/* reads have no side effects on memory, so retry them unpacked */
+	if (retval != ERROR_OK && mem_ap_packed_unsupported(ap, size, count))
+		retval = mem_ap_read(ap, buffer, size, count, address, true);
+
+	return retval;
 }
 
 int mem_ap_write_buf(struct adiv5_ap *ap,
 		const uint8_t *buffer, uint32_t size, uint32_t count, uint32_t address)
 {
-	return mem_ap_write(ap, buffer, size, count, address, true);
+	int retval = mem_ap_write(ap, buffer, size, count, address, true);
+
+	/* a failed write is never re-issued, later ones go unpacked */
+	if (retval != ERROR_OK)
+		mem_ap_packed_unsupported(ap, size, count);
+
+	return retval;
 }
 
 int mem_ap_read_buf_noincr(struct adiv5_ap *ap,
@@ -583,10 +669,12 @@ struct adiv5_dap *dap_init(void)
 		dap->ap[i].ap_num = i;
 		/* memaccess_tck max is 255 */
 		dap->ap[i].memaccess_tck = 255;
+		dap->ap[i].memaccess_max = 255;
 		/* Number of bits for tar autoincrement, impl. dep. at least 10 */
 		dap->ap[i].tar_autoincr_block = (1<<10);
 	}
 	INIT_LIST_HEAD(&dap->cmd_journal);
+	INIT_LIST_HEAD(&dap->cmd_pool);
 	return dap;
 }
 
@@ -1337,12 +1425,32 @@ static int dap_info_command(struct command_context *cmd_ctx,
 		break;
 	}
 
+	if (ap->dap->ops == &jtag_dp_ops) {
+		struct adiv5_dap *dap = ap->dap;
+		command_print(cmd_ctx, "JTAG-DP journal: %" PRIu32 " entries allocated, %" PRIu64 " reused",
+				dap->journal_allocated, dap->journal_reused);
+		command_print(cmd_ctx, "JTAG-DP IR scans: %" PRIu64 " issued, %" PRIu64 " skipped",
+				dap->ir_scans, dap->ir_scans_skipped);
+	}
+
 	/* NOTE: a MEM-AP may have a single CoreSight component that's
 	 * not a ROM table ... or have no such components at all.
 	 */
 	mem_ap = (apid & IDR_CLASS) == AP_CLASS_MEM_AP;
 	if (mem_ap) {
 		command_print(cmd_ctx, "MEM-AP BASE 0x%8.8" PRIx32, dbgbase);
+		command_print(cmd_ctx, "\tPacked 8/16-bit transfers %s",
+				ap->packed_transfers ? "enabled" : "disabled");
+		command_print(cmd_ctx, "\tTAR autoincrement block %" PRIu32 " bytes",
+				ap->tar_autoincr_block);
+		if (ap->memaccess_auto)
+			command_print(cmd_ctx, "\tMemory access delay %" PRIu32 " tck "
+					"(auto %" PRIu32 "-%" PRIu32 "), %" PRIu64 " runs stalled by WAIT",
+					ap->memaccess_tck, ap->memaccess_min, ap->memaccess_max,
+					ap->wait_count);
+		else
+			command_print(cmd_ctx, "\tMemory access delay %" PRIu32 " tck, %" PRIu64 " runs stalled by WAIT",
+					ap->memaccess_tck, ap->wait_count);
 
 		if (dbgbase == 0xFFFFFFFF || (dbgbase & 0x3) == 0x2) {
 			command_print(cmd_ctx, "\tNo ROM table present");
@@ -1462,23 +1570,55 @@ COMMAND_HANDLER(dap_memaccess_command)
 	struct target *target = get_current_target(CMD_CTX);
 	struct arm *arm = target_to_arm(target);
 	struct adiv5_dap *dap = arm->dap;
+	struct adiv5_ap *ap = &dap->ap[dap->apsel];
 
 	uint32_t memaccess_tck;
 
-	switch (CMD_ARGC) {
-	case 0:
-		memaccess_tck = dap->ap[dap->apsel].memaccess_tck;
-		break;
-	case 1:
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], memaccess_tck);
-		break;
-	default:
-		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC >= 1 && strcmp(CMD_ARGV[0], "auto") == 0) {
+		uint32_t min = 0, max = 255;
+
+		switch (CMD_ARGC) {
+		case 1:
+			break;
+		case 3:
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], min);
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], max);
+			if (min > max)
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			break;
+		default:
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		ap->memaccess_auto = true;
+		ap->memaccess_min = min;
+		ap->memaccess_max = max;
+		ap->memaccess_transfers = 0;
+		/* start low, SWD-DP only ever raises the delay */
+		ap->memaccess_tck = min;
+	} else {
+		switch (CMD_ARGC) {
+		case 0:
+			memaccess_tck = ap->memaccess_tck;
+			break;
+		case 1:
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], memaccess_tck);
+			/* a fixed value pins the delay */
+			ap->memaccess_auto = false;
+			break;
+		default:
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		ap->memaccess_tck = memaccess_tck;
 	}
-	dap->ap[dap->apsel].memaccess_tck = memaccess_tck;
 
-	command_print(CMD_CTX, "memory bus access delay set to %" PRIi32 " tck",
-			dap->ap[dap->apsel].memaccess_tck);
+	if (ap->memaccess_auto)
+		command_print(CMD_CTX, "memory bus access delay set to %" PRIi32 " tck "
+				"(auto, %" PRIu32 "-%" PRIu32 ")",
+				ap->memaccess_tck, ap->memaccess_min, ap->memaccess_max);
+	else
+		command_print(CMD_CTX, "memory bus access delay set to %" PRIi32 " tck",
+				ap->memaccess_tck);
 
 	return ERROR_OK;
 }
@@ -1708,8 +1848,8 @@ static const struct command_registration dap_commands[] = {
 		.handler = dap_memaccess_command,
 		.mode = COMMAND_EXEC,
 		.help = "set/get number of extra tck for MEM-AP memory "
-			"bus access [0-255]",
-		.usage = "[cycles]",
+			"bus access [0-255], or let it adapt to WAIT responses",
+		.usage = "[cycles | 'auto' [min max]]",
 	},
 	{
 		.name = "ti_be_32_quirks",
@@ -30,6 +30,8 @@
  */
 
 #include <helper/list.h>
+#include <helper/metrics.h>
+#include <helper/timeline.h>
 #include "arm_jtag.h"
 
 /* three-bit ACK values for SWD access (sent LSB first) */
@@ -172,6 +174,19 @@ struct adiv5_ap {
 	 */
 	uint32_t memaccess_tck;
 
+	/**
+	 * Adaptive memaccess_tck: raised when the AP answers WAIT and, where
+	 * the transport recovers from WAIT by itself, lowered again after a
+	 * run of transfers without any. See mem_ap_tune_memaccess().
+	 */
+	bool memaccess_auto;
+	uint32_t memaccess_min;
+	uint32_t memaccess_max;
+	/* memory transfers queued since the last adjustment */
+	uint32_t memaccess_transfers;
+	/* runs of queued transactions stalled by WAIT on this AP */
+	uint64_t wait_count;
+
 	/* Size of TAR autoincrement block, ARM ADI Specification requires at least 10 bits */
 	uint32_t tar_autoincr_block;
 
@@ -204,6 +219,17 @@ struct adiv5_dap {
 
 	/* dap transaction list for WAIT support */
 	struct list_head cmd_journal;
+	/* AP of the most recently queued AP access, for WAIT accounting */
+	struct adiv5_ap *last_ap;
+
+	/* recycled journal entries, see adi_v5_jtag.c */
+	struct list_head cmd_pool;
+
+	/* JTAG-DP journal and scan statistics, shown by "dap info" */
+	uint32_t journal_allocated;
+	uint64_t journal_reused;
+	uint64_t ir_scans;
+	uint64_t ir_scans_skipped;
 
 	struct jtag_tap *tap;
 	/* Control config */
@@ -392,8 +418,15 @@ static inline int dap_queue_ap_abort(struct adiv5_dap *dap, uint8_t *ack)
  */
 static inline int dap_run(struct adiv5_dap *dap)
 {
+	struct timeline_span span;
+	int retval;
+
 	assert(dap->ops != NULL);
-	return dap->ops->run(dap);
+	timeline_begin(&span);
+	retval = dap->ops->run(dap);
+	timeline_end(&span, "dap", "dap_run", NULL);
+
+	return retval;
 }
 
 static inline int dap_sync(struct adiv5_dap *dap)
@@ -445,6 +478,16 @@ static inline int dap_dp_poll_register(struct adiv5_dap *dap, unsigned reg,
 	}
 }
 
+/* Count a queued AP access towards the memaccess_tck tuning window. */
+static inline void mem_ap_count_access(struct adiv5_ap *ap, unsigned reg)
+{
+	ap->dap->last_ap = ap;
+	if (reg == MEM_AP_REG_DRW || (reg & 0xF0) == MEM_AP_REG_BD0)
+		ap->memaccess_transfers++;
+}
+
+void mem_ap_tune_memaccess(struct adiv5_ap *ap, unsigned waits, bool can_lower);
+
 /* Queued MEM-AP memory mapped single word transfers. */
 int mem_ap_read_u32(struct adiv5_ap *ap,
 		uint32_t address, uint32_t *value);
@@ -504,6 +547,9 @@ int dap_to_jtag(struct target *target);
 
 extern const struct command_registration dap_command_handlers[];
 
+/* WAIT and FAULT responses, counted by the transports */
+extern struct metric_family dap_acks_metric;
+
 struct adiv5_private_config {
 	int ap_num;
 };
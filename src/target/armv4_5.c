@@ -34,6 +34,7 @@
 #include <helper/binarybuffer.h>
 #include "algorithm.h"
 #include "register.h"
+#include <helper/lz4.h>
 
 /* offsets into armv4_5 core register cache */
 enum {
@@ -1522,6 +1523,163 @@ cleanup:
 	return retval;
 }
 
+/**
+ * Writes a RAM block by downloading it LZ4 compressed and decompressing
+ * it with ARM code in the target.
+ *
+ * Classic ARM cores can't access memory while running, so the stub's
+ * fifo is filled with a whole compressed chunk before each run instead
+ * of being streamed like target_run_flash_async_algorithm() does.
+ */
+int arm_write_compressed(struct target *target,
+	uint32_t address, uint32_t size, const uint8_t *buffer)
+{
+	struct working_area *lz4_algorithm;
+	struct working_area *fifo;
+	struct arm_algorithm arm_algo;
+	struct arm *arm = target_to_arm(target);
+	struct reg_param reg_params[4];
+	uint32_t fifo_size = 16384;
+	uint32_t data_size, chunk, max_chunk, budget;
+	size_t lz4_size;
+	uint8_t *lz4;
+	int retval;
+	uint32_t i;
+	uint32_t exit_var = 0;
+
+	static const uint8_t arm_lz4_code_le[] = {
+#include "../../contrib/loaders/compress/armv4_5_lz4.inc"
+	};
+
+	assert(sizeof(arm_lz4_code_le) % 4 == 0);
+
+	if (target_alloc_working_area(target, sizeof(arm_lz4_code_le),
+			&lz4_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	while (target_alloc_working_area_try(target, fifo_size, &fifo) != ERROR_OK) {
+		fifo_size /= 2;
+		if (fifo_size <= 256) {
+			target_free_working_area(target, lz4_algorithm);
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+	}
+
+	/* the stub must not overwrite itself or its fifo */
+	if (address < target->working_area + target->working_area_size
+			&& target->working_area < address + size) {
+		LOG_DEBUG("data at 0x%08" PRIx32 " overlaps the working area", address);
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto free_fifo;
+	}
+
+	/* first two words of the fifo are the write and read pointers */
+	data_size = fifo->size - 8;
+	max_chunk = 4 * data_size;
+
+	lz4 = malloc(data_size);
+	if (lz4 == NULL) {
+		LOG_ERROR("error allocating buffer for compressed data (%" PRIu32 " bytes)", data_size);
+		retval = ERROR_FAIL;
+		goto free_fifo;
+	}
+
+	/* convert code into a buffer in target endianness */
+	for (i = 0; i < ARRAY_SIZE(arm_lz4_code_le) / 4; i++) {
+		retval = target_write_u32(target,
+				lz4_algorithm->address + i * sizeof(uint32_t),
+				le_to_h_u32(&arm_lz4_code_le[i * 4]));
+		if (retval != ERROR_OK)
+			goto free_lz4;
+	}
+
+	arm_algo.common_magic = ARM_COMMON_MAGIC;
+	arm_algo.core_mode = ARM_MODE_SVC;
+	arm_algo.core_state = ARM_STATE_ARM;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);	/* fifo start */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* fifo end */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_IN_OUT);	/* destination */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* destination end */
+
+	/* armv4 must exit using a hardware breakpoint */
+	if (arm->is_armv4)
+		exit_var = lz4_algorithm->address + sizeof(arm_lz4_code_le) - 4;
+
+	chunk = max_chunk;
+	while (size > 0) {
+		if (chunk > size)
+			chunk = size;
+
+		/* not worth it unless an eighth of the transfer is saved */
+		budget = chunk - chunk / 8;
+		if (budget > data_size)
+			budget = data_size;
+
+		if (lz4_compress(buffer, chunk, lz4, budget, &lz4_size) != ERROR_OK) {
+			if (chunk > data_size) {
+				/* retry with a chunk more likely to fit */
+				chunk /= 2;
+				continue;
+			}
+
+			retval = target_write_buffer(target, address, chunk, buffer);
+			if (retval != ERROR_OK)
+				break;
+		} else {
+			retval = target_write_buffer(target, fifo->address + 8, lz4_size, lz4);
+			if (retval != ERROR_OK)
+				break;
+			retval = target_write_u32(target, fifo->address, fifo->address + 8 + lz4_size);
+			if (retval != ERROR_OK)
+				break;
+			retval = target_write_u32(target, fifo->address + 4, fifo->address + 8);
+			if (retval != ERROR_OK)
+				break;
+
+			/* the whole chunk is in the fifo, so the stub never wraps */
+			buf_set_u32(reg_params[0].value, 0, 32, fifo->address);
+			buf_set_u32(reg_params[1].value, 0, 32, fifo->address + fifo->size);
+			buf_set_u32(reg_params[2].value, 0, 32, address);
+			buf_set_u32(reg_params[3].value, 0, 32, address + chunk);
+
+			retval = target_run_algorithm(target, 0, NULL, 4, reg_params,
+					lz4_algorithm->address,
+					exit_var,
+					1000, &arm_algo);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("error executing ARM lz4 decompressor");
+				break;
+			}
+
+			if (buf_get_u32(reg_params[2].value, 0, 32) != address + chunk) {
+				LOG_ERROR("lz4 decompressor stopped at 0x%08" PRIx32 ", expected 0x%08" PRIx32,
+						buf_get_u32(reg_params[2].value, 0, 32), address + chunk);
+				retval = ERROR_FAIL;
+				break;
+			}
+		}
+
+		address += chunk;
+		buffer += chunk;
+		size -= chunk;
+		chunk = max_chunk;
+	}
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+	destroy_reg_param(&reg_params[3]);
+
+free_lz4:
+	free(lz4);
+free_fifo:
+	target_free_working_area(target, fifo);
+	target_free_working_area(target, lz4_algorithm);
+
+	return retval;
+}
+
 /**
  * Runs ARM code in the target to check whether a memory block holds
  * all ones.  NOR flash which has been erased, and thus may be written,
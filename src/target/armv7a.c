@@ -175,19 +175,96 @@ done:
 	return retval;
 }
 
-/*  method adapted to Cortex-A : reused ARM v4 v5 method */
-int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
+/**
+ * Drop every cached translation together with the cached TTBCR/TTBR
+ * values. Must be called whenever the core may have changed its
+ * translation tables: on resume, reset, TTBR/TTBCR writes from the
+ * debugger, or explicitly through "mmu flush".
+ */
+void armv7a_mmu_tlb_flush(struct armv7a_common *armv7a)
+{
+	struct armv7a_tlb *tlb = &armv7a->armv7a_mmu.tlb;
+	int i;
+
+	for (i = 0; i < ARMV7A_TLB_ENTRIES; i++)
+		tlb->entry[i].valid = false;
+	tlb->regs_valid = false;
+	tlb->next_victim = 0;
+	tlb->flushes++;
+}
+
+static int armv7a_mmu_tlb_mcr(struct target *target, int cpnum,
+	uint32_t op1, uint32_t op2, uint32_t CRn, uint32_t CRm, uint32_t value)
 {
-	uint32_t first_lvl_descriptor = 0x0;
-	uint32_t second_lvl_descriptor = 0x0;
-	int retval;
 	struct armv7a_common *armv7a = target_to_armv7a(target);
+
+	/* c2,c0: TTBR0, TTBR1 and TTBCR */
+	if (cpnum == 15 && op1 == 0 && CRn == 2 && CRm == 0)
+		armv7a_mmu_tlb_flush(armv7a);
+
+	return armv7a->armv7a_mmu.mcr(target, cpnum, op1, op2, CRn, CRm, value);
+}
+
+/**
+ * Hook the translation cache into the coprocessor write path. Must be
+ * called once arm->mcr has been set up, i.e. after arm_dpm_setup().
+ */
+void armv7a_mmu_tlb_setup(struct armv7a_common *armv7a)
+{
+	struct arm *arm = &armv7a->arm;
+
+	if (arm->mcr == armv7a_mmu_tlb_mcr)
+		return;
+
+	armv7a->armv7a_mmu.mcr = arm->mcr;
+	arm->mcr = armv7a_mmu_tlb_mcr;
+	armv7a_mmu_tlb_flush(armv7a);
+	armv7a->armv7a_mmu.tlb.flushes = 0;
+}
+
+static bool armv7a_mmu_tlb_lookup(struct armv7a_tlb *tlb, uint32_t ttb,
+	uint32_t va, uint32_t *val)
+{
+	int i;
+
+	for (i = 0; i < ARMV7A_TLB_ENTRIES; i++) {
+		struct armv7a_tlb_entry *e = &tlb->entry[i];
+
+		if (e->valid && e->ttb == ttb && (va & ~e->offset_mask) == e->va) {
+			*val = e->pa | (va & e->offset_mask);
+			tlb->hits++;
+			return true;
+		}
+	}
+
+	tlb->misses++;
+	return false;
+}
+
+static void armv7a_mmu_tlb_insert(struct armv7a_tlb *tlb, uint32_t ttb,
+	uint32_t va, uint32_t pa, uint32_t offset_mask)
+{
+	struct armv7a_tlb_entry *e = &tlb->entry[tlb->next_victim];
+
+	e->ttb = ttb;
+	e->va = va & ~offset_mask;
+	e->pa = pa & ~offset_mask;
+	e->offset_mask = offset_mask;
+	e->valid = true;
+
+	tlb->next_victim = (tlb->next_victim + 1) % ARMV7A_TLB_ENTRIES;
+}
+
+/* read TTBCR, TTBR0 and TTBR1 once per halt */
+static int armv7a_mmu_tlb_read_regs(struct target *target)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	struct armv7a_tlb *tlb = &armv7a->armv7a_mmu.tlb;
 	struct arm_dpm *dpm = armv7a->arm.dpm;
-	uint32_t ttbidx = 0;	/*  default to ttbr0 */
-	uint32_t ttb_mask;
-	uint32_t va_mask;
-	uint32_t ttbcr;
-	uint32_t ttb;
+	int retval;
+
+	if (tlb->regs_valid)
+		return ERROR_OK;
 
 	retval = dpm->prepare(dpm);
 	if (retval != ERROR_OK)
@@ -196,13 +273,51 @@ int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 	/*  MRC p15,0,<Rt>,c2,c0,2 ; Read CP15 Translation Table Base Control Register*/
 	retval = dpm->instr_read_data_r0(dpm,
 			ARMV4_5_MRC(15, 0, 0, 2, 0, 2),
-			&ttbcr);
+			&tlb->ttbcr);
 	if (retval != ERROR_OK)
 		goto done;
 
+	/*  MRC p15,0,<Rt>,c2,c0,0 ; Read CP15 Translation Table Base Register 0 */
+	retval = dpm->instr_read_data_r0(dpm,
+			ARMV4_5_MRC(15, 0, 0, 2, 0, 0),
+			&tlb->ttbr[0]);
+	if (retval != ERROR_OK)
+		goto done;
+
+	/*  MRC p15,0,<Rt>,c2,c0,1 ; Read CP15 Translation Table Base Register 1 */
+	retval = dpm->instr_read_data_r0(dpm,
+			ARMV4_5_MRC(15, 0, 0, 2, 0, 1),
+			&tlb->ttbr[1]);
+	if (retval != ERROR_OK)
+		goto done;
+
+	tlb->regs_valid = true;
+
+done:
+	dpm->finish(dpm);
+	return retval;
+}
+
+/*  method adapted to Cortex-A : reused ARM v4 v5 method */
+int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
+{
+	uint32_t first_lvl_descriptor = 0x0;
+	uint32_t second_lvl_descriptor = 0x0;
+	int retval;
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	struct armv7a_tlb *tlb = &armv7a->armv7a_mmu.tlb;
+	uint32_t ttbidx = 0;	/*  default to ttbr0 */
+	uint32_t ttb_mask;
+	uint32_t va_mask;
+	uint32_t ttb;
+
+	retval = armv7a_mmu_tlb_read_regs(target);
+	if (retval != ERROR_OK)
+		return retval;
+
 	/* if ttbcr has changed or was not read before, re-read the information */
 	if ((armv7a->armv7a_mmu.cached == 0) ||
-		(armv7a->armv7a_mmu.ttbcr != ttbcr)) {
+		(armv7a->armv7a_mmu.ttbcr != tlb->ttbcr)) {
 		armv7a_read_ttbcr(target);
 	}
 
@@ -211,20 +326,18 @@ int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 		/*  select ttb 1 */
 		ttbidx = 1;
 	}
-	/*  MRC p15,0,<Rt>,c2,c0,ttbidx */
-	retval = dpm->instr_read_data_r0(dpm,
-			ARMV4_5_MRC(15, 0, 0, 2, 0, ttbidx),
-			&ttb);
-	if (retval != ERROR_OK)
-		return retval;
 
 	ttb_mask = armv7a->armv7a_mmu.ttbr_mask[ttbidx];
 	va_mask = 0xfff00000 & armv7a->armv7a_mmu.ttbr_range[ttbidx];
+	ttb = tlb->ttbr[ttbidx] & ttb_mask;
+
+	if (armv7a_mmu_tlb_lookup(tlb, ttb, va, val))
+		return ERROR_OK;
 
 	LOG_DEBUG("ttb_mask %" PRIx32 " va_mask %" PRIx32 " ttbidx %i",
 		  ttb_mask, va_mask, ttbidx);
 	retval = armv7a->armv7a_mmu.read_physical_memory(target,
-			(ttb & ttb_mask) | ((va & va_mask) >> 18),
+			ttb | ((va & va_mask) >> 18),
 			4, 1, (uint8_t *)&first_lvl_descriptor);
 	if (retval != ERROR_OK)
 		return retval;
@@ -242,6 +355,7 @@ int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 	if ((first_lvl_descriptor & 0x40002) == 2) {
 		/* section descriptor */
 		*val = (first_lvl_descriptor & 0xfff00000) | (va & 0x000fffff);
+		armv7a_mmu_tlb_insert(tlb, ttb, va, *val, 0x000fffff);
 		return ERROR_OK;
 	} else if ((first_lvl_descriptor & 0x40002) == 0x40002) {
 		/* supersection descriptor */
@@ -250,6 +364,7 @@ int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 			return ERROR_TARGET_TRANSLATION_FAULT;
 		}
 		*val = (first_lvl_descriptor & 0xff000000) | (va & 0x00ffffff);
+		armv7a_mmu_tlb_insert(tlb, ttb, va, *val, 0x00ffffff);
 		return ERROR_OK;
 	}
 
@@ -273,15 +388,14 @@ int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val)
 	if ((second_lvl_descriptor & 0x3) == 1) {
 		/* large page descriptor */
 		*val = (second_lvl_descriptor & 0xffff0000) | (va & 0x0000ffff);
+		armv7a_mmu_tlb_insert(tlb, ttb, va, *val, 0x0000ffff);
 	} else {
 		/* small page descriptor */
 		*val = (second_lvl_descriptor & 0xfffff000) | (va & 0x00000fff);
+		armv7a_mmu_tlb_insert(tlb, ttb, va, *val, 0x00000fff);
 	}
 
 	return ERROR_OK;
-
-done:
-	return retval;
 }
 
 /*  V7 method VA TO PA  */
@@ -784,10 +898,80 @@ const struct command_registration l2x_cache_command_handlers[] = {
 	COMMAND_REGISTRATION_DONE
 };
 
+COMMAND_HANDLER(handle_mmu_flush_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+
+	if (!is_armv7a(armv7a)) {
+		command_print(CMD_CTX, "current target isn't an ARMv7-A/R target");
+		return ERROR_TARGET_INVALID;
+	}
+
+	armv7a_mmu_tlb_flush(armv7a);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mmu_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	struct armv7a_tlb *tlb;
+	int i, used = 0;
+
+	if (!is_armv7a(armv7a)) {
+		command_print(CMD_CTX, "current target isn't an ARMv7-A/R target");
+		return ERROR_TARGET_INVALID;
+	}
+
+	tlb = &armv7a->armv7a_mmu.tlb;
+	for (i = 0; i < ARMV7A_TLB_ENTRIES; i++) {
+		if (tlb->entry[i].valid)
+			used++;
+	}
+
+	command_print(CMD_CTX, "translation cache: %d/%d entries, %" PRIu32 " hits, "
+			"%" PRIu32 " misses, %" PRIu32 " flushes",
+			used, ARMV7A_TLB_ENTRIES, tlb->hits, tlb->misses, tlb->flushes);
+	return ERROR_OK;
+}
+
+static const struct command_registration armv7a_mmu_commands[] = {
+	{
+		.name = "flush",
+		.handler = handle_mmu_flush_command,
+		.mode = COMMAND_EXEC,
+		.help = "discard cached virtual to physical translations",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.handler = handle_mmu_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "display translation cache statistics",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration armv7a_mmu_command_handlers[] = {
+	{
+		.name = "mmu",
+		.mode = COMMAND_ANY,
+		.help = "MMU translation cache commands",
+		.usage = "",
+		.chain = armv7a_mmu_commands,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 const struct command_registration armv7a_command_handlers[] = {
 	{
 		.chain = dap_command_handlers,
 	},
+	{
+		.chain = armv7a_mmu_command_handlers,
+	},
 	{
 		.chain = l2x_cache_command_handlers,
 	},
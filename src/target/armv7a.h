@@ -83,6 +83,30 @@ struct armv7a_cache_common {
 	int (*flush_all_data_cache)(struct target *target);
 };
 
+/* host side translation cache used by armv7a_mmu_translate_va() */
+#define ARMV7A_TLB_ENTRIES 64
+
+struct armv7a_tlb_entry {
+	uint32_t ttb;		/* translation table base the entry was walked from */
+	uint32_t va;		/* virtual base of the mapping */
+	uint32_t pa;		/* physical base of the mapping */
+	uint32_t offset_mask;	/* 0xfff, 0xffff, 0xfffff or 0xffffff */
+	bool valid;
+};
+
+struct armv7a_tlb {
+	/* TTBCR, TTBR0 and TTBR1 as read once per halt */
+	bool regs_valid;
+	uint32_t ttbcr;
+	uint32_t ttbr[2];
+	struct armv7a_tlb_entry entry[ARMV7A_TLB_ENTRIES];
+	unsigned next_victim;
+	/* statistics, reported by "mmu stats" */
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t flushes;
+};
+
 struct armv7a_mmu_common {
 	/* following field mmu working way */
 	int32_t cached;     /* 0: not initialized, 1: initialized */
@@ -94,6 +118,13 @@ struct armv7a_mmu_common {
 			uint32_t count, uint8_t *buffer);
 	struct armv7a_cache_common armv7a_cache;
 	uint32_t mmu_enabled;
+
+	struct armv7a_tlb tlb;
+	/* coprocessor write routine wrapped to catch TTBR/TTBCR updates */
+	int (*mcr)(struct target *target, int cpnum,
+			uint32_t op1, uint32_t op2,
+			uint32_t CRn, uint32_t CRm,
+			uint32_t value);
 };
 
 struct armv7a_common {
@@ -190,6 +221,8 @@ int armv7a_init_arch_info(struct target *target, struct armv7a_common *armv7a);
 int armv7a_mmu_translate_va_pa(struct target *target, uint32_t va,
 		uint32_t *val, int meminfo);
 int armv7a_mmu_translate_va(struct target *target,  uint32_t va, uint32_t *val);
+void armv7a_mmu_tlb_setup(struct armv7a_common *armv7a);
+void armv7a_mmu_tlb_flush(struct armv7a_common *armv7a);
 
 int armv7a_handle_cache_info_command(struct command_context *cmd_ctx,
 		struct armv7a_cache_common *armv7a_cache);
@@ -37,6 +37,7 @@
 #include "armv7m.h"
 #include "algorithm.h"
 #include "register.h"
+#include <helper/lz4.h>
 
 #if 0
 #define _DEBUG_INSTRUCTION_EXECUTION_
@@ -146,6 +147,12 @@ int armv7m_restore_context(struct target *target)
 	if (armv7m->pre_restore_context)
 		armv7m->pre_restore_context(target);
 
+	if (armv7m->store_dirty_core_regs) {
+		int retval = armv7m->store_dirty_core_regs(target);
+		if (retval != ERROR_OK)
+			LOG_DEBUG("batched register restore failed, falling back");
+	}
+
 	for (i = cache->num_regs - 1; i >= 0; i--) {
 		if (cache->reg_list[i].dirty) {
 			armv7m->arm.write_core_reg(target, &cache->reg_list[i], i,
@@ -731,6 +738,113 @@ cleanup:
 	return retval;
 }
 
+/**
+ * Writes a RAM block by streaming it LZ4 compressed through the fifo of
+ * target_run_flash_async_algorithm() to a decompressor stub.
+ */
+int armv7m_write_compressed(struct target *target,
+	uint32_t address, uint32_t size, const uint8_t *buffer)
+{
+	struct working_area *lz4_algorithm;
+	struct working_area *fifo;
+	struct armv7m_algorithm armv7m_info;
+	struct reg_param reg_params[4];
+	uint32_t fifo_size = 16384;
+	size_t lz4_size;
+	uint8_t *lz4;
+	int retval;
+
+	static const uint8_t cortex_m_lz4_code[] = {
+#include "../../contrib/loaders/compress/armv7m_lz4.inc"
+	};
+
+	lz4 = malloc(size);
+	if (lz4 == NULL) {
+		LOG_ERROR("error allocating buffer for compressed data (%" PRIu32 " bytes)", size);
+		return ERROR_FAIL;
+	}
+
+	/* not worth it unless an eighth of the transfer is saved */
+	retval = lz4_compress(buffer, size, lz4, size - size / 8, &lz4_size);
+	if (retval != ERROR_OK) {
+		LOG_DEBUG("data at 0x%08" PRIx32 " doesn't compress, writing it as is", address);
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto free_lz4;
+	}
+
+	if (target_alloc_working_area(target, sizeof(cortex_m_lz4_code),
+			&lz4_algorithm) != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto free_lz4;
+	}
+
+	while (target_alloc_working_area_try(target, fifo_size, &fifo) != ERROR_OK) {
+		fifo_size /= 2;
+		if (fifo_size <= 256) {
+			retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+			goto free_algorithm;
+		}
+	}
+
+	/* the stub must not overwrite itself or its fifo */
+	if (address < target->working_area + target->working_area_size
+			&& target->working_area < address + size) {
+		LOG_DEBUG("data at 0x%08" PRIx32 " overlaps the working area", address);
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto free_fifo;
+	}
+
+	retval = target_write_buffer(target, lz4_algorithm->address,
+			sizeof(cortex_m_lz4_code), cortex_m_lz4_code);
+	if (retval != ERROR_OK)
+		goto free_fifo;
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);	/* fifo start */
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);	/* fifo end */
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_IN_OUT);	/* destination */
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* destination end */
+
+	buf_set_u32(reg_params[0].value, 0, 32, fifo->address);
+	buf_set_u32(reg_params[1].value, 0, 32, fifo->address + fifo->size);
+	buf_set_u32(reg_params[2].value, 0, 32, address);
+	buf_set_u32(reg_params[3].value, 0, 32, address + size);
+
+	retval = target_run_flash_async_algorithm(target, lz4, lz4_size, 1,
+			0, NULL, 4, reg_params,
+			fifo->address, fifo->size,
+			lz4_algorithm->address,
+			lz4_algorithm->address + sizeof(cortex_m_lz4_code) - 2,
+			&armv7m_info);
+
+	if (retval != ERROR_OK) {
+		LOG_ERROR("error executing cortex_m lz4 decompressor");
+	} else if (buf_get_u32(reg_params[2].value, 0, 32) != address + size) {
+		LOG_ERROR("lz4 decompressor stopped at 0x%08" PRIx32 ", expected 0x%08" PRIx32,
+				buf_get_u32(reg_params[2].value, 0, 32), address + size);
+		retval = ERROR_FAIL;
+	} else {
+		LOG_DEBUG("wrote %" PRIu32 " bytes at 0x%08" PRIx32 " compressed to %zu",
+				size, address, lz4_size);
+	}
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+	destroy_reg_param(&reg_params[3]);
+
+free_fifo:
+	target_free_working_area(target, fifo);
+free_algorithm:
+	target_free_working_area(target, lz4_algorithm);
+free_lz4:
+	free(lz4);
+
+	return retval;
+}
+
 /** Checks whether a memory region is erased. */
 int armv7m_blank_check_memory(struct target *target,
 	uint32_t address, uint32_t count, uint32_t *blank, uint8_t erased_value)
@@ -161,6 +161,9 @@ struct armv7m_common {
 	/* Direct processor core register read and writes */
 	int (*load_core_reg_u32)(struct target *target, uint32_t num, uint32_t *value);
 	int (*store_core_reg_u32)(struct target *target, uint32_t num, uint32_t value);
+	/* Optional: write back all dirty core registers at once, leaving
+	 * dirty whatever it could not confirm */
+	int (*store_dirty_core_regs)(struct target *target);
 
 	int (*examine_debug_reason)(struct target *target);
 	int (*post_debug_entry)(struct target *target);
@@ -226,6 +229,8 @@ int armv7m_checksum_memory(struct target *target,
 		uint32_t address, uint32_t count, uint32_t *checksum);
 int armv7m_blank_check_memory(struct target *target,
 		uint32_t address, uint32_t count, uint32_t *blank, uint8_t erased_value);
+int armv7m_write_compressed(struct target *target,
+		uint32_t address, uint32_t size, const uint8_t *buffer);
 
 int armv7m_maybe_skip_bkpt_inst(struct target *target, bool *inst_found);
 
@@ -26,6 +26,7 @@
 #include "target.h"
 #include <helper/log.h>
 #include "breakpoints.h"
+#include "agent_expr.h"
 
 static const char * const breakpoint_type_strings[] = {
 	"hardware",
@@ -74,6 +75,7 @@ int breakpoint_add_internal(struct target *target,
 	(*breakpoint_p)->length = length;
 	(*breakpoint_p)->type = type;
 	(*breakpoint_p)->set = 0;
+	(*breakpoint_p)->cond = NULL;
 	(*breakpoint_p)->orig_instr = malloc(length);
 	(*breakpoint_p)->next = NULL;
 	(*breakpoint_p)->unique_id = bpwp_unique_id++;
@@ -138,6 +140,7 @@ int context_breakpoint_add_internal(struct target *target,
 	(*breakpoint_p)->length = length;
 	(*breakpoint_p)->type = type;
 	(*breakpoint_p)->set = 0;
+	(*breakpoint_p)->cond = NULL;
 	(*breakpoint_p)->orig_instr = malloc(length);
 	(*breakpoint_p)->next = NULL;
 	(*breakpoint_p)->unique_id = bpwp_unique_id++;
@@ -194,6 +197,7 @@ int hybrid_breakpoint_add_internal(struct target *target,
 	(*breakpoint_p)->length = length;
 	(*breakpoint_p)->type = type;
 	(*breakpoint_p)->set = 0;
+	(*breakpoint_p)->cond = NULL;
 	(*breakpoint_p)->orig_instr = malloc(length);
 	(*breakpoint_p)->next = NULL;
 	(*breakpoint_p)->unique_id = bpwp_unique_id++;
@@ -306,6 +310,7 @@ static void breakpoint_free(struct target *target, struct breakpoint *breakpoint
 
 	LOG_DEBUG("free BPID: %" PRIu32 " --> %d", breakpoint->unique_id, retval);
 	(*breakpoint_p) = breakpoint->next;
+	agent_expr_free_list(breakpoint->cond);
 	free(breakpoint->orig_instr);
 	free(breakpoint);
 }
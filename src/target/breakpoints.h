@@ -22,6 +22,7 @@
 #include <stdint.h>
 
 struct target;
+struct agent_expr;
 
 enum breakpoint_type {
 	BKPT_HARD,
@@ -42,6 +43,8 @@ struct breakpoint {
 	struct breakpoint *next;
 	uint32_t unique_id;
 	int linked_BRP;
+	/* GDB agent expressions; stop only if one of them holds */
+	struct agent_expr *cond;
 };
 
 struct watchpoint {
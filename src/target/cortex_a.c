@@ -763,8 +763,10 @@ static int cortex_a_dpm_setup(struct cortex_a_common *a, uint32_t didr)
 	dpm->bpwp_disable = cortex_a_bpwp_disable;
 
 	retval = arm_dpm_setup(dpm);
-	if (retval == ERROR_OK)
+	if (retval == ERROR_OK) {
+		armv7a_mmu_tlb_setup(&a->armv7a_common);
 		retval = arm_dpm_initialize(dpm);
+	}
 
 	return retval;
 }
@@ -947,6 +949,9 @@ static int cortex_a_internal_restore(struct target *target, int current,
 	if (!debug_execution)
 		target_free_all_working_areas(target);
 
+	/* the core may rewrite its translation tables once running */
+	armv7a_mmu_tlb_flush(armv7a);
+
 #if 0
 	if (debug_execution) {
 		/* Disable interrupts */
@@ -1859,6 +1864,8 @@ static int cortex_a_assert_reset(struct target *target)
 
 	LOG_DEBUG(" ");
 
+	armv7a_mmu_tlb_flush(armv7a);
+
 	/* FIXME when halt is requested, make it work somehow... */
 
 	/* This function can be called in "target not examined" state */
@@ -127,6 +127,298 @@ static int cortexm_dap_write_coreregister_u32(struct target *target,
 	return retval;
 }
 
+/* Every DCRSR transfer of the batched register paths, at most two per
+ * cache entry (D registers are moved as two single precision halves) */
+#define CORTEX_M_MAX_REG_XFERS	(2 * ARMV7M_LAST_REG)
+
+struct cortex_m_reg_xfer {
+	struct reg *reg;
+	unsigned word;
+	uint32_t sel;
+	uint32_t value;
+	uint32_t dhcsr;
+};
+
+/* DCRSR selector for word @a word of register @a num, or -1 if the
+ * register has no selector of its own */
+static int cortex_m_dcrsr_sel(unsigned num, unsigned word)
+{
+	switch (num) {
+		case 0 ... 18:
+			return num;
+		case ARMV7M_PRIMASK:
+		case ARMV7M_BASEPRI:
+		case ARMV7M_FAULTMASK:
+		case ARMV7M_CONTROL:
+			return 20;
+		case ARMV7M_D0 ... ARMV7M_D15:
+			return 0x40 + 2 * (num - ARMV7M_D0) + word;
+		case ARMV7M_FPSCR:
+			return 0x21;
+		default:
+			return -1;
+	}
+}
+
+/* Bit field of the packed special register selector 20 */
+static void cortex_m_special_field(unsigned num, unsigned *first, unsigned *width)
+{
+	switch (num) {
+		case ARMV7M_PRIMASK:
+			*first = 0;
+			*width = 1;
+			break;
+		case ARMV7M_BASEPRI:
+			*first = 8;
+			*width = 8;
+			break;
+		case ARMV7M_FAULTMASK:
+			*first = 16;
+			*width = 1;
+			break;
+		default:
+			*first = 24;
+			*width = 2;
+			break;
+	}
+}
+
+/**
+ * Read every invalid register of the core cache with a single DAP flush.
+ * Each DCRSR write is followed by a DHCSR read; a transfer whose S_REGRDY
+ * was not yet set, and everything queued after it, is left invalid for
+ * the one-by-one path to pick up.
+ */
+static int cortex_m_fast_read_all_regs(struct target *target)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	struct adiv5_ap *ap = armv7m->debug_ap;
+	struct cortex_m_reg_xfer xfer[CORTEX_M_MAX_REG_XFERS];
+	unsigned num_xfers = 0;
+	int special = -1;
+	uint32_t dcrdr;
+	int retval;
+
+	if (target->dbg_msg_enabled) {
+		retval = mem_ap_read_u32(ap, DCB_DCRDR, &dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* stop queueing on error, but still flush what reads into xfer[] */
+	retval = ERROR_OK;
+	for (unsigned i = 0; i < cache->num_regs && retval == ERROR_OK; i++) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+		unsigned words = r->size > 32 ? 2 : 1;
+
+		if (r->valid)
+			continue;
+		for (unsigned w = 0; w < words; w++) {
+			int sel = cortex_m_dcrsr_sel(arm_reg->num, w);
+			if (sel < 0)
+				break;
+
+			/* the special registers share one transfer */
+			if (sel == 20 && special >= 0) {
+				xfer[num_xfers] = xfer[special];
+				xfer[num_xfers++].reg = r;
+				continue;
+			}
+			if (sel == 20)
+				special = num_xfers;
+
+			xfer[num_xfers].reg = r;
+			xfer[num_xfers].word = w;
+			xfer[num_xfers].sel = sel;
+			retval = mem_ap_write_u32(ap, DCB_DCRSR, sel);
+			if (retval == ERROR_OK)
+				retval = mem_ap_read_u32(ap, DCB_DHCSR, &xfer[num_xfers].dhcsr);
+			if (retval == ERROR_OK)
+				retval = mem_ap_read_u32(ap, DCB_DCRDR, &xfer[num_xfers].value);
+			if (retval != ERROR_OK)
+				break;
+			num_xfers++;
+		}
+	}
+
+	int retval_run = dap_run(ap->dap);
+	if (retval == ERROR_OK)
+		retval = retval_run;
+
+	if (target->dbg_msg_enabled) {
+		/* restore DCB_DCRDR - this needs to be in a separate
+		 * transaction otherwise the emulated DCC channel breaks */
+		int retval2 = mem_ap_write_atomic_u32(ap, DCB_DCRDR, dcrdr);
+		if (retval == ERROR_OK)
+			retval = retval2;
+	}
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* aliases of the shared special transfer carry the copy taken before
+	 * the flush, so fetch its results again */
+	for (unsigned n = 0; n < num_xfers; n++) {
+		if (special >= 0 && xfer[n].sel == 20 && n != (unsigned)special) {
+			xfer[n].value = xfer[special].value;
+			xfer[n].dhcsr = xfer[special].dhcsr;
+		}
+	}
+
+	unsigned not_ready = num_xfers;
+	for (unsigned n = 0; n < num_xfers; n++) {
+		if (!(xfer[n].dhcsr & S_REGRDY)) {
+			not_ready = n;
+			break;
+		}
+	}
+
+	for (unsigned n = 0; n < num_xfers; n++) {
+		struct reg *r = xfer[n].reg;
+		struct arm_reg *arm_reg = r->arch_info;
+
+		unsigned pos = xfer[n].sel == 20 ? (unsigned)special : n;
+		if (pos >= not_ready) {
+			r->valid = 0;
+			continue;
+		}
+
+		if (xfer[n].sel == 20) {
+			unsigned first, width;
+			cortex_m_special_field(arm_reg->num, &first, &width);
+			buf_set_u32(r->value, 0, 32,
+				buf_get_u32((uint8_t *)&xfer[n].value, first, width));
+		} else
+			buf_set_u32(r->value + 4 * xfer[n].word, 0, 32, xfer[n].value);
+
+		/* a D register is only valid once its second half is in */
+		if (r->size <= 32 || xfer[n].word == 1) {
+			r->valid = 1;
+			r->dirty = 0;
+		}
+	}
+
+	if (not_ready < num_xfers)
+		LOG_DEBUG("S_REGRDY not set after %u of %u register reads",
+			not_ready, num_xfers);
+
+	return ERROR_OK;
+}
+
+/**
+ * Write back every dirty register of the core cache with a single DAP
+ * flush, highest index first like armv7m_restore_context(). Registers
+ * whose transfer could not be confirmed through S_REGRDY stay dirty.
+ */
+static int cortex_m_fast_write_dirty_regs(struct target *target)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	struct adiv5_ap *ap = armv7m->debug_ap;
+	struct cortex_m_reg_xfer xfer[CORTEX_M_MAX_REG_XFERS];
+	unsigned num_xfers = 0;
+	bool special_done = false;
+	uint32_t dcrdr;
+	int retval;
+
+	/* the packed special registers are rebuilt from the cache, which
+	 * needs all four of them; otherwise leave them to the slow path */
+	for (unsigned num = ARMV7M_PRIMASK; num <= ARMV7M_CONTROL; num++) {
+		if (!cache->reg_list[num].valid)
+			special_done = true;
+	}
+
+	if (target->dbg_msg_enabled) {
+		retval = mem_ap_read_u32(ap, DCB_DCRDR, &dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* stop queueing on error, but still flush what reads into xfer[] */
+	retval = ERROR_OK;
+	for (int i = cache->num_regs - 1; i >= 0 && retval == ERROR_OK; i--) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+		unsigned words = r->size > 32 ? 2 : 1;
+
+		if (!r->dirty)
+			continue;
+
+		for (unsigned w = 0; w < words; w++) {
+			int sel = cortex_m_dcrsr_sel(arm_reg->num, w);
+			uint32_t value;
+
+			if (sel < 0)
+				break;
+
+			if (sel == 20) {
+				/* all four fields go out together */
+				if (special_done)
+					continue;
+				value = 0;
+				for (unsigned num = ARMV7M_PRIMASK; num <= ARMV7M_CONTROL; num++) {
+					struct reg *s = &cache->reg_list[num];
+					unsigned first, width;
+
+					cortex_m_special_field(num, &first, &width);
+					buf_set_u32((uint8_t *)&value, first, width,
+						buf_get_u32(s->value, 0, width));
+				}
+				special_done = true;
+			} else
+				value = buf_get_u32(r->value + 4 * w, 0, 32);
+
+			xfer[num_xfers].reg = r;
+			xfer[num_xfers].word = w;
+			xfer[num_xfers].sel = sel;
+			retval = mem_ap_write_u32(ap, DCB_DCRDR, value);
+			if (retval == ERROR_OK)
+				retval = mem_ap_write_u32(ap, DCB_DCRSR, sel | DCRSR_WnR);
+			if (retval == ERROR_OK)
+				retval = mem_ap_read_u32(ap, DCB_DHCSR, &xfer[num_xfers].dhcsr);
+			if (retval != ERROR_OK)
+				break;
+			num_xfers++;
+		}
+	}
+
+	int retval_run = dap_run(ap->dap);
+	if (retval == ERROR_OK)
+		retval = retval_run;
+
+	if (target->dbg_msg_enabled) {
+		/* restore DCB_DCRDR - this needs to be in a separate
+		 * transaction otherwise the emulated DCC channel breaks */
+		int retval2 = mem_ap_write_atomic_u32(ap, DCB_DCRDR, dcrdr);
+		if (retval == ERROR_OK)
+			retval = retval2;
+	}
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned n = 0; n < num_xfers; n++) {
+		struct reg *r = xfer[n].reg;
+
+		/* a later DCRDR write may have hit a transfer still in flight */
+		if (!(xfer[n].dhcsr & S_REGRDY)) {
+			LOG_DEBUG("S_REGRDY not set after %u of %u register writes",
+				n, num_xfers);
+			break;
+		}
+
+		if (xfer[n].sel == 20) {
+			for (unsigned num = ARMV7M_PRIMASK; num <= ARMV7M_CONTROL; num++)
+				cache->reg_list[num].dirty = 0;
+		} else if (r->size <= 32 || xfer[n].word == 1) {
+			r->valid = 1;
+			r->dirty = 0;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int cortex_m_write_debug_halt_mask(struct target *target,
 	uint32_t mask_on, uint32_t mask_off)
 {
@@ -425,6 +717,11 @@ static int cortex_m_debug_entry(struct target *target)
 	 * First load register accessible through core debug port */
 	int num_regs = arm->core_cache->num_regs;
 
+	/* batch what we can; whatever it leaves invalid is read one by one */
+	retval = cortex_m_fast_read_all_regs(target);
+	if (retval != ERROR_OK)
+		LOG_DEBUG("batched register read failed, falling back");
+
 	for (i = 0; i < num_regs; i++) {
 		r = &armv7m->arm.core_cache->reg_list[i];
 		if (!r->valid)
@@ -2172,6 +2469,7 @@ static int cortex_m_init_arch_info(struct target *target,
 
 	armv7m->load_core_reg_u32 = cortex_m_load_core_reg_u32;
 	armv7m->store_core_reg_u32 = cortex_m_store_core_reg_u32;
+	armv7m->store_dirty_core_regs = cortex_m_fast_write_dirty_regs;
 
 	target_register_timer_callback(cortex_m_handle_target_request, 1, 1, target);
 
@@ -2441,6 +2739,7 @@ struct target_type cortexm_target = {
 	.write_memory = cortex_m_write_memory,
 	.checksum_memory = armv7m_checksum_memory,
 	.blank_check_memory = armv7m_blank_check_memory,
+	.write_compressed = armv7m_write_compressed,
 
 	.run_algorithm = armv7m_run_algorithm,
 	.start_algorithm = armv7m_start_algorithm,
@@ -32,6 +32,9 @@
 #include "image.h"
 #include "target.h"
 #include <helper/log.h>
+#include <helper/configuration.h>
+
+#include <sys/stat.h>
 
 /* convert ELF header field to host endianness */
 #define field16(elf, field) \
@@ -115,26 +118,116 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
+/* hex digit values plus one, zero for anything else */
+static const uint8_t image_hex_digits[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+/* longest record: byte count, up to 4 address bytes or IHEX address and
+ * record type, 255 data bytes and the checksum */
+#define IMAGE_MAX_RECORD	(1 + 4 + 255 + 1)
+
+/**
+ * Decodes the hex digit pairs at @a line into @a record and moves @a line
+ * to the start of the next line. Like the sscanf() based parsers this
+ * replaced, anything after the record is ignored.
+ *
+ * @returns the number of bytes decoded
+ */
+static size_t image_decode_record(const char **line, const char *end, uint8_t *record)
+{
+	const char *p = *line;
+	size_t count = 0;
+
+	while (end - p >= 2 && count < IMAGE_MAX_RECORD) {
+		uint8_t high = image_hex_digits[(uint8_t)p[0]];
+		uint8_t low = image_hex_digits[(uint8_t)p[1]];
+		if (!high || !low)
+			break;
+		record[count++] = (high - 1) << 4 | (low - 1);
+		p += 2;
+	}
+
+	p = memchr(p, '\n', end - p);
+	*line = p ? p + 1 : end;
+
+	return count;
+}
+
+/* start a new section at @a data, unless the current one is still empty */
+static int image_start_section(struct image *image, struct imagesection *section,
+	uint8_t *data, const char *format)
+{
+	if (section[image->num_sections].size == 0)
+		return ERROR_OK;
+
+	image->num_sections++;
+	if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+		/* too many sections */
+		LOG_ERROR("Too many sections found in %s file", format);
+		return ERROR_IMAGE_FORMAT_ERROR;
+	}
+	section[image->num_sections].size = 0x0;
+	section[image->num_sections].flags = 0;
+	section[image->num_sections].private = data;
+
+	return ERROR_OK;
+}
+
+/* finish the current section and hand all of them to the image */
+static int image_finish_sections(struct image *image, struct imagesection *section)
+{
+	int i;
+
+	image->num_sections++;
+
+	/* copy section information */
+	image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
+	if (image->sections == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	for (i = 0; i < image->num_sections; i++) {
+		image->sections[i].private = section[i].private;
+		image->sections[i].base_address = section[i].base_address;
+		image->sections[i].size = section[i].size;
+		image->sections[i].flags = section[i].flags;
+	}
+
+	return ERROR_OK;
+}
+
 static int image_ihex_buffer_complete_inner(struct image *image,
-	char *lpszLine,
+	uint8_t *record,
 	struct imagesection *section)
 {
 	struct image_ihex *ihex = image->type_private;
-	struct fileio *fileio = ihex->fileio;
 	uint32_t full_address = 0x0;
 	uint32_t cooked_bytes;
-	int i;
+	const uint8_t *data;
+	size_t filesize;
+	int retval;
 
 	/* we can't determine the number of sections that we'll have to create ahead of time,
 	 * so we locally hold them until parsing is finished */
 
-	size_t filesize;
-	int retval;
-	retval = fileio_size(fileio, &filesize);
+	ihex->buffer = NULL;
+	retval = fileio_map(ihex->fileio, &data, &filesize);
 	if (retval != ERROR_OK)
 		return retval;
 
-	ihex->buffer = malloc(filesize >> 1);
+	const char *line = (const char *)data;
+	const char *end = line + filesize;
+
+	/* every data byte takes two characters */
+	ihex->buffer = malloc((filesize >> 1) + 1);
+	if (ihex->buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	cooked_bytes = 0x0;
 	image->num_sections = 0;
 	section[image->num_sections].private = &ihex->buffer[cooked_bytes];
@@ -142,26 +235,46 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 	section[image->num_sections].size = 0x0;
 	section[image->num_sections].flags = 0;
 
-	while (fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
+	while (line < end) {
 		uint32_t count;
 		uint32_t address;
 		uint32_t record_type;
-		uint32_t checksum;
 		uint8_t cal_checksum = 0;
-		size_t bytes_read = 0;
+		size_t record_size;
+		size_t i;
 
-		if (lpszLine[0] == '#')
+		/* skip line ends, blank lines and comments */
+		if (isspace((uint8_t)*line)) {
+			line++;
+			continue;
+		}
+		if (*line == '#') {
+			line = memchr(line, '\n', end - line);
+			if (line == NULL)
+				break;
 			continue;
+		}
+		if (*line++ != ':')
+			return ERROR_IMAGE_FORMAT_ERROR;
 
-		if (sscanf(&lpszLine[bytes_read], ":%2" SCNx32 "%4" SCNx32 "%2" SCNx32, &count,
-			&address, &record_type) != 3)
+		record_size = image_decode_record(&line, end, record);
+		if (record_size < 5 || record_size < record[0] + 5u) {
+			LOG_ERROR("truncated record found in IHEX file");
 			return ERROR_IMAGE_FORMAT_ERROR;
-		bytes_read += 9;
+		}
 
-		cal_checksum += (uint8_t)count;
-		cal_checksum += (uint8_t)(address >> 8);
-		cal_checksum += (uint8_t)address;
-		cal_checksum += (uint8_t)record_type;
+		count = record[0];
+		address = record[1] << 8 | record[2];
+		record_type = record[3];
+
+		/* all bytes including the checksum add up to zero */
+		for (i = 0; i < count + 5; i++)
+			cal_checksum += record[i];
+		if (cal_checksum != 0) {
+			/* checksum failed */
+			LOG_ERROR("incorrect record checksum found in IHEX file");
+			return ERROR_IMAGE_CHECKSUM;
+		}
 
 		if (record_type == 0) {	/* Data Record */
 			if ((full_address & 0xffff) != address) {
@@ -169,139 +282,56 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 				 * unless the current section has zero size, in which case this specifies
 				 * the current section's base address
 				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
+				retval = image_start_section(image, section,
+						&ihex->buffer[cooked_bytes], "IHEX");
+				if (retval != ERROR_OK)
+					return retval;
 				section[image->num_sections].base_address =
 					(full_address & 0xffff0000) | address;
 				full_address = (full_address & 0xffff0000) | address;
 			}
 
-			while (count-- > 0) {
-				unsigned value;
-				sscanf(&lpszLine[bytes_read], "%2x", &value);
-				ihex->buffer[cooked_bytes] = (uint8_t)value;
-				cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-				bytes_read += 2;
-				cooked_bytes += 1;
-				section[image->num_sections].size += 1;
-				full_address++;
-			}
+			memcpy(&ihex->buffer[cooked_bytes], &record[4], count);
+			cooked_bytes += count;
+			section[image->num_sections].size += count;
+			full_address += count;
 		} else if (record_type == 1) {	/* End of File Record */
-			/* finish the current section */
-			image->num_sections++;
-
-			/* copy section information */
-			image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
-			for (i = 0; i < image->num_sections; i++) {
-				image->sections[i].private = section[i].private;
-				image->sections[i].base_address = section[i].base_address;
-				image->sections[i].size = section[i].size;
-				image->sections[i].flags = section[i].flags;
-			}
-
-			return ERROR_OK;
-		} else if (record_type == 2) {	/* Linear Address Record */
-			uint16_t upper_address;
+			return image_finish_sections(image, section);
+		} else if (record_type == 2 || record_type == 4) {
+			/* Extended Segment / Linear Address Record */
+			uint32_t upper_address;
+			unsigned shift = (record_type == 2) ? 4 : 16;
 
-			sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
-			cal_checksum += (uint8_t)(upper_address >> 8);
-			cal_checksum += (uint8_t)upper_address;
-			bytes_read += 4;
+			if (count < 2)
+				return ERROR_IMAGE_FORMAT_ERROR;
+			upper_address = record[4] << 8 | record[5];
 
-			if ((full_address >> 4) != upper_address) {
+			if ((full_address >> shift) != upper_address) {
 				/* we encountered a nonconsecutive location, create a new section,
 				 * unless the current section has zero size, in which case this specifies
 				 * the current section's base address
 				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
+				retval = image_start_section(image, section,
+						&ihex->buffer[cooked_bytes], "IHEX");
+				if (retval != ERROR_OK)
+					return retval;
 				section[image->num_sections].base_address =
-					(full_address & 0xffff) | (upper_address << 4);
-				full_address = (full_address & 0xffff) | (upper_address << 4);
+					(full_address & 0xffff) | (upper_address << shift);
+				full_address = (full_address & 0xffff) | (upper_address << shift);
 			}
 		} else if (record_type == 3) {	/* Start Segment Address Record */
-			uint32_t dummy;
-
 			/* "Start Segment Address Record" will not be supported
 			 * but we must consume it, and do not create an error.  */
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
-				cal_checksum += (uint8_t)dummy;
-				bytes_read += 2;
-			}
-		} else if (record_type == 4) {	/* Extended Linear Address Record */
-			uint16_t upper_address;
-
-			sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
-			cal_checksum += (uint8_t)(upper_address >> 8);
-			cal_checksum += (uint8_t)upper_address;
-			bytes_read += 4;
-
-			if ((full_address >> 16) != upper_address) {
-				/* we encountered a nonconsecutive location, create a new section,
-				 * unless the current section has zero size, in which case this specifies
-				 * the current section's base address
-				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-						/* too many sections */
-						LOG_ERROR("Too many sections found in IHEX file");
-						return ERROR_IMAGE_FORMAT_ERROR;
-					}
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&ihex->buffer[cooked_bytes];
-				}
-				section[image->num_sections].base_address =
-					(full_address & 0xffff) | (upper_address << 16);
-				full_address = (full_address & 0xffff) | (upper_address << 16);
-			}
 		} else if (record_type == 5) {	/* Start Linear Address Record */
-			uint32_t start_address;
-
-			sscanf(&lpszLine[bytes_read], "%8" SCNx32, &start_address);
-			cal_checksum += (uint8_t)(start_address >> 24);
-			cal_checksum += (uint8_t)(start_address >> 16);
-			cal_checksum += (uint8_t)(start_address >> 8);
-			cal_checksum += (uint8_t)start_address;
-			bytes_read += 8;
+			if (count < 4)
+				return ERROR_IMAGE_FORMAT_ERROR;
 
 			image->start_address_set = 1;
-			image->start_address = be_to_h_u32((uint8_t *)&start_address);
+			image->start_address = be_to_h_u32(&record[4]);
 		} else {
 			LOG_ERROR("unhandled IHEX record type: %i", (int)record_type);
 			return ERROR_IMAGE_FORMAT_ERROR;
 		}
-
-		sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
-
-		if ((uint8_t)checksum != (uint8_t)(~cal_checksum + 1)) {
-			/* checksum failed */
-			LOG_ERROR("incorrect record checksum found in IHEX file");
-			return ERROR_IMAGE_CHECKSUM;
-		}
 	}
 
 	LOG_ERROR("premature end of IHEX file, no end-of-file record found");
@@ -314,23 +344,23 @@ static int image_ihex_buffer_complete_inner(struct image *image,
  */
 static int image_ihex_buffer_complete(struct image *image)
 {
-	char *lpszLine = malloc(1023);
-	if (lpszLine == NULL) {
+	uint8_t *record = malloc(IMAGE_MAX_RECORD);
+	if (record == NULL) {
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
 	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
 	if (section == NULL) {
-		free(lpszLine);
+		free(record);
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
 	int retval;
 
-	retval = image_ihex_buffer_complete_inner(image, lpszLine, section);
+	retval = image_ihex_buffer_complete_inner(image, record, section);
 
 	free(section);
-	free(lpszLine);
+	free(record);
 
 	return retval;
 }
@@ -338,8 +368,10 @@ static int image_ihex_buffer_complete(struct image *image)
 static int image_elf_read_headers(struct image *image)
 {
 	struct image_elf *elf = image->type_private;
-	size_t read_bytes;
+	const uint8_t *data;
+	size_t filesize;
 	uint32_t i, j;
+	uint32_t phoff;
 	int retval;
 	uint32_t nload, load_to_vaddr = 0;
 
@@ -350,15 +382,18 @@ static int image_elf_read_headers(struct image *image)
 		return ERROR_FILEIO_OPERATION_FAILED;
 	}
 
-	retval = fileio_read(elf->fileio, sizeof(Elf32_Ehdr), (uint8_t *)elf->header, &read_bytes);
+	/* segments are served straight from the mapped file */
+	retval = fileio_map(elf->fileio, &data, &filesize);
 	if (retval != ERROR_OK) {
-		LOG_ERROR("cannot read ELF file header, read failed");
-		return ERROR_FILEIO_OPERATION_FAILED;
+		LOG_ERROR("cannot read ELF file, read failed");
+		return retval;
 	}
-	if (read_bytes != sizeof(Elf32_Ehdr)) {
+
+	if (filesize < sizeof(Elf32_Ehdr)) {
 		LOG_ERROR("cannot read ELF file header, only partially read");
 		return ERROR_FILEIO_OPERATION_FAILED;
 	}
+	memcpy(elf->header, data, sizeof(Elf32_Ehdr));
 
 	if (strncmp((char *)elf->header->e_ident, ELFMAG, SELFMAG) != 0) {
 		LOG_ERROR("invalid ELF file, bad magic number");
@@ -382,10 +417,10 @@ static int image_elf_read_headers(struct image *image)
 		return ERROR_IMAGE_FORMAT_ERROR;
 	}
 
-	retval = fileio_seek(elf->fileio, field32(elf, elf->header->e_phoff));
-	if (retval != ERROR_OK) {
-		LOG_ERROR("cannot seek to ELF program header table, read failed");
-		return retval;
+	phoff = field32(elf, elf->header->e_phoff);
+	if (phoff > filesize || elf->segment_count*sizeof(Elf32_Phdr) > filesize - phoff) {
+		LOG_ERROR("cannot read ELF segment headers, only partially read");
+		return ERROR_FILEIO_OPERATION_FAILED;
 	}
 
 	elf->segments = malloc(elf->segment_count*sizeof(Elf32_Phdr));
@@ -394,16 +429,8 @@ static int image_elf_read_headers(struct image *image)
 		return ERROR_FILEIO_OPERATION_FAILED;
 	}
 
-	retval = fileio_read(elf->fileio, elf->segment_count*sizeof(Elf32_Phdr),
-			(uint8_t *)elf->segments, &read_bytes);
-	if (retval != ERROR_OK) {
-		LOG_ERROR("cannot read ELF segment headers, read failed");
-		return retval;
-	}
-	if (read_bytes != elf->segment_count*sizeof(Elf32_Phdr)) {
-		LOG_ERROR("cannot read ELF segment headers, only partially read");
-		return ERROR_FILEIO_OPERATION_FAILED;
-	}
+	/* copied, the table needn't be aligned in the file */
+	memcpy(elf->segments, data + phoff, elf->segment_count*sizeof(Elf32_Phdr));
 
 	/* count useful segments (loadable), ignore BSS section */
 	image->num_sections = 0;
@@ -442,14 +469,20 @@ static int image_elf_read_headers(struct image *image)
 		if ((field32(elf,
 			elf->segments[i].p_type) == PT_LOAD) &&
 			(field32(elf, elf->segments[i].p_filesz) != 0)) {
+			uint32_t offset = field32(elf, elf->segments[i].p_offset);
+
 			image->sections[j].size = field32(elf, elf->segments[i].p_filesz);
+			if (offset > filesize || image->sections[j].size > filesize - offset) {
+				LOG_ERROR("cannot find ELF segment content, file truncated");
+				return ERROR_FILEIO_OPERATION_FAILED;
+			}
 			if (load_to_vaddr)
 				image->sections[j].base_address = field32(elf,
 						elf->segments[i].p_vaddr);
 			else
 				image->sections[j].base_address = field32(elf,
 						elf->segments[i].p_paddr);
-			image->sections[j].private = &elf->segments[i];
+			image->sections[j].private = (void *)(data + offset);
 			image->sections[j].flags = field32(elf, elf->segments[i].p_flags);
 			j++;
 		}
@@ -461,69 +494,34 @@ static int image_elf_read_headers(struct image *image)
 	return ERROR_OK;
 }
 
-static int image_elf_read_section(struct image *image,
-	int section,
-	uint32_t offset,
-	uint32_t size,
-	uint8_t *buffer,
-	size_t *size_read)
-{
-	struct image_elf *elf = image->type_private;
-	Elf32_Phdr *segment = (Elf32_Phdr *)image->sections[section].private;
-	size_t read_size, really_read;
-	int retval;
-
-	*size_read = 0;
-
-	LOG_DEBUG("load segment %d at 0x%" PRIx32 " (sz = 0x%" PRIx32 ")", section, offset, size);
-
-	/* read initialized data in current segment if any */
-	if (offset < field32(elf, segment->p_filesz)) {
-		/* maximal size present in file for the current segment */
-		read_size = MIN(size, field32(elf, segment->p_filesz) - offset);
-		LOG_DEBUG("read elf: size = 0x%zu at 0x%" PRIx32 "", read_size,
-			field32(elf, segment->p_offset) + offset);
-		/* read initialized area of the segment */
-		retval = fileio_seek(elf->fileio, field32(elf, segment->p_offset) + offset);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot find ELF segment content, seek failed");
-			return retval;
-		}
-		retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot read ELF segment content, read failed");
-			return retval;
-		}
-		size -= read_size;
-		*size_read += read_size;
-		/* need more data ? */
-		if (!size)
-			return ERROR_OK;
-	}
-
-	return ERROR_OK;
-}
-
 static int image_mot_buffer_complete_inner(struct image *image,
-	char *lpszLine,
+	uint8_t *record,
 	struct imagesection *section)
 {
 	struct image_mot *mot = image->type_private;
-	struct fileio *fileio = mot->fileio;
 	uint32_t full_address = 0x0;
 	uint32_t cooked_bytes;
-	int i;
+	const uint8_t *data;
+	size_t filesize;
+	int retval;
 
 	/* we can't determine the number of sections that we'll have to create ahead of time,
 	 * so we locally hold them until parsing is finished */
 
-	int retval;
-	size_t filesize;
-	retval = fileio_size(fileio, &filesize);
+	mot->buffer = NULL;
+	retval = fileio_map(mot->fileio, &data, &filesize);
 	if (retval != ERROR_OK)
 		return retval;
 
-	mot->buffer = malloc(filesize >> 1);
+	const char *line = (const char *)data;
+	const char *end = line + filesize;
+
+	/* every data byte takes two characters */
+	mot->buffer = malloc((filesize >> 1) + 1);
+	if (mot->buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	cooked_bytes = 0x0;
 	image->num_sections = 0;
 	section[image->num_sections].private = &mot->buffer[cooked_bytes];
@@ -531,131 +529,81 @@ static int image_mot_buffer_complete_inner(struct image *image,
 	section[image->num_sections].size = 0x0;
 	section[image->num_sections].flags = 0;
 
-	while (fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
+	while (line < end) {
 		uint32_t count;
 		uint32_t address;
 		uint32_t record_type;
-		uint32_t checksum;
 		uint8_t cal_checksum = 0;
-		uint32_t bytes_read = 0;
+		size_t record_size;
+		size_t i;
+
+		/* skip line ends and blank lines */
+		if (isspace((uint8_t)*line)) {
+			line++;
+			continue;
+		}
 
 		/* get record type and record length */
-		if (sscanf(&lpszLine[bytes_read], "S%1" SCNx32 "%2" SCNx32, &record_type,
-			&count) != 2)
+		if (end - line < 2 || line[0] != 'S' || !image_hex_digits[(uint8_t)line[1]])
 			return ERROR_IMAGE_FORMAT_ERROR;
+		record_type = image_hex_digits[(uint8_t)line[1]] - 1;
+		line += 2;
 
-		bytes_read += 4;
-		cal_checksum += (uint8_t)count;
-
-		/* skip checksum byte */
-		count -= 1;
+		record_size = image_decode_record(&line, end, record);
+		if (record_size < 1 || record_size < record[0] + 1u) {
+			LOG_ERROR("truncated record found in S19 file");
+			return ERROR_IMAGE_FORMAT_ERROR;
+		}
+		count = record[0];
 
-		if (record_type == 0) {
-			/* S0 - starting record (optional) */
-			int iValue;
+		/* all bytes including the checksum add up to 0xFF */
+		for (i = 0; i <= count; i++)
+			cal_checksum += record[i];
+		if (cal_checksum != 0xFF) {
+			/* checksum failed */
+			LOG_ERROR("incorrect record checksum found in S19 file");
+			return ERROR_IMAGE_CHECKSUM;
+		}
 
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2x", &iValue);
-				cal_checksum += (uint8_t)iValue;
-				bytes_read += 2;
-			}
+		if (record_type == 0 || record_type == 5) {
+			/* S0 - starting record (optional),
+			 * S5 is the data count record, we ignore both */
 		} else if (record_type >= 1 && record_type <= 3) {
-			switch (record_type) {
-				case 1:
-					/* S1 - 16 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%4" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 4;
-					count -= 2;
-					break;
-
-				case 2:
-					/* S2 - 24 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%6" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 16);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 6;
-					count -= 3;
-					break;
-
-				case 3:
-					/* S3 - 32 bit address data record */
-					sscanf(&lpszLine[bytes_read], "%8" SCNx32, &address);
-					cal_checksum += (uint8_t)(address >> 24);
-					cal_checksum += (uint8_t)(address >> 16);
-					cal_checksum += (uint8_t)(address >> 8);
-					cal_checksum += (uint8_t)address;
-					bytes_read += 8;
-					count -= 4;
-					break;
+			/* S1, S2, S3 - 16, 24 and 32 bit address data records */
+			uint32_t address_size = record_type + 1;
 
-			}
+			if (count < address_size + 1)
+				return ERROR_IMAGE_FORMAT_ERROR;
+
+			address = 0;
+			for (i = 1; i <= address_size; i++)
+				address = address << 8 | record[i];
+			count -= address_size + 1;
 
 			if (full_address != address) {
 				/* we encountered a nonconsecutive location, create a new section,
 				 * unless the current section has zero size, in which case this specifies
 				 * the current section's base address
 				 */
-				if (section[image->num_sections].size != 0) {
-					image->num_sections++;
-					section[image->num_sections].size = 0x0;
-					section[image->num_sections].flags = 0;
-					section[image->num_sections].private =
-						&mot->buffer[cooked_bytes];
-				}
+				retval = image_start_section(image, section,
+						&mot->buffer[cooked_bytes], "S19");
+				if (retval != ERROR_OK)
+					return retval;
 				section[image->num_sections].base_address = address;
 				full_address = address;
 			}
 
-			while (count-- > 0) {
-				unsigned value;
-				sscanf(&lpszLine[bytes_read], "%2x", &value);
-				mot->buffer[cooked_bytes] = (uint8_t)value;
-				cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-				bytes_read += 2;
-				cooked_bytes += 1;
-				section[image->num_sections].size += 1;
-				full_address++;
-			}
-		} else if (record_type == 5) {
-			/* S5 is the data count record, we ignore it */
-			uint32_t dummy;
-
-			while (count-- > 0) {
-				sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
-				cal_checksum += (uint8_t)dummy;
-				bytes_read += 2;
-			}
+			memcpy(&mot->buffer[cooked_bytes], &record[1 + address_size], count);
+			cooked_bytes += count;
+			section[image->num_sections].size += count;
+			full_address += count;
 		} else if (record_type >= 7 && record_type <= 9) {
 			/* S7, S8, S9 - ending records for 32, 24 and 16bit */
-			image->num_sections++;
-
-			/* copy section information */
-			image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
-			for (i = 0; i < image->num_sections; i++) {
-				image->sections[i].private = section[i].private;
-				image->sections[i].base_address = section[i].base_address;
-				image->sections[i].size = section[i].size;
-				image->sections[i].flags = section[i].flags;
-			}
-
-			return ERROR_OK;
+			return image_finish_sections(image, section);
 		} else {
 			LOG_ERROR("unhandled S19 record type: %i", (int)(record_type));
 			return ERROR_IMAGE_FORMAT_ERROR;
 		}
-
-		/* account for checksum, will always be 0xFF */
-		sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
-		cal_checksum += (uint8_t)checksum;
-
-		if (cal_checksum != 0xFF) {
-			/* checksum failed */
-			LOG_ERROR("incorrect record checksum found in S19 file");
-			return ERROR_IMAGE_CHECKSUM;
-		}
 	}
 
 	LOG_ERROR("premature end of S19 file, no end-of-file record found");
@@ -668,28 +616,692 @@ static int image_mot_buffer_complete_inner(struct image *image,
  */
 static int image_mot_buffer_complete(struct image *image)
 {
-	char *lpszLine = malloc(1023);
-	if (lpszLine == NULL) {
+	uint8_t *record = malloc(IMAGE_MAX_RECORD);
+	if (record == NULL) {
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
 	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
 	if (section == NULL) {
-		free(lpszLine);
+		free(record);
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
 	int retval;
 
-	retval = image_mot_buffer_complete_inner(image, lpszLine, section);
+	retval = image_mot_buffer_complete_inner(image, record, section);
 
 	free(section);
-	free(lpszLine);
+	free(record);
 
 	return retval;
 }
 
-int image_open(struct image *image, const char *url, const char *type_string)
+/*
+ * Parsed image cache
+ *
+ * Images opened from files are kept here after parsing, together with the
+ * checksums of their sections once those got calculated, so that opening
+ * the same file again skips parsing and host side checksumming. A file is
+ * considered unchanged while its resolved path, device, inode, size and
+ * modification time are, and a hash of a few blocks spread over it still
+ * matches. With a cache directory set, entries are also stored on disk, so
+ * they survive restarts of OpenOCD; those are only used if a hash of the
+ * whole file matches too.
+ */
+
+#define IMAGE_CACHE_MAX_ENTRIES		(8)
+
+#define IMAGE_CACHE_MAGIC		"OCDIMGC"
+#define IMAGE_CACHE_VERSION		(2)
+
+/* blocks hashed to notice changes that keep size and modification time */
+#define IMAGE_CACHE_SAMPLES		(16)
+#define IMAGE_CACHE_SAMPLE_SIZE		(4096)
+
+/* what identifies the contents of an image file */
+struct image_cache_stamp {
+	int64_t file_size;
+	int64_t mtime;			/* in nanoseconds where the host has them */
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t sample_hash;		/* of IMAGE_CACHE_SAMPLES blocks of the file */
+	uint64_t file_hash;		/* of the whole file, 0 until needed on disk */
+};
+
+struct image_cache_entry {
+	struct image_cache_entry *next;
+	char *path;			/* resolved file name */
+	char *type_string;		/* as given to image_open(), "" for autodetect */
+	struct image_cache_stamp stamp;
+	unsigned refs;			/* images currently using this entry */
+	bool stale;			/* no longer in the cache, freed on last release */
+	bool dirty;			/* checksums changed since stored on disk */
+
+	enum image_type type;
+	int num_sections;
+	struct imagesection *sections;	/* unrelocated, contents in data */
+	uint32_t *checksums;
+	bool *checksums_valid;
+	uint8_t *data;
+	size_t data_size;
+	int start_address_set;
+	uint32_t start_address;
+};
+
+/* most recently used first */
+static struct image_cache_entry *image_cache;
+static bool image_cache_enabled;
+static char *image_cache_dir;
+
+static int image_open_uncached(struct image *image, const char *url, const char *type_string);
+
+static void image_cache_free(struct image_cache_entry *entry)
+{
+	free(entry->path);
+	free(entry->type_string);
+	free(entry->sections);
+	free(entry->checksums);
+	free(entry->checksums_valid);
+	free(entry->data);
+	free(entry);
+}
+
+static struct image_cache_entry *image_cache_alloc(const char *path, const char *type_string,
+	const struct image_cache_stamp *stamp, int num_sections, size_t data_size)
+{
+	struct image_cache_entry *entry = calloc(1, sizeof(struct image_cache_entry));
+	if (entry == NULL)
+		return NULL;
+
+	/* allocate at least one of each, images may have no sections */
+	entry->path = strdup(path);
+	entry->type_string = strdup(type_string);
+	entry->sections = calloc(num_sections + 1, sizeof(struct imagesection));
+	entry->checksums = calloc(num_sections + 1, sizeof(uint32_t));
+	entry->checksums_valid = calloc(num_sections + 1, sizeof(bool));
+	entry->data = malloc(data_size + 1);
+	if (entry->path == NULL || entry->type_string == NULL || entry->sections == NULL
+		|| entry->checksums == NULL || entry->checksums_valid == NULL
+		|| entry->data == NULL) {
+		image_cache_free(entry);
+		return NULL;
+	}
+
+	entry->stamp = *stamp;
+	entry->num_sections = num_sections;
+	entry->data_size = data_size;
+
+	return entry;
+}
+
+/* removes an entry from the cache, it is freed once no image uses it */
+static void image_cache_drop(struct image_cache_entry **prev)
+{
+	struct image_cache_entry *entry = *prev;
+
+	*prev = entry->next;
+	entry->next = NULL;
+	if (entry->refs)
+		entry->stale = true;
+	else
+		image_cache_free(entry);
+}
+
+static void image_cache_insert(struct image_cache_entry *entry)
+{
+	struct image_cache_entry **prev;
+	int count = 0;
+
+	entry->next = image_cache;
+	image_cache = entry;
+
+	/* forget the least recently used ones */
+	for (prev = &image_cache; *prev; ) {
+		if (++count > IMAGE_CACHE_MAX_ENTRIES)
+			image_cache_drop(prev);
+		else
+			prev = &(*prev)->next;
+	}
+}
+
+static struct image_cache_entry *image_cache_lookup(const char *path, const char *type_string,
+	const struct image_cache_stamp *stamp)
+{
+	struct image_cache_entry **prev;
+
+	for (prev = &image_cache; *prev; prev = &(*prev)->next) {
+		struct image_cache_entry *entry = *prev;
+
+		if (strcmp(entry->path, path) || strcmp(entry->type_string, type_string))
+			continue;
+
+		if (entry->stamp.file_size != stamp->file_size
+			|| entry->stamp.mtime != stamp->mtime
+			|| entry->stamp.dev != stamp->dev
+			|| entry->stamp.ino != stamp->ino
+			|| entry->stamp.sample_hash != stamp->sample_hash) {
+			LOG_DEBUG("image cache: %s changed", path);
+			image_cache_drop(prev);
+			return NULL;
+		}
+
+		/* move to the front */
+		*prev = entry->next;
+		entry->next = image_cache;
+		image_cache = entry;
+		return entry;
+	}
+
+	return NULL;
+}
+
+/* FNV-1a, names the cache files and guards their contents */
+static uint64_t image_cache_hash(uint64_t hash, const uint8_t *data, size_t size)
+{
+	while (size--) {
+		hash ^= *data++;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+#define IMAGE_CACHE_HASH_INIT		(0xcbf29ce484222325ull)
+
+/* Hashes the raw file, not through fileio, which would decompress it.
+ * With @a sampled only IMAGE_CACHE_SAMPLES blocks spread evenly over
+ * larger files are hashed, always including the first and the last. */
+static int image_cache_hash_file(const char *path, int64_t file_size, bool sampled,
+	uint64_t *hash)
+{
+	uint8_t buffer[IMAGE_CACHE_SAMPLE_SIZE];
+	int64_t span = IMAGE_CACHE_SAMPLES * IMAGE_CACHE_SAMPLE_SIZE;
+	size_t size_read;
+	int i;
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return ERROR_FILEIO_OPERATION_FAILED;
+
+	*hash = IMAGE_CACHE_HASH_INIT;
+	if (!sampled || file_size <= span) {
+		while ((size_read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			*hash = image_cache_hash(*hash, buffer, size_read);
+	} else {
+		for (i = 0; i < IMAGE_CACHE_SAMPLES; i++) {
+			long offset = (file_size - IMAGE_CACHE_SAMPLE_SIZE) * i
+				/ (IMAGE_CACHE_SAMPLES - 1);
+			if (fseek(file, offset, SEEK_SET) != 0)
+				break;
+			size_read = fread(buffer, 1, sizeof(buffer), file);
+			*hash = image_cache_hash(*hash, buffer, size_read);
+		}
+	}
+
+	int retval = ferror(file) ? ERROR_FILEIO_OPERATION_FAILED : ERROR_OK;
+	fclose(file);
+	return retval;
+}
+
+static int image_cache_get_stamp(const char *path, const struct stat *st,
+	struct image_cache_stamp *stamp)
+{
+	stamp->file_size = st->st_size;
+	stamp->mtime = (int64_t)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	stamp->mtime += st->st_mtim.tv_nsec;
+#endif
+	stamp->dev = st->st_dev;
+	stamp->ino = st->st_ino;
+	stamp->file_hash = 0;
+
+	return image_cache_hash_file(path, st->st_size, true, &stamp->sample_hash);
+}
+
+static char *image_cache_file_name(const char *path, const char *type_string)
+{
+	uint64_t hash = IMAGE_CACHE_HASH_INIT;
+
+	hash = image_cache_hash(hash, (const uint8_t *)path, strlen(path) + 1);
+	hash = image_cache_hash(hash, (const uint8_t *)type_string, strlen(type_string));
+
+	return alloc_printf("%s/%016" PRIx64 ".img", image_cache_dir, hash);
+}
+
+/*
+ * Cache files, all integers little endian:
+ *
+ *	8 bytes magic, u32 version, u32 image type, u64 file size,
+ *	u64 modification time, u64 device, u64 inode, u64 sampled hash,
+ *	u64 hash of the whole file, u32 path length, the path, u32 type string
+ *	length, the type string, u32 start address set, u32 start address,
+ *	u32 number of sections, then per section u32 base address, u32 size,
+ *	u32 flags, u32 checksum valid and u32 checksum, then the contents of
+ *	all sections and finally the u64 hash of everything before it.
+ */
+static size_t image_cache_header_size(struct image_cache_entry *entry)
+{
+	return 8 + 4 + 4 + 6 * 8 + 4 + strlen(entry->path) + 4
+		+ strlen(entry->type_string) + 4 + 4 + 4 + entry->num_sections * 20;
+}
+
+static void image_cache_store(struct image_cache_entry *entry)
+{
+	size_t size = image_cache_header_size(entry) + entry->data_size + 8;
+	uint8_t *buffer = malloc(size);
+	uint8_t *p = buffer;
+	int i;
+
+	if (buffer == NULL)
+		return;
+
+	/* entries made without a cache directory lack the full hash; only
+	 * add it if the file still looks the way it was parsed */
+	if (entry->stamp.file_hash == 0) {
+		struct stat st;
+		struct image_cache_stamp stamp;
+		if (stat(entry->path, &st) != 0
+			|| image_cache_get_stamp(entry->path, &st, &stamp) != ERROR_OK
+			|| stamp.sample_hash != entry->stamp.sample_hash
+			|| image_cache_hash_file(entry->path, stamp.file_size, false,
+				&entry->stamp.file_hash) != ERROR_OK) {
+			LOG_DEBUG("image cache: %s changed, not storing it", entry->path);
+			free(buffer);
+			return;
+		}
+	}
+
+	memcpy(p, IMAGE_CACHE_MAGIC, 8);
+	p += 8;
+	h_u32_to_le(p, IMAGE_CACHE_VERSION);
+	h_u32_to_le(p + 4, entry->type);
+	h_u64_to_le(p + 8, entry->stamp.file_size);
+	h_u64_to_le(p + 16, entry->stamp.mtime);
+	h_u64_to_le(p + 24, entry->stamp.dev);
+	h_u64_to_le(p + 32, entry->stamp.ino);
+	h_u64_to_le(p + 40, entry->stamp.sample_hash);
+	h_u64_to_le(p + 48, entry->stamp.file_hash);
+	h_u32_to_le(p + 56, strlen(entry->path));
+	p += 60;
+	memcpy(p, entry->path, strlen(entry->path));
+	p += strlen(entry->path);
+	h_u32_to_le(p, strlen(entry->type_string));
+	p += 4;
+	memcpy(p, entry->type_string, strlen(entry->type_string));
+	p += strlen(entry->type_string);
+	h_u32_to_le(p, entry->start_address_set);
+	h_u32_to_le(p + 4, entry->start_address);
+	h_u32_to_le(p + 8, entry->num_sections);
+	p += 12;
+	for (i = 0; i < entry->num_sections; i++) {
+		h_u32_to_le(p, entry->sections[i].base_address);
+		h_u32_to_le(p + 4, entry->sections[i].size);
+		h_u32_to_le(p + 8, entry->sections[i].flags);
+		h_u32_to_le(p + 12, entry->checksums_valid[i]);
+		h_u32_to_le(p + 16, entry->checksums[i]);
+		p += 20;
+	}
+	memcpy(p, entry->data, entry->data_size);
+	p += entry->data_size;
+	h_u64_to_le(p, image_cache_hash(IMAGE_CACHE_HASH_INIT, buffer, p - buffer));
+
+	/* write a new file and rename it, other OpenOCD instances may be
+	 * reading the old one */
+	char *name = image_cache_file_name(entry->path, entry->type_string);
+	char *tmp_name = alloc_printf("%s.%d", name, (int)getpid());
+	struct fileio *fileio;
+	size_t written;
+	int retval;
+
+	retval = fileio_open(&fileio, tmp_name, FILEIO_WRITE, FILEIO_BINARY);
+	if (retval == ERROR_OK) {
+		retval = fileio_write(fileio, size, buffer, &written);
+		fileio_close(fileio);
+		if (retval == ERROR_OK && written != size)
+			retval = ERROR_FILEIO_OPERATION_FAILED;
+		if (retval == ERROR_OK && rename(tmp_name, name) != 0)
+			retval = ERROR_FILEIO_OPERATION_FAILED;
+		if (retval != ERROR_OK)
+			remove(tmp_name);
+	}
+
+	if (retval == ERROR_OK) {
+		LOG_DEBUG("image cache: stored %s as %s", entry->path, name);
+		entry->dirty = false;
+	} else
+		LOG_WARNING("couldn't store %s in the image cache", entry->path);
+
+	free(tmp_name);
+	free(name);
+	free(buffer);
+}
+
+static struct image_cache_entry *image_cache_load(const char *path, const char *type_string,
+	struct image_cache_stamp *stamp)
+{
+	struct image_cache_entry *entry = NULL;
+	struct fileio *fileio;
+	const uint8_t *data;
+	size_t size;
+	int i;
+
+	/* a miss isn't worth an error message */
+	char *name = image_cache_file_name(path, type_string);
+	struct stat cache_st;
+	int retval = ERROR_FILEIO_NOT_FOUND;
+	if (stat(name, &cache_st) == 0)
+		retval = fileio_open(&fileio, name, FILEIO_READ, FILEIO_BINARY);
+	free(name);
+	if (retval != ERROR_OK)
+		return NULL;
+
+	retval = fileio_map(fileio, &data, &size);
+	if (retval != ERROR_OK)
+		goto done;
+
+	/* check the key before trusting anything else */
+	size_t path_len = strlen(path);
+	size_t type_len = strlen(type_string);
+	size_t fixed = 72 + path_len + type_len + 12;
+	if (size < fixed + 8
+		|| memcmp(data, IMAGE_CACHE_MAGIC, 8)
+		|| le_to_h_u32(data + 8) != IMAGE_CACHE_VERSION
+		|| (int64_t)le_to_h_u64(data + 16) != stamp->file_size
+		|| (int64_t)le_to_h_u64(data + 24) != stamp->mtime
+		|| le_to_h_u64(data + 32) != stamp->dev
+		|| le_to_h_u64(data + 40) != stamp->ino
+		|| le_to_h_u64(data + 48) != stamp->sample_hash
+		|| le_to_h_u32(data + 64) != path_len
+		|| memcmp(data + 68, path, path_len)
+		|| le_to_h_u32(data + 68 + path_len) != type_len
+		|| memcmp(data + 72 + path_len, type_string, type_len))
+		goto done;
+	if (le_to_h_u64(data + size - 8) !=
+		image_cache_hash(IMAGE_CACHE_HASH_INIT, data, size - 8)) {
+		LOG_WARNING("image cache: ignoring corrupted entry for %s", path);
+		goto done;
+	}
+
+	/* the stamp may match a file rewritten in place, e.g. on another
+	 * machine sharing the directory, so check all of its contents */
+	if (stamp->file_hash == 0
+		&& image_cache_hash_file(path, stamp->file_size, false,
+			&stamp->file_hash) != ERROR_OK)
+		goto done;
+	if (le_to_h_u64(data + 56) != stamp->file_hash) {
+		LOG_DEBUG("image cache: %s changed since stored on disk", path);
+		goto done;
+	}
+
+	const uint8_t *p = data + fixed - 12;
+	uint32_t num_sections = le_to_h_u32(p + 8);
+	if (num_sections > IMAGE_MAX_SECTIONS || size - fixed - 8 < num_sections * 20)
+		goto done;
+
+	size_t data_size = size - fixed - 8 - num_sections * 20;
+	entry = image_cache_alloc(path, type_string, stamp, num_sections, data_size);
+	if (entry == NULL)
+		goto done;
+
+	entry->type = le_to_h_u32(data + 12);
+	entry->start_address_set = le_to_h_u32(p);
+	entry->start_address = le_to_h_u32(p + 4);
+	p += 12;
+
+	size_t offset = 0;
+	for (i = 0; i < entry->num_sections; i++) {
+		entry->sections[i].base_address = le_to_h_u32(p);
+		entry->sections[i].size = le_to_h_u32(p + 4);
+		entry->sections[i].flags = le_to_h_u32(p + 8);
+		entry->sections[i].private = entry->data + offset;
+		entry->checksums_valid[i] = le_to_h_u32(p + 12) != 0;
+		entry->checksums[i] = le_to_h_u32(p + 16);
+		offset += entry->sections[i].size;
+		p += 20;
+	}
+	if (offset != data_size) {
+		image_cache_free(entry);
+		entry = NULL;
+		goto done;
+	}
+	memcpy(entry->data, p, data_size);
+
+	LOG_DEBUG("image cache: loaded %s from disk", path);
+
+done:
+	fileio_close(fileio);
+	return entry;
+}
+
+/* takes over the contents of a freshly parsed image */
+static struct image_cache_entry *image_cache_create(struct image *image, const char *path,
+	const char *type_string, const struct image_cache_stamp *stamp)
+{
+	struct image_cache_entry *entry;
+	size_t data_size = 0;
+	size_t size_read;
+	int i;
+
+	for (i = 0; i < image->num_sections; i++)
+		data_size += image->sections[i].size;
+
+	entry = image_cache_alloc(path, type_string, stamp, image->num_sections, data_size);
+	if (entry == NULL)
+		return NULL;
+
+	entry->type = image->type;
+	entry->start_address_set = image->start_address_set;
+	entry->start_address = image->start_address;
+
+	uint8_t *data = entry->data;
+	for (i = 0; i < image->num_sections; i++) {
+		entry->sections[i] = image->sections[i];
+		entry->sections[i].private = data;
+		if (image_read_section(image, i, 0, image->sections[i].size,
+				data, &size_read) != ERROR_OK) {
+			image_cache_free(entry);
+			return NULL;
+		}
+		data += image->sections[i].size;
+	}
+
+	return entry;
+}
+
+static int image_cache_attach(struct image *image, struct image_cache_entry *entry)
+{
+	int i;
+
+	image->sections = malloc(sizeof(struct imagesection) * (entry->num_sections + 1));
+	if (image->sections == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	for (i = 0; i < entry->num_sections; i++)
+		image->sections[i] = entry->sections[i];
+
+	image->type = entry->type;
+	image->type_private = NULL;
+	image->num_sections = entry->num_sections;
+	if (entry->start_address_set) {
+		image->start_address_set = 1;
+		image->start_address = entry->start_address;
+	}
+	image->cache = entry;
+	entry->refs++;
+
+	return ERROR_OK;
+}
+
+static void image_cache_release(struct image_cache_entry *entry)
+{
+	struct image_cache_entry **prev;
+
+	entry->refs--;
+	if (entry->dirty && !entry->stale && image_cache_dir)
+		image_cache_store(entry);
+
+	if (entry->refs)
+		return;
+	if (entry->stale) {
+		image_cache_free(entry);
+		return;
+	}
+
+	/* only kept while enabled, image_open_cached() adds them anyway */
+	if (!image_cache_enabled) {
+		for (prev = &image_cache; *prev; prev = &(*prev)->next) {
+			if (*prev == entry) {
+				image_cache_drop(prev);
+				break;
+			}
+		}
+	}
+}
+
+static int image_cache_open(struct image *image, const char *url, const char *type_string)
+{
+	struct image_cache_entry *entry;
+	struct image_cache_stamp stamp;
+	struct stat st;
+	int retval;
+
+	/* only files can be cached */
+	if (type_string && (!strcmp(type_string, "mem") || !strcmp(type_string, "build")))
+		return image_open_uncached(image, url, type_string);
+
+	char *path = find_file(url);
+#ifdef HAVE_REALPATH
+	/* the same key whatever the working directory */
+	if (path != NULL) {
+		char *real_path = realpath(path, NULL);
+		free(path);
+		path = real_path;
+	}
+#endif
+	if (path == NULL || stat(path, &st) != 0
+		|| image_cache_get_stamp(path, &st, &stamp) != ERROR_OK) {
+		free(path);
+		return image_open_uncached(image, url, type_string);
+	}
+
+	const char *key_type = type_string ? type_string : "";
+
+	entry = image_cache_lookup(path, key_type, &stamp);
+	if (entry != NULL) {
+		LOG_DEBUG("image cache: using %s", path);
+	} else if (image_cache_dir) {
+		entry = image_cache_load(path, key_type, &stamp);
+		if (entry != NULL)
+			image_cache_insert(entry);
+	}
+
+	if (entry == NULL) {
+		retval = image_open_uncached(image, url, type_string);
+		if (retval != ERROR_OK) {
+			free(path);
+			return retval;
+		}
+
+		entry = image_cache_create(image, path, key_type, &stamp);
+		if (entry == NULL) {
+			/* go on with the image as parsed */
+			LOG_WARNING("couldn't add %s to the image cache", path);
+			free(path);
+			return ERROR_OK;
+		}
+		image_close(image);
+		image_cache_insert(entry);
+		if (image_cache_dir)
+			image_cache_store(entry);
+	}
+	free(path);
+
+	return image_cache_attach(image, entry);
+}
+
+int image_section_checksum(struct image *image, int section, uint32_t *checksum)
+{
+	struct image_cache_entry *entry = image->cache;
+	uint8_t *buffer = NULL;
+	size_t size_read;
+	int retval;
+
+	if (entry && entry->checksums_valid[section]) {
+		*checksum = entry->checksums[section];
+		return ERROR_OK;
+	}
+
+	const uint8_t *data = image_section_data(image, section);
+	if (data == NULL) {
+		buffer = malloc(image->sections[section].size);
+		if (buffer == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		retval = image_read_section(image, section, 0, image->sections[section].size,
+				buffer, &size_read);
+		if (retval != ERROR_OK) {
+			free(buffer);
+			return retval;
+		}
+		data = buffer;
+	}
+
+	retval = image_calculate_checksum((uint8_t *)data, image->sections[section].size, checksum);
+	free(buffer);
+
+	if (retval == ERROR_OK && entry) {
+		entry->checksums[section] = *checksum;
+		entry->checksums_valid[section] = true;
+		entry->dirty = true;
+	}
+
+	return retval;
+}
+
+void image_cache_flush(void)
+{
+	while (image_cache)
+		image_cache_drop(&image_cache);
+}
+
+void image_cache_enable(bool enable)
+{
+	image_cache_enabled = enable;
+	if (!enable)
+		image_cache_flush();
+}
+
+bool image_cache_is_enabled(void)
+{
+	return image_cache_enabled;
+}
+
+int image_cache_set_directory(const char *directory)
+{
+	free(image_cache_dir);
+	image_cache_dir = NULL;
+
+	if (directory == NULL)
+		return ERROR_OK;
+
+	struct stat st;
+	if (stat(directory, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		LOG_ERROR("image cache directory %s doesn't exist", directory);
+		return ERROR_FAIL;
+	}
+
+	image_cache_dir = strdup(directory);
+	return ERROR_OK;
+}
+
+const char *image_cache_get_directory(void)
+{
+	return image_cache_dir;
+}
+
+static int image_open_uncached(struct image *image, const char *url, const char *type_string)
 {
 	int retval = ERROR_OK;
 
@@ -705,8 +1317,9 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		retval = fileio_open(&image_binary->fileio, url, FILEIO_READ, FILEIO_BINARY);
 		if (retval != ERROR_OK)
 			return retval;
+		const uint8_t *data;
 		size_t filesize;
-		retval = fileio_size(image_binary->fileio, &filesize);
+		retval = fileio_map(image_binary->fileio, &data, &filesize);
 		if (retval != ERROR_OK) {
 			fileio_close(image_binary->fileio);
 			return retval;
@@ -717,6 +1330,7 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		image->sections[0].base_address = 0x0;
 		image->sections[0].size = filesize;
 		image->sections[0].flags = 0;
+		image->sections[0].private = (void *)data;
 	} else if (image->type == IMAGE_IHEX) {
 		struct image_ihex *image_ihex;
 
@@ -791,6 +1405,11 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		image->type_private = NULL;
 	}
 
+	return retval;
+}
+
+static void image_relocate(struct image *image)
+{
 	if (image->base_address_set) {
 		/* relocate */
 		int section;
@@ -802,9 +1421,34 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		image->base_address = 0;
 		image->base_address_set = 0;
 	}
+}
+
+int image_open(struct image *image, const char *url, const char *type_string)
+{
+	int retval;
+
+	image->cache = NULL;
+	if (image_cache_enabled)
+		retval = image_cache_open(image, url, type_string);
+	else
+		retval = image_open_uncached(image, url, type_string);
+	if (retval == ERROR_OK)
+		image_relocate(image);
 
 	return retval;
-};
+}
+
+int image_open_cached(struct image *image, const char *url, const char *type_string)
+{
+	int retval;
+
+	image->cache = NULL;
+	retval = image_cache_open(image, url, type_string);
+	if (retval == ERROR_OK)
+		image_relocate(image);
+
+	return retval;
+}
 
 int image_read_section(struct image *image,
 	int section,
@@ -813,8 +1457,6 @@ int image_read_section(struct image *image,
 	uint8_t *buffer,
 	size_t *size_read)
 {
-	int retval;
-
 	/* don't read past the end of a section */
 	if (offset + size > image->sections[section].size) {
 		LOG_DEBUG(
@@ -825,30 +1467,7 @@ int image_read_section(struct image *image,
 		return ERROR_COMMAND_SYNTAX_ERROR;
 	}
 
-	if (image->type == IMAGE_BINARY) {
-		struct image_binary *image_binary = image->type_private;
-
-		/* only one section in a plain binary */
-		if (section != 0)
-			return ERROR_COMMAND_SYNTAX_ERROR;
-
-		/* seek to offset */
-		retval = fileio_seek(image_binary->fileio, offset);
-		if (retval != ERROR_OK)
-			return retval;
-
-		/* return requested bytes */
-		retval = fileio_read(image_binary->fileio, size, buffer, size_read);
-		if (retval != ERROR_OK)
-			return retval;
-	} else if (image->type == IMAGE_IHEX) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
-
-		return ERROR_OK;
-	} else if (image->type == IMAGE_ELF)
-		return image_elf_read_section(image, section, offset, size, buffer, size_read);
-	else if (image->type == IMAGE_MEMORY) {
+	if (image->type == IMAGE_MEMORY) {
 		struct image_memory *image_memory = image->type_private;
 		uint32_t address = image->sections[section].base_address + offset;
 
@@ -886,21 +1505,24 @@ int image_read_section(struct image *image,
 			*size_read += (size_in_cache > size) ? size : size_in_cache;
 			address += (size_in_cache > size) ? size : size_in_cache;
 		}
-	} else if (image->type == IMAGE_SRECORD) {
+	} else {
+		/* everything else is held in memory or mapped from the file */
 		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
 		*size_read = size;
-
-		return ERROR_OK;
-	} else if (image->type == IMAGE_BUILDER) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
-
-		return ERROR_OK;
 	}
 
 	return ERROR_OK;
 }
 
+const uint8_t *image_section_data(struct image *image, int section)
+{
+	/* memory images are read through a small cache */
+	if (image->type == IMAGE_MEMORY)
+		return NULL;
+
+	return image->sections[section].private;
+}
+
 int image_add_section(struct image *image, uint32_t base, uint32_t size, int flags, uint8_t const *data)
 {
 	struct imagesection *section;
@@ -940,7 +1562,10 @@ int image_add_section(struct image *image, uint32_t base, uint32_t size, int fla
 
 void image_close(struct image *image)
 {
-	if (image->type == IMAGE_BINARY) {
+	if (image->cache) {
+		image_cache_release(image->cache);
+		image->cache = NULL;
+	} else if (image->type == IMAGE_BINARY) {
 		struct image_binary *image_binary = image->type_private;
 
 		fileio_close(image_binary->fileio);
@@ -36,6 +36,8 @@
 
 #define IMAGE_MEMORY_CACHE_SIZE		(2048)
 
+struct image_cache_entry;
+
 enum image_type {
 	IMAGE_BINARY,	/* plain binary */
 	IMAGE_IHEX,		/* intel hex-record format */
@@ -61,6 +63,7 @@ struct image {
 	long long base_address;		/* base address, if one is set */
 	int start_address_set;	/* whether the image has a start address (entry point) associated */
 	uint32_t start_address;		/* start address, if one is set */
+	struct image_cache_entry *cache;	/* parsed image cache entry, if any */
 };
 
 struct image_binary {
@@ -92,13 +95,32 @@ struct image_mot {
 };
 
 int image_open(struct image *image, const char *url, const char *type_string);
+/**
+ * Like image_open(), but goes through the parsed image cache even when
+ * it is disabled, so the image stays valid if the file changes later.
+ */
+int image_open_cached(struct image *image, const char *url, const char *type_string);
 int image_read_section(struct image *image, int section, uint32_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
+/**
+ * Returns the contents of a whole section without copying them, or NULL
+ * if the section can only be read with image_read_section().
+ */
+const uint8_t *image_section_data(struct image *image, int section);
 void image_close(struct image *image);
 
 int image_add_section(struct image *image, uint32_t base, uint32_t size,
 		int flags, uint8_t const *data);
 
+/** Calculates the checksum of a whole section, or takes it from the cache. */
+int image_section_checksum(struct image *image, int section, uint32_t *checksum);
+
+void image_cache_enable(bool enable);
+bool image_cache_is_enabled(void);
+int image_cache_set_directory(const char *directory);
+const char *image_cache_get_directory(void);
+void image_cache_flush(void);
+
 int image_calculate_checksum(uint8_t *buffer, uint32_t nbytes,
 		uint32_t *checksum);
 
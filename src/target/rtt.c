@@ -0,0 +1,504 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "target.h"
+#include "rtt.h"
+#include <helper/log.h>
+#include <helper/command.h>
+
+/* control block: char id[16], i32 max up buffers, i32 max down buffers,
+ * then the up and the down buffer descriptors */
+#define RTT_CB_ID_SIZE		16
+#define RTT_CB_HEADER_SIZE	24
+
+/* buffer descriptor: name, buffer, size, write offset, read offset, flags */
+#define RTT_DESC_SIZE		24
+#define RTT_DESC_BUFFER		4
+#define RTT_DESC_SIZE_OF_BUFFER	8
+#define RTT_DESC_WR_OFF		12
+#define RTT_DESC_RD_OFF		16
+#define RTT_DESC_FLAGS		20
+
+#define RTT_MAX_CHANNELS	32
+#define RTT_NAME_MAX		32
+#define RTT_SEARCH_CHUNK	1024
+#define RTT_DEFAULT_INTERVAL	10
+
+struct rtt_channel {
+	/* address of the buffer descriptor in the control block */
+	uint32_t desc;
+	char name[RTT_NAME_MAX];
+	uint32_t buffer;
+	uint32_t size;
+	uint32_t flags;
+};
+
+struct rtt_sink {
+	unsigned channel;
+	rtt_sink_t sink;
+	void *priv;
+	struct rtt_sink *next;
+};
+
+static struct {
+	/* search region and control block ID, from 'rtt setup' */
+	bool configured;
+	uint32_t address;
+	uint32_t size;
+	char id[RTT_CB_ID_SIZE];
+
+	struct target *target;
+	bool started;
+	unsigned interval;
+	uint32_t cb;
+	unsigned num_up;
+	unsigned num_down;
+	struct rtt_channel up[RTT_MAX_CHANNELS];
+	struct rtt_channel down[RTT_MAX_CHANNELS];
+	/* host copy of the up descriptors, refreshed by each poll */
+	uint8_t desc[RTT_MAX_CHANNELS * RTT_DESC_SIZE];
+	uint8_t *rx;
+	uint32_t rx_size;
+
+	struct rtt_sink *sinks;
+} rtt = {
+	.interval = RTT_DEFAULT_INTERVAL,
+};
+
+int rtt_register_sink(unsigned channel, rtt_sink_t sink, void *priv)
+{
+	struct rtt_sink *s = malloc(sizeof(*s));
+	if (s == NULL)
+		return ERROR_FAIL;
+
+	s->channel = channel;
+	s->sink = sink;
+	s->priv = priv;
+	s->next = rtt.sinks;
+	rtt.sinks = s;
+	return ERROR_OK;
+}
+
+void rtt_unregister_sink(unsigned channel, void *priv)
+{
+	for (struct rtt_sink **p = &rtt.sinks; *p; p = &(*p)->next) {
+		struct rtt_sink *s = *p;
+		if (s->channel == channel && s->priv == priv) {
+			*p = s->next;
+			free(s);
+			return;
+		}
+	}
+}
+
+static bool rtt_channel_has_sink(unsigned channel)
+{
+	for (struct rtt_sink *s = rtt.sinks; s; s = s->next) {
+		if (s->channel == channel)
+			return true;
+	}
+	return false;
+}
+
+static void rtt_deliver(unsigned channel, const uint8_t *data, size_t length)
+{
+	struct rtt_sink **p = &rtt.sinks;
+
+	while (*p) {
+		struct rtt_sink *s = *p;
+		if (s->channel == channel && s->sink(channel, data, length, s->priv) != ERROR_OK) {
+			*p = s->next;
+			free(s);
+			continue;
+		}
+		p = &s->next;
+	}
+}
+
+/* Move whatever the target wrote to one up channel over to its sinks */
+static int rtt_drain_up(unsigned channel, const uint8_t *desc)
+{
+	struct target *target = rtt.target;
+	struct rtt_channel *ch = &rtt.up[channel];
+	uint32_t wr = target_buffer_get_u32(target, desc + RTT_DESC_WR_OFF);
+	uint32_t rd = target_buffer_get_u32(target, desc + RTT_DESC_RD_OFF);
+	int retval;
+
+	if (wr == rd)
+		return ERROR_OK;
+	if (wr >= ch->size || rd >= ch->size) {
+		LOG_DEBUG("rtt: up channel %u has bogus offsets", channel);
+		return ERROR_FAIL;
+	}
+
+	/* at most two pieces, the second one after wrapping around */
+	uint32_t first = wr > rd ? wr - rd : ch->size - rd;
+	uint32_t second = wr > rd ? 0 : wr;
+
+	retval = target_read_buffer(target, ch->buffer + rd, first, rtt.rx);
+	if (retval == ERROR_OK && second)
+		retval = target_read_buffer(target, ch->buffer, second, rtt.rx + first);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* hand the space back before the data goes out, so that the target
+	 * can refill it while the host is busy */
+	retval = target_write_u32(target, ch->desc + RTT_DESC_RD_OFF, wr);
+	if (retval != ERROR_OK)
+		return retval;
+
+	rtt_deliver(channel, rtt.rx, first + second);
+	return ERROR_OK;
+}
+
+static int rtt_poll(void *priv)
+{
+	int retval;
+
+	if (!rtt.started || rtt.sinks == NULL || !target_was_examined(rtt.target))
+		return ERROR_OK;
+
+	/* one block read fetches the offsets of every up channel */
+	retval = target_read_buffer(rtt.target, rtt.cb + RTT_CB_HEADER_SIZE,
+			rtt.num_up * RTT_DESC_SIZE, rtt.desc);
+	if (retval != ERROR_OK)
+		return ERROR_OK;
+
+	for (unsigned i = 0; i < rtt.num_up; i++) {
+		if (rtt_channel_has_sink(i))
+			rtt_drain_up(i, rtt.desc + i * RTT_DESC_SIZE);
+	}
+	return ERROR_OK;
+}
+
+int rtt_write_channel(unsigned channel, const uint8_t *data, size_t *length)
+{
+	struct target *target = rtt.target;
+	uint8_t desc[RTT_DESC_SIZE];
+	int retval;
+
+	if (!rtt.started || channel >= rtt.num_down) {
+		*length = 0;
+		return ERROR_FAIL;
+	}
+
+	struct rtt_channel *ch = &rtt.down[channel];
+	retval = target_read_buffer(target, ch->desc, RTT_DESC_SIZE, desc);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint32_t wr = target_buffer_get_u32(target, desc + RTT_DESC_WR_OFF);
+	uint32_t rd = target_buffer_get_u32(target, desc + RTT_DESC_RD_OFF);
+	if (wr >= ch->size || rd >= ch->size) {
+		LOG_DEBUG("rtt: down channel %u has bogus offsets", channel);
+		*length = 0;
+		return ERROR_FAIL;
+	}
+
+	/* one byte always stays free to tell a full ring from an empty one */
+	uint32_t space = rd > wr ? rd - wr - 1 : ch->size - wr + rd - 1;
+	uint32_t count = *length < space ? *length : space;
+	uint32_t first = count < ch->size - wr ? count : ch->size - wr;
+
+	retval = target_write_buffer(target, ch->buffer + wr, first, data);
+	if (retval == ERROR_OK && count > first)
+		retval = target_write_buffer(target, ch->buffer, count - first, data + first);
+	if (retval == ERROR_OK)
+		retval = target_write_u32(target, ch->desc + RTT_DESC_WR_OFF,
+				(wr + count) % ch->size);
+	if (retval != ERROR_OK) {
+		*length = 0;
+		return retval;
+	}
+
+	*length = count;
+	return ERROR_OK;
+}
+
+static int rtt_find_cb(struct target *target, uint32_t *address)
+{
+	size_t id_len = strlen(rtt.id);
+	uint8_t *buf = malloc(RTT_SEARCH_CHUNK);
+	uint32_t end = rtt.address + rtt.size;
+	int retval = ERROR_FAIL;
+
+	if (buf == NULL)
+		return ERROR_FAIL;
+
+	/* chunks overlap so that an ID across their boundary is found */
+	for (uint32_t addr = rtt.address; addr < end && end - addr >= id_len;
+			addr += RTT_SEARCH_CHUNK - id_len + 1) {
+		uint32_t len = end - addr < RTT_SEARCH_CHUNK ? end - addr : RTT_SEARCH_CHUNK;
+
+		retval = target_read_buffer(target, addr, len, buf);
+		if (retval != ERROR_OK)
+			break;
+		retval = ERROR_FAIL;
+
+		for (uint32_t i = 0; i + id_len <= len; i++) {
+			if (memcmp(buf + i, rtt.id, id_len) == 0) {
+				*address = addr + i;
+				free(buf);
+				return ERROR_OK;
+			}
+		}
+		keep_alive();
+	}
+
+	free(buf);
+	return retval;
+}
+
+static void rtt_parse_channel(struct target *target, struct rtt_channel *ch,
+		uint32_t desc_address, const uint8_t *desc)
+{
+	uint32_t name = target_buffer_get_u32(target, desc);
+
+	ch->desc = desc_address;
+	ch->buffer = target_buffer_get_u32(target, desc + RTT_DESC_BUFFER);
+	ch->size = target_buffer_get_u32(target, desc + RTT_DESC_SIZE_OF_BUFFER);
+	ch->flags = target_buffer_get_u32(target, desc + RTT_DESC_FLAGS);
+
+	if (name == 0 || target_read_buffer(target, name, RTT_NAME_MAX - 1,
+				(uint8_t *)ch->name) != ERROR_OK)
+		ch->name[0] = '\0';
+	else
+		ch->name[RTT_NAME_MAX - 1] = '\0';
+}
+
+static int rtt_start(struct target *target)
+{
+	uint8_t header[RTT_CB_HEADER_SIZE];
+	uint8_t *desc;
+	uint32_t cb;
+	int retval;
+
+	retval = rtt_find_cb(target, &cb);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("rtt: no control block with ID '%s' in 0x%8.8" PRIx32
+			"..0x%8.8" PRIx32, rtt.id, rtt.address, rtt.address + rtt.size);
+		return ERROR_FAIL;
+	}
+
+	retval = target_read_buffer(target, cb, RTT_CB_HEADER_SIZE, header);
+	if (retval != ERROR_OK)
+		return retval;
+
+	unsigned num_up = target_buffer_get_u32(target, header + RTT_CB_ID_SIZE);
+	unsigned num_down = target_buffer_get_u32(target, header + RTT_CB_ID_SIZE + 4);
+	if (num_up > RTT_MAX_CHANNELS || num_down > RTT_MAX_CHANNELS) {
+		LOG_ERROR("rtt: control block at 0x%8.8" PRIx32 " declares %u up and "
+			"%u down channels", cb, num_up, num_down);
+		return ERROR_FAIL;
+	}
+
+	desc = malloc((num_up + num_down) * RTT_DESC_SIZE + 1);
+	if (desc == NULL)
+		return ERROR_FAIL;
+	retval = target_read_buffer(target, cb + RTT_CB_HEADER_SIZE,
+			(num_up + num_down) * RTT_DESC_SIZE, desc);
+	if (retval != ERROR_OK) {
+		free(desc);
+		return retval;
+	}
+
+	uint32_t rx_size = 0;
+	for (unsigned i = 0; i < num_up + num_down; i++) {
+		struct rtt_channel *ch = i < num_up ? &rtt.up[i] : &rtt.down[i - num_up];
+		rtt_parse_channel(target, ch, cb + RTT_CB_HEADER_SIZE + i * RTT_DESC_SIZE,
+				desc + i * RTT_DESC_SIZE);
+		if (i < num_up && ch->size > rx_size)
+			rx_size = ch->size;
+	}
+	free(desc);
+
+	free(rtt.rx);
+	rtt.rx = malloc(rx_size ? rx_size : 1);
+	if (rtt.rx == NULL)
+		return ERROR_FAIL;
+	rtt.rx_size = rx_size;
+
+	rtt.target = target;
+	rtt.cb = cb;
+	rtt.num_up = num_up;
+	rtt.num_down = num_down;
+	rtt.started = true;
+
+	LOG_INFO("rtt: control block at 0x%8.8" PRIx32 ", %u up and %u down channels",
+		cb, num_up, num_down);
+
+	return target_register_timer_callback(rtt_poll, rtt.interval, 1, NULL);
+}
+
+static void rtt_stop(void)
+{
+	if (!rtt.started)
+		return;
+	target_unregister_timer_callback(rtt_poll, NULL);
+	rtt.started = false;
+}
+
+COMMAND_HANDLER(handle_rtt_setup_command)
+{
+	uint32_t address, size;
+
+	if (CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+
+	if (strlen(CMD_ARGV[2]) == 0 || strlen(CMD_ARGV[2]) >= RTT_CB_ID_SIZE) {
+		LOG_ERROR("rtt: the control block ID must have 1 to %d characters",
+			RTT_CB_ID_SIZE - 1);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	rtt_stop();
+	rtt.address = address;
+	rtt.size = size;
+	strcpy(rtt.id, CMD_ARGV[2]);
+	rtt.configured = true;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_start_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!rtt.configured) {
+		LOG_ERROR("rtt: use 'rtt setup' first");
+		return ERROR_FAIL;
+	}
+
+	rtt_stop();
+	return rtt_start(get_current_target(CMD_CTX));
+}
+
+COMMAND_HANDLER(handle_rtt_stop_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	rtt_stop();
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_polling_interval_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned interval;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], interval);
+		if (interval == 0)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+
+		rtt.interval = interval;
+		if (rtt.started) {
+			target_unregister_timer_callback(rtt_poll, NULL);
+			target_register_timer_callback(rtt_poll, rtt.interval, 1, NULL);
+		}
+	}
+
+	command_print(CMD_CTX, "rtt polling interval: %u ms", rtt.interval);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_channels_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!rtt.started) {
+		LOG_ERROR("rtt: not started");
+		return ERROR_FAIL;
+	}
+
+	command_print(CMD_CTX, "Up channels:");
+	for (unsigned i = 0; i < rtt.num_up; i++)
+		command_print(CMD_CTX, "%u: %s %" PRIu32 " 0x%" PRIx32, i,
+			rtt.up[i].name, rtt.up[i].size, rtt.up[i].flags);
+
+	command_print(CMD_CTX, "Down channels:");
+	for (unsigned i = 0; i < rtt.num_down; i++)
+		command_print(CMD_CTX, "%u: %s %" PRIu32 " 0x%" PRIx32, i,
+			rtt.down[i].name, rtt.down[i].size, rtt.down[i].flags);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration rtt_subcommand_handlers[] = {
+	{
+		.name = "setup",
+		.handler = handle_rtt_setup_command,
+		.mode = COMMAND_ANY,
+		.help = "set the memory region to search for the control block "
+			"and its ID string",
+		.usage = "address size ID",
+	},
+	{
+		.name = "start",
+		.handler = handle_rtt_start_command,
+		.mode = COMMAND_EXEC,
+		.help = "find the control block of the current target and "
+			"start polling its channels",
+		.usage = "",
+	},
+	{
+		.name = "stop",
+		.handler = handle_rtt_stop_command,
+		.mode = COMMAND_EXEC,
+		.help = "stop polling the RTT channels",
+		.usage = "",
+	},
+	{
+		.name = "polling_interval",
+		.handler = handle_rtt_polling_interval_command,
+		.mode = COMMAND_ANY,
+		.help = "display or set the polling interval in milliseconds",
+		.usage = "[ms]",
+	},
+	{
+		.name = "channels",
+		.handler = handle_rtt_channels_command,
+		.mode = COMMAND_EXEC,
+		.help = "list the up and down channels of the control block",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration rtt_command_handlers[] = {
+	{
+		.name = "rtt",
+		.mode = COMMAND_ANY,
+		.help = "Real Time Transfer channels",
+		.usage = "",
+		.chain = rtt_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int rtt_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, rtt_command_handlers);
+}
@@ -0,0 +1,50 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_TARGET_RTT_H
+#define OPENOCD_TARGET_RTT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct command_context;
+
+/*
+ * Real Time Transfer: the firmware keeps a control block in RAM that
+ * starts with an ID string and describes ring buffers, "up" buffers
+ * written by the target and "down" buffers written by the host. The
+ * debugger moves data through them with plain memory accesses while
+ * the core keeps running.
+ */
+
+/**
+ * Called with data read from up channel @a channel. Returning an error
+ * unregisters the sink.
+ */
+typedef int (*rtt_sink_t)(unsigned channel, const uint8_t *data,
+		size_t length, void *priv);
+
+int rtt_register_sink(unsigned channel, rtt_sink_t sink, void *priv);
+void rtt_unregister_sink(unsigned channel, void *priv);
+
+/**
+ * Queue up to @a *length bytes into down channel @a channel; @a *length
+ * is updated to what fit into the ring buffer.
+ */
+int rtt_write_channel(unsigned channel, const uint8_t *data, size_t *length);
+
+int rtt_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_TARGET_RTT_H */
@@ -42,15 +42,19 @@
 #endif
 
 #include <helper/time_support.h>
+#include <helper/metrics.h>
+#include <helper/timeline.h>
 #include <jtag/jtag.h>
 #include <flash/nor/core.h>
 
 #include "target.h"
 #include "target_type.h"
 #include "target_request.h"
+#include "algorithm.h"
 #include "breakpoints.h"
 #include "register.h"
 #include "trace.h"
+#include "rtt.h"
 #include "image.h"
 #include "rtos/rtos.h"
 #include "transport/transport.h"
@@ -66,7 +70,20 @@ static int target_array2mem(Jim_Interp *interp, struct target *target,
 		int argc, Jim_Obj * const *argv);
 static int target_mem2array(Jim_Interp *interp, struct target *target,
 		int argc, Jim_Obj * const *argv);
+static int target_mem2bin(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj * const *argv);
+static int target_bin2mem(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj * const *argv);
+static int target_mem2file(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj * const *argv);
+static int target_file2mem(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj * const *argv);
 static int target_register_user_commands(struct command_context *cmd_ctx);
+static int target_working_area_write(struct target *target,
+		uint32_t address, uint32_t size);
+static int target_backup_algorithm_memory(struct target *target,
+		int num_mem_params, struct mem_param *mem_params,
+		int num_reg_params, struct reg_param *reg_params);
 static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
@@ -793,6 +810,14 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	retval = target_backup_algorithm_memory(target, num_mem_params, mem_params,
+			num_reg_params, reg_param);
+	if (retval != ERROR_OK)
+		goto done;
+
+	struct timeline_span span;
+	timeline_begin(&span);
+
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
@@ -800,6 +825,8 @@ int target_run_algorithm(struct target *target,
 			entry_point, exit_point, timeout_ms, arch_info);
 	target->running_alg = false;
 
+	timeline_end(&span, "target", "run_algorithm", target_name(target));
+
 done:
 	return retval;
 }
@@ -833,12 +860,22 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	retval = target_backup_algorithm_memory(target, num_mem_params, mem_params,
+			num_reg_params, reg_params);
+	if (retval != ERROR_OK)
+		goto done;
+
+	struct timeline_span span;
+	timeline_begin(&span);
+
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_params,
 			entry_point, exit_point, arch_info);
 
+	timeline_end(&span, "target", "start_algorithm", target_name(target));
+
 done:
 	return retval;
 }
@@ -867,10 +904,16 @@ int target_wait_algorithm(struct target *target,
 		goto done;
 	}
 
+	struct timeline_span span;
+	timeline_begin(&span);
+
 	retval = target->type->wait_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_params,
 			exit_point, timeout_ms, arch_info);
+
+	timeline_end(&span, "target", "wait_algorithm", target_name(target));
+
 	if (retval != ERROR_TARGET_TIMEOUT)
 		target->running_alg = false;
 
@@ -1033,6 +1076,29 @@ int target_run_flash_async_algorithm(struct target *target,
 	return retval;
 }
 
+static struct metric_family target_read_bytes_metric =
+	METRIC_COUNTER("openocd_target_memory_read_bytes_total",
+		"Bytes read from target memory, by access size.", "size");
+static struct metric_family target_write_bytes_metric =
+	METRIC_COUNTER("openocd_target_memory_write_bytes_total",
+		"Bytes written to target memory, by access size.", "size");
+
+static const char *target_access_size_label(uint32_t size)
+{
+	switch (size) {
+	case 1:
+		return "1";
+	case 2:
+		return "2";
+	case 4:
+		return "4";
+	case 8:
+		return "8";
+	default:
+		return "other";
+	}
+}
+
 int target_read_memory(struct target *target,
 		uint32_t address, uint32_t size, uint32_t count, uint8_t *buffer)
 {
@@ -1044,6 +1110,7 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	metric_add_label(&target_read_bytes_metric, target_access_size_label(size), size * count);
 	return target->type->read_memory(target, address, size, count, buffer);
 }
 
@@ -1072,6 +1139,10 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	int retval = target_working_area_write(target, address, size * count);
+	if (retval != ERROR_OK)
+		return retval;
+	metric_add_label(&target_write_bytes_metric, target_access_size_label(size), size * count);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1086,6 +1157,9 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	int retval = target_working_area_write(target, address, size * count);
+	if (retval != ERROR_OK)
+		return retval;
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1575,6 +1649,10 @@ static int target_call_timer_callback(struct target_timer_callback *cb,
 	return target_unregister_timer_callback(cb->callback, cb->priv);
 }
 
+static struct metric_family target_timer_lateness_metric =
+	METRIC_HISTOGRAM_US("openocd_timer_callback_lateness_seconds",
+		"How late timer callbacks ran after they were due.");
+
 static int target_call_timer_callbacks_check_time(int checktime)
 {
 	static bool callback_processing;
@@ -1608,8 +1686,13 @@ static int target_call_timer_callbacks_check_time(int checktime)
 			 (now.tv_sec == (*callback)->when.tv_sec &&
 			  now.tv_usec >= (*callback)->when.tv_usec));
 
-		if (call_it)
+		if (call_it) {
+			int64_t late = (now.tv_sec - (*callback)->when.tv_sec) * 1000000ll
+				+ now.tv_usec - (*callback)->when.tv_usec;
+			if (late >= 0)
+				metric_observe(&target_timer_lateness_metric, late);
 			target_call_timer_callback(*callback, &now);
+		}
 
 		callback = &(*callback)->next;
 	}
@@ -1642,6 +1725,14 @@ static void print_wa_layout(struct target *target)
 	}
 }
 
+static void target_free_working_area_backup(struct working_area *area)
+{
+	free(area->backup);
+	area->backup = NULL;
+	free(area->dirty);
+	area->dirty = NULL;
+}
+
 /* Reduce area to size bytes, create a new free area from the remaining bytes, if any. */
 static void target_split_working_area(struct working_area *area, uint32_t size)
 {
@@ -1659,18 +1750,19 @@ static void target_split_working_area(struct working_area *area, uint32_t size)
 		new_wa->size = area->size - size;
 		new_wa->address = area->address + size;
 		new_wa->backup = NULL;
+		new_wa->dirty = NULL;
+		new_wa->algorithm_scratch = false;
 		new_wa->user = NULL;
 		new_wa->free = true;
+		new_wa->resident = false;
+		new_wa->code = NULL;
 
 		area->next = new_wa;
 		area->size = size;
 
 		/* If backup memory was allocated to this area, it has the wrong size
 		 * now so free it and it will be reallocated if/when needed */
-		if (area->backup) {
-			free(area->backup);
-			area->backup = NULL;
-		}
+		target_free_working_area_backup(area);
 	}
 }
 
@@ -1690,22 +1782,214 @@ static void target_merge_working_areas(struct target *target)
 			/* Remove the last */
 			struct working_area *to_be_freed = c->next;
 			c->next = c->next->next;
-			if (to_be_freed->backup)
-				free(to_be_freed->backup);
+			target_free_working_area_backup(to_be_freed);
 			free(to_be_freed);
 
 			/* If backup memory was allocated to the remaining area, it's has
 			 * the wrong size now */
-			if (c->backup) {
-				free(c->backup);
-				c->backup = NULL;
-			}
+			target_free_working_area_backup(c);
 		} else {
 			c = c->next;
 		}
 	}
 }
 
+static int target_restore_working_area(struct target *target, struct working_area *area);
+
+/* Turn a resident area back into an ordinary allocated one */
+static void target_release_resident_code(struct working_area *area)
+{
+	area->resident = false;
+	free(area->code);
+	area->code = NULL;
+}
+
+/* Give an idle resident code area back to the allocation pool */
+static void target_evict_code_area(struct target *target, struct working_area *area, bool restore)
+{
+	LOG_DEBUG("evicting resident code at address 0x%08"PRIx32, area->address);
+
+	/* release first, restoring the backup writes to the area */
+	target_release_resident_code(area);
+	if (restore)
+		target_restore_working_area(target, area);
+	area->free = true;
+}
+
+/* Free all idle resident code areas, returns true if any was freed */
+static bool target_evict_resident_code(struct target *target, bool restore)
+{
+	struct working_area *c;
+	bool evicted = false;
+
+	for (c = target->working_areas; c; c = c->next) {
+		if (c->resident && c->user == NULL) {
+			target_evict_code_area(target, c, restore);
+			evicted = true;
+		}
+	}
+
+	if (evicted)
+		target_merge_working_areas(target);
+
+	return evicted;
+}
+
+static bool target_area_word_dirty(struct working_area *area, uint32_t word)
+{
+	return area->dirty[word / 32] & (1u << (word % 32));
+}
+
+/* Back up the words of @a area in [first, last] that are not backed up
+ * yet, with a single read spanning all of them */
+static int target_backup_working_area_words(struct target *target,
+		struct working_area *area, uint32_t first, uint32_t last)
+{
+	uint8_t *buffer;
+	uint32_t word;
+	int retval;
+
+	while (first <= last && target_area_word_dirty(area, first))
+		first++;
+	while (last > first && target_area_word_dirty(area, last))
+		last--;
+	if (first > last)
+		return ERROR_OK;
+
+	/* words backed up before may have changed since, read around them */
+	buffer = malloc((last - first + 1) * 4);
+	if (buffer == NULL)
+		return ERROR_FAIL;
+
+	retval = target_read_memory(target, area->address + first * 4, 4,
+			last - first + 1, buffer);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("failed to back up working area at address 0x%08"PRIx32,
+				area->address + first * 4);
+		free(buffer);
+		return retval;
+	}
+
+	for (word = first; word <= last; word++) {
+		if (target_area_word_dirty(area, word))
+			continue;
+		memcpy(area->backup + word * 4, buffer + (word - first) * 4, 4);
+		area->dirty[word / 32] |= 1u << (word % 32);
+	}
+
+	free(buffer);
+	return ERROR_OK;
+}
+
+/**
+ * Called before target memory in [address, address + size) is changed.
+ * Idle resident code hit by the write is evicted. For allocated areas
+ * the original content of the words about to be overwritten is backed
+ * up, so only memory that was actually touched has to be restored.
+ */
+static int target_working_area_write(struct target *target,
+		uint32_t address, uint32_t size)
+{
+	struct working_area *c;
+	bool evicted = false;
+	int retval;
+
+	if (size == 0)
+		return ERROR_OK;
+
+	for (c = target->working_areas; c; c = c->next) {
+		if (c->free || address >= c->address + c->size || c->address >= address + size)
+			continue;
+
+		if (c->resident && c->user == NULL) {
+			target_evict_code_area(target, c, true);
+			evicted = true;
+			continue;
+		}
+
+		if (c->dirty == NULL)
+			continue;
+
+		uint32_t start = MAX(address, c->address) - c->address;
+		uint32_t end = MIN(address + size - c->address, c->size) - 1;
+		retval = target_backup_working_area_words(target, c, start / 4, end / 4);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (evicted)
+		target_merge_working_areas(target);
+
+	return ERROR_OK;
+}
+
+/* Does a register parameter handed to an algorithm point into @a area?
+ * A stack pointer usually points just past its end. */
+static bool target_reg_param_points_into(struct reg_param *param,
+		struct working_area *area)
+{
+	if (param->direction == PARAM_IN || param->size < 32)
+		return false;
+
+	uint32_t value = buf_get_u32(param->value, 0, 32);
+	return (value >= area->address && value - area->address < area->size)
+		|| (value > area->address && value - area->address == area->size);
+}
+
+/* An algorithm may write to memory OpenOCD never wrote, which the write
+ * hooks therefore haven't backed up. Before running one, back up the
+ * rest of every allocated area a register parameter points into (its
+ * stack, buffers for results) or that its caller flagged as
+ * algorithm_scratch, along with any memory parameters the algorithm
+ * writes. Other areas, e.g. the one holding the code, only keep the
+ * backup of what OpenOCD wrote to them.
+ */
+static int target_backup_algorithm_memory(struct target *target,
+		int num_mem_params, struct mem_param *mem_params,
+		int num_reg_params, struct reg_param *reg_params)
+{
+	struct working_area *c;
+	int retval;
+
+	for (c = target->working_areas; c; c = c->next) {
+		/* idle resident code isn't run, nobody changes it */
+		if (c->free || c->dirty == NULL || c->user == NULL || c->size < 4)
+			continue;
+
+		bool used = c->algorithm_scratch;
+		for (int i = 0; i < num_reg_params && !used; i++)
+			used = target_reg_param_points_into(&reg_params[i], c);
+		if (!used)
+			continue;
+
+		retval = target_backup_working_area_words(target, c, 0, c->size / 4 - 1);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (int i = 0; i < num_mem_params; i++) {
+		if (mem_params[i].direction == PARAM_OUT)
+			continue;
+		retval = target_working_area_write(target, mem_params[i].address, mem_params[i].size);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
+static uint32_t target_code_hash(const uint8_t *code, uint32_t size)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+
+	for (uint32_t i = 0; i < size; i++) {
+		hash ^= code[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 int target_alloc_working_area_try(struct target *target, uint32_t size, struct working_area **area)
 {
 	/* Reevaluate working area address based on MMU state*/
@@ -1748,8 +2032,12 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 			new_wa->size = target->working_area_size & ~3UL; /* 4-byte align */
 			new_wa->address = target->working_area;
 			new_wa->backup = NULL;
+			new_wa->dirty = NULL;
+			new_wa->algorithm_scratch = false;
 			new_wa->user = NULL;
 			new_wa->free = true;
+			new_wa->resident = false;
+			new_wa->code = NULL;
 		}
 
 		target->working_areas = new_wa;
@@ -1768,6 +2056,16 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 		c = c->next;
 	}
 
+	/* Make room by dropping idle resident algorithm code */
+	if (c == NULL && target_evict_resident_code(target, true)) {
+		c = target->working_areas;
+		while (c) {
+			if (c->free && c->size >= size)
+				break;
+			c = c->next;
+		}
+	}
+
 	if (c == NULL)
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 
@@ -1776,16 +2074,20 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 
 	LOG_DEBUG("allocated new working area of %"PRIu32" bytes at address 0x%08"PRIx32, size, c->address);
 
+	c->algorithm_scratch = false;
+
+	/* The backup is read lazily, just before OpenOCD writes to the area */
 	if (target->backup_working_area) {
 		if (c->backup == NULL) {
 			c->backup = malloc(c->size);
-			if (c->backup == NULL)
+			c->dirty = calloc(DIV_ROUND_UP(c->size / 4, 32), sizeof(uint32_t));
+			if (c->backup == NULL || c->dirty == NULL) {
+				target_free_working_area_backup(c);
 				return ERROR_FAIL;
+			}
+		} else {
+			memset(c->dirty, 0, DIV_ROUND_UP(c->size / 4, 32) * sizeof(uint32_t));
 		}
-
-		int retval = target_read_memory(target, c->address, 4, c->size / 4, c->backup);
-		if (retval != ERROR_OK)
-			return retval;
 	}
 
 	/* mark as used, and return the new (reused) area */
@@ -1811,17 +2113,76 @@ int target_alloc_working_area(struct target *target, uint32_t size, struct worki
 
 }
 
+int target_alloc_working_area_code(struct target *target,
+		const uint8_t *code, uint32_t size, struct working_area **area)
+{
+	uint32_t hash = target_code_hash(code, size);
+	struct working_area *c;
+	int retval;
+
+	for (c = target->working_areas; c; c = c->next) {
+		if (c->resident && c->user == NULL && c->code_size == size &&
+				c->code_hash == hash && memcmp(c->code, code, size) == 0) {
+			LOG_DEBUG("reusing resident code at address 0x%08"PRIx32, c->address);
+			c->user = area;
+			*area = c;
+			return ERROR_OK;
+		}
+	}
+
+	retval = target_alloc_working_area(target, size, area);
+	if (retval != ERROR_OK)
+		return retval;
+
+	c = *area;
+	retval = target_write_buffer(target, c->address, size, code);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, c);
+		return retval;
+	}
+
+	/* without a copy to compare against it is simply not kept */
+	c->code = malloc(size);
+	if (c->code != NULL) {
+		memcpy(c->code, code, size);
+		c->code_size = size;
+		c->code_hash = hash;
+		c->resident = true;
+	}
+
+	return ERROR_OK;
+}
+
 static int target_restore_working_area(struct target *target, struct working_area *area)
 {
 	int retval = ERROR_OK;
 
-	if (target->backup_working_area && area->backup != NULL) {
-		retval = target_write_memory(target, area->address, 4, area->size / 4, area->backup);
-		if (retval != ERROR_OK)
+	if (!target->backup_working_area || area->backup == NULL)
+		return retval;
+
+	/* only write back the words that were backed up before being changed */
+	for (uint32_t word = 0; word < area->size / 4; ) {
+		uint32_t end;
+
+		if (!target_area_word_dirty(area, word)) {
+			word++;
+			continue;
+		}
+
+		for (end = word + 1; end < area->size / 4 && target_area_word_dirty(area, end); end++)
+			;
+
+		retval = target_write_memory(target, area->address + word * 4, 4,
+				end - word, area->backup + word * 4);
+		if (retval != ERROR_OK) {
 			LOG_ERROR("failed to restore %"PRIu32" bytes of working area at address 0x%08"PRIx32,
-					area->size, area->address);
+					(end - word) * 4, area->address + word * 4);
+			return retval;
+		}
+		word = end;
 	}
 
+	memset(area->dirty, 0, DIV_ROUND_UP(area->size / 4, 32) * sizeof(uint32_t));
 	return retval;
 }
 
@@ -1833,6 +2194,14 @@ static int target_free_working_area_restore(struct target *target, struct workin
 	if (area->free)
 		return retval;
 
+	/* keep resident code allocated, it is restored when evicted */
+	if (area->resident) {
+		LOG_DEBUG("keeping resident code at address 0x%08"PRIx32, area->address);
+		*area->user = NULL;
+		area->user = NULL;
+		return retval;
+	}
+
 	if (restore) {
 		retval = target_restore_working_area(target, area);
 		/* REVISIT: Perhaps the area should be freed even if restoring fails. */
@@ -1901,10 +2270,12 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 	/* Loop through all areas, restoring the allocated ones and marking them as free */
 	while (c) {
 		if (!c->free) {
+			target_release_resident_code(c);
 			if (restore)
 				target_restore_working_area(target, c);
 			c->free = true;
-			*c->user = NULL; /* Same as above */
+			if (c->user)
+				*c->user = NULL; /* Same as above */
 			c->user = NULL;
 		}
 		c = c->next;
@@ -2045,6 +2416,9 @@ int target_write_buffer(struct target *target, uint32_t address, uint32_t size,
 		return ERROR_FAIL;
 	}
 
+	int retval = target_working_area_write(target, address, size);
+	if (retval != ERROR_OK)
+		return retval;
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2199,6 +2573,24 @@ int target_blank_check_memory(struct target *target, uint32_t address, uint32_t
 	return retval;
 }
 
+/* below this the stub download costs more than compression saves */
+#define TARGET_COMPRESS_MIN_SIZE	4096
+
+static bool target_compressed_download;
+
+int target_write_compressed(struct target *target, uint32_t address, uint32_t size, const uint8_t *buffer)
+{
+	if (target_compressed_download && target->type->write_compressed
+			&& target->state == TARGET_HALTED && size >= TARGET_COMPRESS_MIN_SIZE
+			&& target_was_examined(target)) {
+		int retval = target->type->write_compressed(target, address, size, buffer);
+		if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+			return retval;
+	}
+
+	return target_write_buffer(target, address, size, buffer);
+}
+
 int target_read_u64(struct target *target, uint64_t address, uint64_t *value)
 {
 	uint8_t value_buf[8];
@@ -3152,6 +3544,7 @@ static COMMAND_HELPER(parse_load_image_command_CMD_ARGV, struct image *image,
 COMMAND_HANDLER(handle_load_image_command)
 {
 	uint8_t *buffer;
+	const uint8_t *data;
 	size_t buf_cnt;
 	uint32_t image_size;
 	uint32_t min_address = 0;
@@ -3175,19 +3568,27 @@ COMMAND_HANDLER(handle_load_image_command)
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
+		/* write straight from the parsed or mapped image where possible */
+		buffer = NULL;
+		data = image_section_data(&image, i);
+		if (data != NULL) {
+			buf_cnt = image.sections[i].size;
+		} else {
+			buffer = malloc(image.sections[i].size);
+			if (buffer == NULL) {
+				command_print(CMD_CTX,
+							  "error allocating buffer for section (%d bytes)",
+							  (int)(image.sections[i].size));
+				retval = ERROR_FAIL;
+				break;
+			}
 
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			data = buffer;
 		}
 
 		uint32_t offset = 0;
@@ -3207,8 +3608,8 @@ COMMAND_HANDLER(handle_load_image_command)
 			if (image.sections[i].base_address + buf_cnt > max_address)
 				length -= (image.sections[i].base_address + buf_cnt)-max_address;
 
-			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
+			retval = target_write_compressed(target,
+					image.sections[i].base_address + offset, length, data + offset);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3305,6 +3706,7 @@ enum verify_mode {
 static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode verify)
 {
 	uint8_t *buffer;
+	const uint8_t *image_data;
 	size_t buf_cnt;
 	uint32_t image_size;
 	int i;
@@ -3347,22 +3749,30 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 	int diffs = 0;
 	retval = ERROR_OK;
 	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX,
-					"error allocating buffer for section (%d bytes)",
-					(int)(image.sections[i].size));
-			break;
-		}
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+		/* compare straight with the parsed or mapped image where possible */
+		buffer = NULL;
+		image_data = image_section_data(&image, i);
+		if (image_data != NULL) {
+			buf_cnt = image.sections[i].size;
+		} else {
+			buffer = malloc(image.sections[i].size);
+			if (buffer == NULL) {
+				command_print(CMD_CTX,
+						"error allocating buffer for section (%d bytes)",
+						(int)(image.sections[i].size));
+				break;
+			}
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			image_data = buffer;
 		}
 
 		if (verify >= IMAGE_VERIFY) {
-			/* calculate checksum of image */
-			retval = image_calculate_checksum(buffer, buf_cnt, &checksum);
+			/* calculate checksum of image, cached along with the image */
+			retval = image_section_checksum(&image, i, &checksum);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3399,13 +3809,13 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 				if (retval == ERROR_OK) {
 					uint32_t t;
 					for (t = 0; t < buf_cnt; t++) {
-						if (data[t] != buffer[t]) {
+						if (data[t] != image_data[t]) {
 							command_print(CMD_CTX,
 										  "diff %d address 0x%08x. Was 0x%02x instead of 0x%02x",
 										  diffs,
 										  (unsigned)(t + image.sections[i].base_address),
 										  data[t],
-										  buffer[t]);
+										  image_data[t]);
 							if (diffs++ >= 127) {
 								command_print(CMD_CTX, "More than 128 errors, the rest are not printed.");
 								free(data);
@@ -3935,6 +4345,44 @@ static int jim_mem2array(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 	return target_mem2array(interp, target, argc - 1, argv + 1);
 }
 
+static int jim_current_target_bin(Jim_Interp *interp, int argc, Jim_Obj *const *argv,
+		int (*fn)(Jim_Interp *interp, struct target *target, int argc, Jim_Obj *const *argv))
+{
+	struct command_context *context;
+	struct target *target;
+
+	context = current_command_context(interp);
+	assert(context != NULL);
+
+	target = get_current_target(context);
+	if (target == NULL) {
+		LOG_ERROR("%s: no current target", Jim_GetString(argv[0], NULL));
+		return JIM_ERR;
+	}
+
+	return fn(interp, target, argc, argv);
+}
+
+static int jim_mem2bin(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	return jim_current_target_bin(interp, argc, argv, target_mem2bin);
+}
+
+static int jim_bin2mem(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	return jim_current_target_bin(interp, argc, argv, target_bin2mem);
+}
+
+static int jim_mem2file(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	return jim_current_target_bin(interp, argc, argv, target_mem2file);
+}
+
+static int jim_file2mem(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	return jim_current_target_bin(interp, argc, argv, target_file2mem);
+}
+
 static int target_mem2array(Jim_Interp *interp, struct target *target, int argc, Jim_Obj *const *argv)
 {
 	long l;
@@ -4295,26 +4743,378 @@ static int target_array2mem(Jim_Interp *interp, struct target *target,
 	return e;
 }
 
-/* FIX? should we propagate errors here rather than printing them
- * and continuing?
+/* Binary memory transfers: target memory is moved to and from Jim binary
+ * strings or host files in large chunks, without per-element variable
+ * lookups. Elements are in target byte order unless "little" or "big"
+ * asks for a specific one.
  */
-void target_handle_event(struct target *target, enum target_event e)
+#define TARGET_BIN_CHUNK	(64 * 1024)
+
+struct target_bin_xfer {
+	uint32_t width;
+	bool is_phys;
+	bool swap;
+};
+
+static int target_bin_parse(Jim_Interp *interp, struct target *target,
+		const char *cmd_name, Jim_Obj *width_obj, int argc, Jim_Obj *const *argv,
+		struct target_bin_xfer *xfer)
 {
-	struct target_event_action *teap;
+	long l;
 
-	for (teap = target->event_action; teap != NULL; teap = teap->next) {
-		if (teap->event == e) {
-			LOG_DEBUG("target: (%d) %s (%s) event: %d (%s) action: %s",
-					   target->target_number,
-					   target_name(target),
+	if (Jim_GetLong(interp, width_obj, &l) != JIM_OK)
+		return JIM_ERR;
+
+	switch (l) {
+		case 8:
+			xfer->width = 1;
+			break;
+		case 16:
+			xfer->width = 2;
+			break;
+		case 32:
+			xfer->width = 4;
+			break;
+		default:
+			Jim_SetResultFormatted(interp, "%s: invalid width param, must be 8/16/32", cmd_name);
+			return JIM_ERR;
+	}
+
+	xfer->is_phys = false;
+	xfer->swap = false;
+	for (int i = 0; i < argc; i++) {
+		const char *opt = Jim_GetString(argv[i], NULL);
+		if (strcmp(opt, "phys") == 0)
+			xfer->is_phys = true;
+		else if (strcmp(opt, "little") == 0)
+			xfer->swap = target->endianness == TARGET_BIG_ENDIAN;
+		else if (strcmp(opt, "big") == 0)
+			xfer->swap = target->endianness == TARGET_LITTLE_ENDIAN;
+		else {
+			Jim_SetResultFormatted(interp, "%s: unknown option '%s'", cmd_name, opt);
+			return JIM_ERR;
+		}
+	}
+	if (xfer->width == 1)
+		xfer->swap = false;
+
+	return JIM_OK;
+}
+
+static int target_bin_check(Jim_Interp *interp, const char *cmd_name,
+		const struct target_bin_xfer *xfer, uint32_t addr, uint64_t bytes)
+{
+	if (addr % xfer->width) {
+		Jim_SetResultFormatted(interp, "%s: address is not aligned to the access width", cmd_name);
+		return JIM_ERR;
+	}
+	if (bytes % xfer->width) {
+		Jim_SetResultFormatted(interp, "%s: length is not a multiple of the access width", cmd_name);
+		return JIM_ERR;
+	}
+	if (addr + bytes > 0x100000000ULL) {
+		Jim_SetResultFormatted(interp, "%s: addr + len - wraps to zero?", cmd_name);
+		return JIM_ERR;
+	}
+	return JIM_OK;
+}
+
+static void target_bin_swap(const struct target_bin_xfer *xfer,
+		uint8_t *dst, const uint8_t *src, uint32_t len)
+{
+	if (xfer->width == 2)
+		buf_bswap16(dst, src, len);
+	else
+		buf_bswap32(dst, src, len);
+}
+
+static int target_bin_read(struct target *target, const struct target_bin_xfer *xfer,
+		uint32_t addr, uint32_t len, uint8_t *buffer)
+{
+	uint32_t count = len / xfer->width;
+	int retval;
+
+	if (xfer->is_phys)
+		retval = target_read_phys_memory(target, addr, xfer->width, count, buffer);
+	else
+		retval = target_read_memory(target, addr, xfer->width, count, buffer);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Read @ 0x%08" PRIx32 ", w=%" PRIu32 ", cnt=%" PRIu32 ", failed",
+				addr, xfer->width, count);
+		return retval;
+	}
+
+	if (xfer->swap)
+		target_bin_swap(xfer, buffer, buffer, len);
+	return ERROR_OK;
+}
+
+/* @a scratch must hold @a len bytes, it is only used when swapping */
+static int target_bin_write(struct target *target, const struct target_bin_xfer *xfer,
+		uint32_t addr, uint32_t len, const uint8_t *data, uint8_t *scratch)
+{
+	uint32_t count = len / xfer->width;
+	int retval;
+
+	if (xfer->swap) {
+		target_bin_swap(xfer, scratch, data, len);
+		data = scratch;
+	}
+
+	if (xfer->is_phys)
+		retval = target_write_phys_memory(target, addr, xfer->width, count, data);
+	else
+		retval = target_write_memory(target, addr, xfer->width, count, data);
+	if (retval != ERROR_OK)
+		LOG_ERROR("Write @ 0x%08" PRIx32 ", w=%" PRIu32 ", cnt=%" PRIu32 ", failed",
+				addr, xfer->width, count);
+	return retval;
+}
+
+static int target_mem2bin(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	const char *cmd_name = Jim_GetString(argv[0], NULL);
+	struct target_bin_xfer xfer;
+	jim_wide addr, count;
+	uint64_t bytes;
+	char *data;
+
+	/* argv[1] = width, argv[2] = address, argv[3] = count */
+	if (argc < 4) {
+		Jim_WrongNumArgs(interp, 1, argv, "width addr nelems [phys] [little|big]");
+		return JIM_ERR;
+	}
+	if (Jim_GetWide(interp, argv[2], &addr) != JIM_OK ||
+			Jim_GetWide(interp, argv[3], &count) != JIM_OK)
+		return JIM_ERR;
+	if (target_bin_parse(interp, target, cmd_name, argv[1], argc - 4, argv + 4, &xfer) != JIM_OK)
+		return JIM_ERR;
+
+	bytes = (uint64_t)count * xfer.width;
+	if (count < 0 || bytes > INT_MAX) {
+		Jim_SetResultFormatted(interp, "%s: invalid element count", cmd_name);
+		return JIM_ERR;
+	}
+	if (target_bin_check(interp, cmd_name, &xfer, addr, bytes) != JIM_OK)
+		return JIM_ERR;
+
+	/* read straight into the result string, Jim takes ownership of it */
+	data = Jim_Alloc(bytes + 1);
+	for (uint32_t done = 0; done < bytes; ) {
+		uint32_t len = MIN(bytes - done, TARGET_BIN_CHUNK);
+
+		if (target_bin_read(target, &xfer, addr + done, len, (uint8_t *)data + done) != ERROR_OK) {
+			Jim_Free(data);
+			Jim_SetResultFormatted(interp, "%s: cannot read memory", cmd_name);
+			return JIM_ERR;
+		}
+		done += len;
+		keep_alive();
+	}
+	data[bytes] = '\0';
+
+	Jim_SetResult(interp, Jim_NewStringObjNoAlloc(interp, data, bytes));
+	return JIM_OK;
+}
+
+static int target_bin2mem(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	const char *cmd_name = Jim_GetString(argv[0], NULL);
+	struct target_bin_xfer xfer;
+	const uint8_t *data;
+	uint8_t *scratch = NULL;
+	jim_wide addr;
+	int bytes;
+	int e = JIM_OK;
+
+	/* argv[1] = width, argv[2] = address, argv[3] = binary string */
+	if (argc < 4) {
+		Jim_WrongNumArgs(interp, 1, argv, "width addr data [phys] [little|big]");
+		return JIM_ERR;
+	}
+	if (Jim_GetWide(interp, argv[2], &addr) != JIM_OK)
+		return JIM_ERR;
+	if (target_bin_parse(interp, target, cmd_name, argv[1], argc - 4, argv + 4, &xfer) != JIM_OK)
+		return JIM_ERR;
+
+	data = (const uint8_t *)Jim_GetString(argv[3], &bytes);
+	if (target_bin_check(interp, cmd_name, &xfer, addr, bytes) != JIM_OK)
+		return JIM_ERR;
+
+	if (xfer.swap) {
+		scratch = malloc(TARGET_BIN_CHUNK);
+		if (scratch == NULL)
+			return JIM_ERR;
+	}
+
+	for (int done = 0; done < bytes; ) {
+		uint32_t len = MIN(bytes - done, TARGET_BIN_CHUNK);
+
+		if (target_bin_write(target, &xfer, addr + done, len, data + done, scratch) != ERROR_OK) {
+			Jim_SetResultFormatted(interp, "%s: cannot write memory", cmd_name);
+			e = JIM_ERR;
+			break;
+		}
+		done += len;
+		keep_alive();
+	}
+
+	free(scratch);
+	return e;
+}
+
+static int target_mem2file(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	const char *cmd_name = Jim_GetString(argv[0], NULL);
+	struct target_bin_xfer xfer;
+	struct fileio *fileio;
+	jim_wide addr, count;
+	uint64_t bytes;
+	uint8_t *buffer;
+	int retval = ERROR_OK;
+
+	/* argv[1] = filename, argv[2] = width, argv[3] = address, argv[4] = count */
+	if (argc < 5) {
+		Jim_WrongNumArgs(interp, 1, argv, "filename width addr nelems [phys] [little|big]");
+		return JIM_ERR;
+	}
+	if (Jim_GetWide(interp, argv[3], &addr) != JIM_OK ||
+			Jim_GetWide(interp, argv[4], &count) != JIM_OK)
+		return JIM_ERR;
+	if (target_bin_parse(interp, target, cmd_name, argv[2], argc - 5, argv + 5, &xfer) != JIM_OK)
+		return JIM_ERR;
+
+	bytes = (uint64_t)count * xfer.width;
+	if (count < 0 || target_bin_check(interp, cmd_name, &xfer, addr, bytes) != JIM_OK)
+		return JIM_ERR;
+
+	buffer = malloc(TARGET_BIN_CHUNK);
+	if (buffer == NULL)
+		return JIM_ERR;
+
+	if (fileio_open(&fileio, Jim_GetString(argv[1], NULL), FILEIO_WRITE, FILEIO_BINARY) != ERROR_OK) {
+		free(buffer);
+		Jim_SetResultFormatted(interp, "%s: cannot open '%#s'", cmd_name, argv[1]);
+		return JIM_ERR;
+	}
+
+	for (uint64_t done = 0; done < bytes; ) {
+		uint32_t len = MIN(bytes - done, TARGET_BIN_CHUNK);
+		size_t written;
+
+		retval = target_bin_read(target, &xfer, addr + done, len, buffer);
+		if (retval != ERROR_OK)
+			break;
+		retval = fileio_write(fileio, len, buffer, &written);
+		if (retval != ERROR_OK)
+			break;
+		done += len;
+		keep_alive();
+	}
+
+	free(buffer);
+	if (fileio_close(fileio) != ERROR_OK || retval != ERROR_OK) {
+		Jim_SetResultFormatted(interp, "%s: transfer failed", cmd_name);
+		return JIM_ERR;
+	}
+	return JIM_OK;
+}
+
+static int target_file2mem(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	const char *cmd_name = Jim_GetString(argv[0], NULL);
+	struct target_bin_xfer xfer;
+	struct fileio *fileio;
+	jim_wide addr;
+	size_t bytes;
+	uint8_t *buffer, *scratch;
+	int retval;
+
+	/* argv[1] = filename, argv[2] = width, argv[3] = address */
+	if (argc < 4) {
+		Jim_WrongNumArgs(interp, 1, argv, "filename width addr [phys] [little|big]");
+		return JIM_ERR;
+	}
+	if (Jim_GetWide(interp, argv[3], &addr) != JIM_OK)
+		return JIM_ERR;
+	if (target_bin_parse(interp, target, cmd_name, argv[2], argc - 4, argv + 4, &xfer) != JIM_OK)
+		return JIM_ERR;
+
+	if (fileio_open(&fileio, Jim_GetString(argv[1], NULL), FILEIO_READ, FILEIO_BINARY) != ERROR_OK) {
+		Jim_SetResultFormatted(interp, "%s: cannot open '%#s'", cmd_name, argv[1]);
+		return JIM_ERR;
+	}
+
+	retval = fileio_size(fileio, &bytes);
+	if (retval != ERROR_OK || target_bin_check(interp, cmd_name, &xfer, addr, bytes) != JIM_OK) {
+		fileio_close(fileio);
+		return JIM_ERR;
+	}
+
+	/* second half of the buffer is scratch space for byte swapping */
+	buffer = malloc(2 * TARGET_BIN_CHUNK);
+	if (buffer == NULL) {
+		fileio_close(fileio);
+		return JIM_ERR;
+	}
+	scratch = buffer + TARGET_BIN_CHUNK;
+
+	for (size_t done = 0; done < bytes; ) {
+		size_t len;
+
+		retval = fileio_read(fileio, MIN(bytes - done, TARGET_BIN_CHUNK), buffer, &len);
+		if (retval != ERROR_OK)
+			break;
+		if (len == 0 || len % xfer.width) {
+			LOG_ERROR("%s: short read from file", cmd_name);
+			retval = ERROR_FAIL;
+			break;
+		}
+		retval = target_bin_write(target, &xfer, addr + done, len, buffer, scratch);
+		if (retval != ERROR_OK)
+			break;
+		done += len;
+		keep_alive();
+	}
+
+	free(buffer);
+	fileio_close(fileio);
+	if (retval != ERROR_OK) {
+		Jim_SetResultFormatted(interp, "%s: transfer failed", cmd_name);
+		return JIM_ERR;
+	}
+	return JIM_OK;
+}
+
+/* FIX? should we propagate errors here rather than printing them
+ * and continuing?
+ */
+void target_handle_event(struct target *target, enum target_event e)
+{
+	struct target_event_action *teap;
+	struct timeline_span span;
+
+	for (teap = target->event_action; teap != NULL; teap = teap->next) {
+		if (teap->event == e) {
+			LOG_DEBUG("target: (%d) %s (%s) event: %d (%s) action: %s",
+					   target->target_number,
+					   target_name(target),
 					   target_type_name(target),
 					   e,
 					   Jim_Nvp_value2name_simple(nvp_target_event, e)->name,
 					   Jim_GetString(teap->body, NULL));
+			timeline_begin(&span);
 			if (Jim_EvalObj(teap->interp, teap->body) != JIM_OK) {
 				Jim_MakeErrorMessage(teap->interp);
 				command_print(NULL, "%s\n", Jim_GetString(Jim_GetResult(teap->interp), NULL));
 			}
+			timeline_end(&span, "event",
+					Jim_Nvp_value2name_simple(nvp_target_event, e)->name,
+					target_name(target));
 		}
 	}
 }
@@ -4901,6 +5701,34 @@ static int jim_target_array2mem(Jim_Interp *interp,
 	return target_array2mem(interp, target, argc - 1, argv + 1);
 }
 
+static int jim_target_mem2bin(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_mem2bin(interp, target, argc, argv);
+}
+
+static int jim_target_bin2mem(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_bin2mem(interp, target, argc, argv);
+}
+
+static int jim_target_mem2file(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_mem2file(interp, target, argc, argv);
+}
+
+static int jim_target_file2mem(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_file2mem(interp, target, argc, argv);
+}
+
 static int jim_target_tap_disabled(Jim_Interp *interp)
 {
 	Jim_SetResultFormatted(interp, "[TAP is disabled]");
@@ -5225,6 +6053,34 @@ static const struct command_registration target_instance_command_handlers[] = {
 			"from target memory",
 		.usage = "arrayname bitwidth address count",
 	},
+	{
+		.name = "mem2bin",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_mem2bin,
+		.help = "Reads 8/16/32 bit target memory into a binary string",
+		.usage = "width address count [phys] [little|big]",
+	},
+	{
+		.name = "bin2mem",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_bin2mem,
+		.help = "Writes a binary string to target memory using 8/16/32 bit accesses",
+		.usage = "width address data [phys] [little|big]",
+	},
+	{
+		.name = "mem2file",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_mem2file,
+		.help = "Dumps 8/16/32 bit target memory to a host file",
+		.usage = "filename width address count [phys] [little|big]",
+	},
+	{
+		.name = "file2mem",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_file2mem,
+		.help = "Writes a host file to target memory using 8/16/32 bit accesses",
+		.usage = "filename width address [phys] [little|big]",
+	},
 	{
 		.name = "eventlist",
 		.mode = COMMAND_EXEC,
@@ -5642,33 +6498,22 @@ static const struct command_registration target_subcommand_handlers[] = {
 	COMMAND_REGISTRATION_DONE
 };
 
-struct FastLoad {
-	uint32_t address;
-	uint8_t *data;
-	int length;
-
-};
-
-static int fastload_num;
-static struct FastLoad *fastload;
+/* image held in memory by fast_load_image, for fast_load */
+static struct image fastload_image;
+static bool fastload_valid;
+static uint32_t fastload_min_address;
+static uint32_t fastload_max_address;
 
 static void free_fastload(void)
 {
-	if (fastload != NULL) {
-		int i;
-		for (i = 0; i < fastload_num; i++) {
-			if (fastload[i].data)
-				free(fastload[i].data);
-		}
-		free(fastload);
-		fastload = NULL;
+	if (fastload_valid) {
+		image_close(&fastload_image);
+		fastload_valid = false;
 	}
 }
 
 COMMAND_HANDLER(handle_fast_load_image_command)
 {
-	uint8_t *buffer;
-	size_t buf_cnt;
 	uint32_t image_size;
 	uint32_t min_address = 0;
 	uint32_t max_address = 0xffffffff;
@@ -5684,41 +6529,26 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 	struct duration bench;
 	duration_start(&bench);
 
-	retval = image_open(&image, CMD_ARGV[0], (CMD_ARGC >= 3) ? CMD_ARGV[2] : NULL);
+	free_fastload();
+
+	/* the parsed image cache keeps a copy, even when disabled */
+	retval = image_open_cached(&image, CMD_ARGV[0], (CMD_ARGC >= 3) ? CMD_ARGV[2] : NULL);
 	if (retval != ERROR_OK)
 		return retval;
-
-	image_size = 0x0;
-	retval = ERROR_OK;
-	fastload_num = image.num_sections;
-	fastload = malloc(sizeof(struct FastLoad)*image.num_sections);
-	if (fastload == NULL) {
-		command_print(CMD_CTX, "out of memory");
+	if (image.type == IMAGE_MEMORY) {
 		image_close(&image);
-		return ERROR_FAIL;
+		LOG_ERROR("fast_load_image needs an image file");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
 	}
-	memset(fastload, 0, sizeof(struct FastLoad)*image.num_sections);
-	for (i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD_CTX, "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
-
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
-		}
 
+	image_size = 0x0;
+	for (i = 0; i < image.num_sections; i++) {
 		uint32_t offset = 0;
-		uint32_t length = buf_cnt;
+		uint32_t length = image.sections[i].size;
 
 		/* DANGER!!! beware of unsigned comparision here!!! */
 
-		if ((image.sections[i].base_address + buf_cnt >= min_address) &&
+		if ((image.sections[i].base_address + length >= min_address) &&
 				(image.sections[i].base_address < max_address)) {
 			if (image.sections[i].base_address < min_address) {
 				/* clip addresses below */
@@ -5726,31 +6556,17 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 				length -= offset;
 			}
 
-			if (image.sections[i].base_address + buf_cnt > max_address)
-				length -= (image.sections[i].base_address + buf_cnt)-max_address;
-
-			fastload[i].address = image.sections[i].base_address + offset;
-			fastload[i].data = malloc(length);
-			if (fastload[i].data == NULL) {
-				free(buffer);
-				command_print(CMD_CTX, "error allocating buffer for section (%" PRIu32 " bytes)",
-							  length);
-				retval = ERROR_FAIL;
-				break;
-			}
-			memcpy(fastload[i].data, buffer + offset, length);
-			fastload[i].length = length;
+			if (image.sections[i].base_address + image.sections[i].size > max_address)
+				length -= (image.sections[i].base_address + image.sections[i].size)-max_address;
 
 			image_size += length;
 			command_print(CMD_CTX, "%u bytes written at address 0x%8.8x",
 						  (unsigned int)length,
 						  ((unsigned int)(image.sections[i].base_address + offset)));
 		}
-
-		free(buffer);
 	}
 
-	if ((ERROR_OK == retval) && (duration_measure(&bench) == ERROR_OK)) {
+	if (duration_measure(&bench) == ERROR_OK) {
 		command_print(CMD_CTX, "Loaded %" PRIu32 " bytes "
 				"in %fs (%0.3f KiB/s)", image_size,
 				duration_elapsed(&bench), duration_kbps(&bench, image_size));
@@ -5760,35 +6576,51 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 				"You can issue a 'fast_load' to finish loading.");
 	}
 
-	image_close(&image);
-
-	if (retval != ERROR_OK)
-		free_fastload();
+	fastload_image = image;
+	fastload_min_address = min_address;
+	fastload_max_address = max_address;
+	fastload_valid = true;
 
-	return retval;
+	return ERROR_OK;
 }
 
 COMMAND_HANDLER(handle_fast_load_command)
 {
 	if (CMD_ARGC > 0)
 		return ERROR_COMMAND_SYNTAX_ERROR;
-	if (fastload == NULL) {
+	if (!fastload_valid) {
 		LOG_ERROR("No image in memory");
 		return ERROR_FAIL;
 	}
+	struct image *image = &fastload_image;
 	int i;
 	int64_t ms = timeval_ms();
 	int size = 0;
 	int retval = ERROR_OK;
-	for (i = 0; i < fastload_num; i++) {
+	for (i = 0; i < image->num_sections; i++) {
 		struct target *target = get_current_target(CMD_CTX);
+		uint32_t address = image->sections[i].base_address;
+		uint32_t offset = 0;
+		uint32_t length = image->sections[i].size;
+
+		if (address + length < fastload_min_address || address >= fastload_max_address)
+			continue;
+		if (address < fastload_min_address) {
+			/* clip addresses below */
+			offset += fastload_min_address - address;
+			length -= offset;
+		}
+		if (address + image->sections[i].size > fastload_max_address)
+			length -= (address + image->sections[i].size) - fastload_max_address;
+
 		command_print(CMD_CTX, "Write to 0x%08x, length 0x%08x",
-					  (unsigned int)(fastload[i].address),
-					  (unsigned int)(fastload[i].length));
-		retval = target_write_buffer(target, fastload[i].address, fastload[i].length, fastload[i].data);
+					  (unsigned int)(address + offset),
+					  (unsigned int)length);
+		retval = target_write_compressed(target, address + offset, length,
+				image_section_data(image, i) + offset);
 		if (retval != ERROR_OK)
 			break;
-		size += fastload[i].length;
+		size += length;
 	}
 	if (retval == ERROR_OK) {
 		int64_t after = timeval_ms();
@@ -5797,6 +6629,47 @@ COMMAND_HANDLER(handle_fast_load_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_target_compressed_download)
+{
+	return CALL_COMMAND_HANDLER(handle_command_parse_bool,
+			&target_compressed_download, "Compressed download");
+}
+
+COMMAND_HANDLER(handle_image_cache_command)
+{
+	bool enable = image_cache_is_enabled();
+	int retval = CALL_COMMAND_HANDLER(handle_command_parse_bool,
+			&enable, "Image cache");
+	if (retval == ERROR_OK)
+		image_cache_enable(enable);
+	return retval;
+}
+
+COMMAND_HANDLER(handle_image_cache_dir_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		int retval = image_cache_set_directory(strcmp(CMD_ARGV[0], "none") ? CMD_ARGV[0] : NULL);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	const char *directory = image_cache_get_directory();
+	command_print(CMD_CTX, "image cache directory: %s", directory ? directory : "none");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_image_cache_flush_command)
+{
+	if (CMD_ARGC > 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	image_cache_flush();
+	return ERROR_OK;
+}
+
 static const struct command_registration target_command_handlers[] = {
 	{
 		.name = "targets",
@@ -5813,6 +6686,36 @@ static const struct command_registration target_command_handlers[] = {
 
 		.chain = target_subcommand_handlers,
 	},
+	{
+		.name = "compressed_download",
+		.handler = handle_target_compressed_download,
+		.mode = COMMAND_ANY,
+		.help = "Download load_image sections LZ4 compressed and "
+				"decompress them on the target, where supported.",
+		.usage = "['enable'|'disable']",
+	},
+	{
+		.name = "image_cache",
+		.handler = handle_image_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "Keep parsed images and their checksums in memory "
+				"for the next command using the same file.",
+		.usage = "['enable'|'disable']",
+	},
+	{
+		.name = "image_cache_dir",
+		.handler = handle_image_cache_dir_command,
+		.mode = COMMAND_ANY,
+		.help = "Also store parsed images in this directory.",
+		.usage = "[directory|'none']",
+	},
+	{
+		.name = "image_cache_flush",
+		.handler = handle_image_cache_flush_command,
+		.mode = COMMAND_ANY,
+		.help = "Forget all images held in memory by the image cache.",
+		.usage = "",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -5865,6 +6768,106 @@ static void binprint(struct command_context *cmd_ctx, const char *text, const ui
 	command_print(cmd_ctx, " ");
 }
 
+/* Check that a working area only partly written by OpenOCD is restored
+ * completely, although the algorithm changed all of it. */
+COMMAND_HANDLER(handle_test_work_area_backup_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct working_area *wa = NULL;
+	uint32_t test_size = 256;
+	uint32_t address;
+	int retval;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], test_size);
+	test_size &= ~3;
+	if (test_size < 8)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_INFO("target not halted !!");
+		return ERROR_FAIL;
+	}
+	if (!target->backup_working_area) {
+		LOG_ERROR("the working area of %s is not backed up", target_name(target));
+		return ERROR_FAIL;
+	}
+
+	uint8_t *pattern = malloc(test_size);
+	uint8_t *scribble = malloc(test_size);
+	uint8_t *readback = malloc(test_size);
+	if (pattern == NULL || scribble == NULL || readback == NULL) {
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
+	for (uint32_t i = 0; i < test_size; i++) {
+		pattern[i] = rand();
+		scribble[i] = ~pattern[i];
+	}
+
+	/* stands for user data in the memory the area is carved from */
+	retval = target_alloc_working_area(target, test_size, &wa);
+	if (retval != ERROR_OK)
+		goto out;
+	address = wa->address;
+	target_free_working_area_restore(target, wa, 0);
+	retval = target_write_memory(target, address, 4, test_size / 4, pattern);
+	if (retval != ERROR_OK)
+		goto out;
+
+	/* OpenOCD writes code to the start of the area only ... */
+	retval = target_alloc_working_area(target, test_size, &wa);
+	if (retval != ERROR_OK)
+		goto out;
+	if (wa->address != address) {
+		LOG_ERROR("working area moved, free the other areas first");
+		target_free_working_area(target, wa);
+		retval = ERROR_FAIL;
+		goto out;
+	}
+	retval = target_write_memory(target, address, 4, 1, scribble);
+	if (retval == ERROR_OK) {
+		struct reg_param sp;
+		init_reg_param(&sp, "sp", 32, PARAM_OUT);
+		buf_set_u32(sp.value, 0, 32, address + test_size);
+		retval = target_backup_algorithm_memory(target, 0, NULL, 1, &sp);
+		destroy_reg_param(&sp);
+	}
+	/* ... while the algorithm uses the rest as its stack */
+	if (retval == ERROR_OK)
+		retval = target->type->write_memory(target, address + 4, 4,
+				test_size / 4 - 1, scribble + 4);
+	if (retval == ERROR_OK)
+		retval = target_free_working_area(target, wa);
+	else
+		target_free_working_area(target, wa);
+	if (retval != ERROR_OK)
+		goto out;
+
+	retval = target_read_memory(target, address, 4, test_size / 4, readback);
+	if (retval != ERROR_OK)
+		goto out;
+
+	for (uint32_t i = 0; i < test_size; i++) {
+		if (readback[i] != pattern[i]) {
+			command_print(CMD_CTX, "working area at 0x%08" PRIx32 " not restored, "
+					"first difference at offset %" PRIu32, address, i);
+			retval = ERROR_FAIL;
+			goto out;
+		}
+	}
+	command_print(CMD_CTX, "%" PRIu32 " bytes of working area restored", test_size);
+
+out:
+	free(pattern);
+	free(scribble);
+	free(readback);
+	return retval;
+}
+
 COMMAND_HANDLER(handle_test_mem_access_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -6258,6 +7261,34 @@ static const struct command_registration target_exec_command_handlers[] = {
 			"and write the 8/16/32 bit values",
 		.usage = "arrayname bitwidth address count",
 	},
+	{
+		.name = "mem2bin",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_mem2bin,
+		.help = "Reads 8/16/32 bit target memory into a binary string",
+		.usage = "width address count [phys] [little|big]",
+	},
+	{
+		.name = "bin2mem",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_bin2mem,
+		.help = "Writes a binary string to target memory using 8/16/32 bit accesses",
+		.usage = "width address data [phys] [little|big]",
+	},
+	{
+		.name = "mem2file",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_mem2file,
+		.help = "Dumps 8/16/32 bit target memory to a host file",
+		.usage = "filename width address count [phys] [little|big]",
+	},
+	{
+		.name = "file2mem",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_file2mem,
+		.help = "Writes a host file to target memory using 8/16/32 bit accesses",
+		.usage = "filename width address [phys] [little|big]",
+	},
 	{
 		.name = "reset_nag",
 		.handler = handle_target_reset_nag,
@@ -6280,6 +7311,14 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.help = "Test the target's memory access functions",
 		.usage = "size",
 	},
+	{
+		.name = "test_work_area_backup",
+		.handler = handle_test_work_area_backup_command,
+		.mode = COMMAND_EXEC,
+		.help = "Test that a partly written working area is restored "
+			"after an algorithm ran",
+		.usage = "[size]",
+	},
 
 	COMMAND_REGISTRATION_DONE
 };
@@ -6294,6 +7333,10 @@ static int target_register_user_commands(struct command_context *cmd_ctx)
 	if (retval != ERROR_OK)
 		return retval;
 
+	retval = rtt_register_commands(cmd_ctx);
+	if (retval != ERROR_OK)
+		return retval;
+
 
 	return register_commands(cmd_ctx, NULL, target_exec_command_handlers);
 }
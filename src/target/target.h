@@ -97,8 +97,17 @@ struct working_area {
 	uint32_t size;
 	bool free;
 	uint8_t *backup;
+	uint32_t *dirty;		/* bitmap of backed up (and since changed) words */
+	/* set by callers whose algorithm writes to this area through pointers
+	 * not passed in registers, so it is backed up in full before running */
+	bool algorithm_scratch;
 	struct working_area **user;
 	struct working_area *next;
+	/* resident algorithm code, kept allocated while idle (user == NULL) */
+	bool resident;
+	uint8_t *code;
+	uint32_t code_size;
+	uint32_t code_hash;
 };
 
 struct gdb_service {
@@ -584,6 +593,15 @@ int target_checksum_memory(struct target *target,
 		uint32_t address, uint32_t size, uint32_t *crc);
 int target_blank_check_memory(struct target *target,
 		uint32_t address, uint32_t size, uint32_t *blank, uint8_t erased_value);
+
+/**
+ * Write @a size bytes like target_write_buffer(), but download them
+ * compressed and decompress them on the target when compressed downloads
+ * are enabled and the target supports them. Falls back to
+ * target_write_buffer() whenever that doesn't pay off.
+ */
+int target_write_compressed(struct target *target,
+		uint32_t address, uint32_t size, const uint8_t *buffer);
 int target_wait_state(struct target *target, enum target_state state, int ms);
 
 /**
@@ -632,6 +650,16 @@ int target_alloc_working_area(struct target *target,
  */
 int target_alloc_working_area_try(struct target *target,
 		uint32_t size, struct working_area **area);
+/* Allocate a working area and download the algorithm @a code into it.
+ *
+ * The code stays resident after target_free_working_area(), so a later
+ * request for identical code reuses it without downloading it again.
+ * Idle resident code is evicted (and its backup restored) when the space
+ * is needed by another allocation, when it is overwritten by a memory
+ * write, and by target_free_all_working_areas() on resume or reset.
+ */
+int target_alloc_working_area_code(struct target *target,
+		const uint8_t *code, uint32_t size, struct working_area **area);
 int target_free_working_area(struct target *target, struct working_area *area);
 void target_free_all_working_areas(struct target *target);
 uint32_t target_get_working_area_avail(struct target *target);
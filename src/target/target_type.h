@@ -133,6 +133,16 @@ struct target_type {
 	int (*blank_check_memory)(struct target *target, uint32_t address,
 			uint32_t count, uint32_t *blank, uint8_t erased_value);
 
+	/**
+	 * Optional. Writes @a size bytes to RAM by downloading them LZ4
+	 * compressed and decompressing them on the target. Returns
+	 * ERROR_TARGET_RESOURCE_NOT_AVAILABLE if the data should rather be
+	 * written with write_buffer, e.g. because it doesn't compress or
+	 * there is no working area.
+	 */
+	int (*write_compressed)(struct target *target, uint32_t address,
+			uint32_t size, const uint8_t *buffer);
+
 	/*
 	 * target break-/watchpoint control
 	 * rw: 0 = write, 1 = read, 2 = access